@@ -17,6 +17,10 @@ void tb_flush(CPUState *cpu)
 {
 }
 
+void cpu_tb_jmp_cache_clear(CPUState *cpu)
+{
+}
+
 void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 {
 }
@@ -175,6 +175,7 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
                                           uint32_t flags, uint32_t cflags)
 {
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
     TranslationBlock *tb;
     uint32_t hash;
 
@@ -182,24 +183,28 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
     tcg_debug_assert(!(cflags & CF_INVALID));
 
     hash = tb_jmp_cache_hash_func(pc);
-    tb = qatomic_rcu_read(&cpu->tb_jmp_cache[hash]);
-
-    if (likely(tb &&
-               tb->pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               tb_cflags(tb) == cflags)) {
+    tb = tb_jmp_cache_get(jc, hash, pc, cs_base, flags, cflags);
+    if (likely(tb)) {
         return tb;
     }
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
-    qatomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_insert(jc, hash, tb, pc, cs_base, flags, cflags);
     return tb;
 }
 
+void cpu_tb_jmp_cache_clear(CPUState *cpu)
+{
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+    if (jc) {
+        tb_jmp_cache_clear_range(jc, 0, TB_JMP_CACHE_SIZE);
+    }
+    tb_ret_stack_clear(cpu);
+}
+
 static inline void log_cpu_exec(target_ulong pc, CPUState *cpu,
                                 const TranslationBlock *tb)
 {
@@ -302,15 +307,8 @@ static bool check_for_breakpoints(CPUState *cpu, target_ulong pc,
     return false;
 }
 
-/**
- * helper_lookup_tb_ptr: quick check for next tb
- * @env: current cpu state
- *
- * Look for an existing TB matching the current cpu state.
- * If found, return the code pointer.  If not found, return
- * the tcg epilogue so that we return into cpu_tb_exec.
- */
-const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+/* Look for an existing TB matching the current cpu state. */
+static TranslationBlock *lookup_tb_for_ptr(CPUArchState *env)
 {
     CPUState *cpu = env_cpu(env);
     TranslationBlock *tb;
@@ -326,12 +324,33 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
 
     tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
-        return tcg_code_gen_epilogue;
+        return NULL;
     }
 
     log_cpu_exec(pc, cpu, tb);
 
-    return tb->tc.ptr;
+    return tb;
+}
+
+/**
+ * helper_lookup_tb_ptr: quick check for next tb
+ * @env: current cpu state
+ *
+ * Look for an existing TB matching the current cpu state.
+ * If found, return the code pointer.  If not found, return
+ * the tcg epilogue so that we return into cpu_tb_exec.
+ */
+const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+{
+    TranslationBlock *tb = lookup_tb_for_ptr(env);
+    const void *code;
+
+    if (tb == NULL) {
+        return tcg_code_gen_epilogue;
+    }
+    code = tb_jmp_cache_code_ptr(tb);
+    tcg_region_mark_used(code);
+    return code;
 }
 
 /* Execute a TB, and fix up the CPU state afterwards if necessary */
@@ -421,6 +440,25 @@ static void cpu_exec_exit(CPUState *cpu)
     }
 }
 
+/*
+ * With "atomic-step=locked", insns which cannot be executed atomically
+ * in a parallel context are run serially while holding atomic_step_lock,
+ * instead of stopping every other vCPU.  This makes them atomic with
+ * respect to each other, which is what guest CAS and LL/SC loops need.
+ * It does not make them atomic with respect to anything else the other
+ * vCPUs do, which includes the host atomic operations that their
+ * CF_PARALLEL code uses for the guest atomics TCG can translate; hence
+ * it is not the default.
+ */
+static bool atomic_step_locked;
+static QemuMutex atomic_step_lock;
+
+void cpu_exec_atomic_init(bool locked)
+{
+    atomic_step_locked = locked;
+    qemu_mutex_init(&atomic_step_lock);
+}
+
 void cpu_exec_step_atomic(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -430,17 +468,28 @@ void cpu_exec_step_atomic(CPUState *cpu)
     int tb_exit;
 
     if (sigsetjmp(cpu->jmp_env, 0) == 0) {
-        start_exclusive();
         g_assert(cpu == current_cpu);
-        g_assert(!cpu->running);
-        cpu->running = true;
+        if (atomic_step_locked) {
+            /*
+             * Take the lock before joining the running vCPUs, so that
+             * we never hold up an exclusive section while waiting.
+             */
+            qemu_mutex_lock(&atomic_step_lock);
+            cpu_exec_start(cpu);
+            qatomic_inc(&tb_ctx.atomic_locked_count);
+        } else {
+            start_exclusive();
+            g_assert(!cpu->running);
+            cpu->running = true;
+            qatomic_inc(&tb_ctx.atomic_exclusive_count);
+        }
 
         cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
 
         cflags = curr_cflags(cpu);
         /* Execute in a serial context. */
         cflags &= ~CF_PARALLEL;
-        /* After 1 insn, return and release the exclusive lock. */
+        /* After 1 insn, return and release the exclusive lock or mutex. */
         cflags |= CF_NO_GOTO_TB | CF_NO_GOTO_PTR | 1;
         /*
          * No need to check_for_breakpoints here.
@@ -478,13 +527,70 @@ void cpu_exec_step_atomic(CPUState *cpu)
     }
 
     /*
-     * As we start the exclusive region before codegen we must still
-     * be in the region if we longjump out of either the codegen or
-     * the execution.
+     * As we start the exclusive region (or take the lock) before codegen
+     * we must still be in the region if we longjump out of either the
+     * codegen or the execution.
      */
-    g_assert(cpu_in_exclusive_context(cpu));
-    cpu->running = false;
-    end_exclusive();
+    if (atomic_step_locked) {
+        cpu_exec_end(cpu);
+        qemu_mutex_unlock(&atomic_step_lock);
+    } else {
+        g_assert(cpu_in_exclusive_context(cpu));
+        cpu->running = false;
+        end_exclusive();
+    }
+}
+
+/*
+ * Statistics about the time a vCPU is stalled translating a missed TB,
+ * from the lookup miss until the new TB is published in the hash table.
+ * The number of vCPUs stalled at the same time is also tracked.
+ *
+ * The translation itself cannot be moved to another thread: code is
+ * fetched through the softmmu TLB of the vCPU and a fetch fault unwinds
+ * into its cpu_exec loop.  See docs/devel/multi-thread-tcg.rst.
+ */
+static __thread int64_t tb_gen_start_ns;
+
+static void tb_gen_stats_begin(void)
+{
+    unsigned inflight = qatomic_fetch_inc(&tb_ctx.tb_gen_inflight) + 1;
+
+    stat64_max(&tb_ctx.tb_gen_inflight_max, inflight);
+    tb_gen_start_ns = get_clock();
+}
+
+static void tb_gen_stats_end(bool aborted)
+{
+    int64_t delta = get_clock() - tb_gen_start_ns;
+
+    tb_gen_start_ns = 0;
+    qatomic_dec(&tb_ctx.tb_gen_inflight);
+    if (aborted) {
+        /* the code fetch faulted, or the code buffer had to be flushed */
+        stat64_add(&tb_ctx.tb_gen_aborted, 1);
+        return;
+    }
+    stat64_add(&tb_ctx.tb_gen_count, 1);
+    stat64_add(&tb_ctx.tb_gen_time_ns, delta);
+    stat64_max(&tb_ctx.tb_gen_time_max_ns, delta);
+}
+
+void tb_gen_dump_info(GString *buf)
+{
+    uint64_t count = stat64_get(&tb_ctx.tb_gen_count);
+    uint64_t time = stat64_get(&tb_ctx.tb_gen_time_ns);
+
+    g_string_append_printf(buf, "TB miss translations %" PRIu64
+                           " (%" PRIu64 " aborted)\n", count,
+                           stat64_get(&tb_ctx.tb_gen_aborted));
+    g_string_append_printf(buf, "TB time-to-publish  avg %" PRIu64
+                           " ns, max %" PRIu64 " ns\n",
+                           count ? time / count : 0,
+                           stat64_get(&tb_ctx.tb_gen_time_max_ns));
+    g_string_append_printf(buf, "TB translations in flight %u (max %" PRIu64
+                           ")\n", qatomic_read(&tb_ctx.tb_gen_inflight),
+                           stat64_get(&tb_ctx.tb_gen_inflight_max));
 }
 
 struct tb_desc {
@@ -581,8 +687,14 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
         goto out_unlock_next;
     }
 
-    /* patch the native jump address */
-    tb_set_jmp_target(tb, n, (uintptr_t)tb_next->tc.ptr);
+    /* patch the native jump address, or set the prediction */
+    if (n == TB_JMP_PRED) {
+        qatomic_set(&tb->jmp_pred, tb_next);
+    } else if (n == TB_JMP_RET) {
+        qatomic_set(&tb->jmp_ret, tb_next);
+    } else {
+        tb_set_jmp_target(tb, n, (uintptr_t)tb_next->tc.ptr);
+    }
 
     /* add in TB jmp list */
     tb->jmp_list_next[n] = tb_next->jmp_list_head;
@@ -590,6 +702,9 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
 
     qemu_spin_unlock(&tb_next->jmp_lock);
 
+    /* from now on @tb_next may run without going through cpu_exec */
+    tcg_region_mark_used(tb_next->tc.ptr);
+
     qemu_log_mask_and_addr(CPU_LOG_EXEC, tb->pc,
                            "Linking TBs %p [" TARGET_FMT_lx
                            "] index %d -> %p [" TARGET_FMT_lx "]\n",
@@ -602,6 +717,84 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
     return;
 }
 
+/*
+ * The generated code only compares the pc with that of the predicted TB,
+ * so the prediction must only be made if the rest of the lookup key is
+ * that of @src; the frontend guarantees that the branch does not change
+ * it.  As for direct jumps, a destination on another page is not safe in
+ * system emulation because the mapping of that page can change.
+ */
+static bool tb_pred_compatible(TranslationBlock *src, TranslationBlock *tb)
+{
+    const uint32_t mask = ~CF_INVALID;
+
+#ifndef CONFIG_USER_ONLY
+    if ((tb->pc & TARGET_PAGE_MASK) != (src->pc & TARGET_PAGE_MASK) ||
+        tb->page_addr[1] != -1) {
+        return false;
+    }
+#endif
+    return tb->cs_base == src->cs_base &&
+           tb->flags == src->flags &&
+           tb->trace_vcpu_dstate == src->trace_vcpu_dstate &&
+           (tb_cflags(tb) & mask) == (tb_cflags(src) & mask);
+}
+
+/**
+ * helper_lookup_tb_ptr_pred: quick check for next tb, with prediction
+ * @env: current cpu state
+ * @src_ptr: the TB ending with the indirect branch
+ *
+ * As helper_lookup_tb_ptr, but also record the TB found as the predicted
+ * destination of @src_ptr, see tcg_gen_lookup_and_goto_ptr_pred.
+ */
+const void *HELPER(lookup_tb_ptr_pred)(CPUArchState *env, void *src_ptr)
+{
+    TranslationBlock *src = src_ptr;
+    TranslationBlock *tb = lookup_tb_for_ptr(env);
+    const void *code;
+
+    if (tb == NULL) {
+        return tcg_code_gen_epilogue;
+    }
+    if (tb != qatomic_read(&src->jmp_pred) && tb_pred_compatible(src, tb)) {
+        tb_remove_pred(src);
+        tb_add_jump(src, TB_JMP_PRED, tb);
+    }
+    code = tb_jmp_cache_code_ptr(tb);
+    tcg_region_mark_used(code);
+    return code;
+}
+
+/**
+ * helper_lookup_tb_ptr_ret: quick check for next tb, after a return
+ * @env: current cpu state
+ * @call_ptr: the TB containing the call, from the return stack, or NULL
+ * @ret_pc: the return address pushed by that call
+ *
+ * As helper_lookup_tb_ptr, but also record the TB found as the return
+ * destination of @call_ptr if the prediction was right, see
+ * tcg_gen_lookup_and_goto_ptr_ret.
+ */
+const void *HELPER(lookup_tb_ptr_ret)(CPUArchState *env, void *call_ptr,
+                                      target_ulong ret_pc)
+{
+    TranslationBlock *call = call_ptr;
+    TranslationBlock *tb = lookup_tb_for_ptr(env);
+    const void *code;
+
+    if (tb == NULL) {
+        return tcg_code_gen_epilogue;
+    }
+    if (call && tb->pc == ret_pc && qatomic_read(&call->jmp_ret) == NULL &&
+        tb_pred_compatible(call, tb)) {
+        tb_add_jump(call, TB_JMP_RET, tb);
+    }
+    code = tb_jmp_cache_code_ptr(tb);
+    tcg_region_mark_used(code);
+    return code;
+}
+
 static inline bool cpu_handle_halt(CPUState *cpu)
 {
 #ifndef CONFIG_USER_ONLY
@@ -720,6 +913,23 @@ static inline bool need_replay_interrupt(int interrupt_request)
 }
 #endif /* !CONFIG_USER_ONLY */
 
+#ifdef CONFIG_PLUGIN
+/*
+ * Deliver a pending sample. We are between TBs, so the state in env is
+ * up to date and the pc is the start of the next block to execute.
+ */
+static void cpu_plugin_sample(CPUState *cpu)
+{
+    CPUArchState *env = cpu->env_ptr;
+    target_ulong pc, cs_base;
+    uint32_t flags;
+
+    qatomic_set(&cpu->plugin_sample_pending, false);
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    qemu_plugin_vcpu_sample_cb(cpu, pc);
+}
+#endif
+
 static inline bool cpu_handle_interrupt(CPUState *cpu,
                                         TranslationBlock **last_tb)
 {
@@ -739,6 +949,12 @@ static inline bool cpu_handle_interrupt(CPUState *cpu,
      */
     qatomic_mb_set(&cpu_neg(cpu)->icount_decr.u16.high, 0);
 
+#ifdef CONFIG_PLUGIN
+    if (unlikely(qatomic_read(&cpu->plugin_sample_pending))) {
+        cpu_plugin_sample(cpu);
+    }
+#endif
+
     if (unlikely(qatomic_read(&cpu->interrupt_request))) {
         int interrupt_request;
         qemu_mutex_lock_iothread();
@@ -942,6 +1158,9 @@ int cpu_exec(CPUState *cpu)
             qemu_mutex_unlock_iothread();
         }
         qemu_plugin_disable_mem_helpers(cpu);
+        if (tb_gen_start_ns) {
+            tb_gen_stats_end(true);
+        }
 
         assert_no_pages_locked();
     }
@@ -978,14 +1197,20 @@ int cpu_exec(CPUState *cpu)
 
             tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
             if (tb == NULL) {
+                tb_gen_stats_begin();
                 mmap_lock();
                 tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+                tb_gen_stats_end(false);
                 mmap_unlock();
                 /*
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                qatomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+                tb_jmp_cache_insert(cpu->tb_jmp_cache,
+                                    tb_jmp_cache_hash_func(pc), tb,
+                                    pc, cs_base, flags, cflags);
+                /* Only once the lookup is complete, as it may exit. */
+                tb_prefetch_page(cpu, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -1004,6 +1229,7 @@ int cpu_exec(CPUState *cpu)
                 tb_add_jump(last_tb, tb_exit, tb);
             }
 
+            tcg_region_mark_used(tb->tc.ptr);
             cpu_loop_exec_tb(cpu, tb, &last_tb, &tb_exit);
 
             /* Try to align the host and virtual clocks
@@ -1013,6 +1239,8 @@ int cpu_exec(CPUState *cpu)
     }
 
     cpu_exec_exit(cpu);
+    /* do not keep accesses in the trace buffer while the vCPU is away */
+    qemu_plugin_vcpu_mem_trace_flush(cpu);
     rcu_read_unlock();
 
     return ret;
@@ -1027,6 +1255,9 @@ void tcg_exec_realizefn(CPUState *cpu, Error **errp)
         cc->tcg_ops->initialize();
         tcg_target_initialized = true;
     }
+    cpu->tb_jmp_cache = qemu_memalign(sizeof(CPUJumpCacheBucket),
+                                      sizeof(CPUJumpCache));
+    memset(cpu->tb_jmp_cache, 0, sizeof(CPUJumpCache));
     tlb_init(cpu);
     qemu_plugin_vcpu_init_hook(cpu);
 
@@ -1044,6 +1275,8 @@ void tcg_exec_unrealizefn(CPUState *cpu)
 
     qemu_plugin_vcpu_exit_hook(cpu);
     tlb_destroy(cpu);
+    qemu_vfree(cpu->tb_jmp_cache);
+    cpu->tb_jmp_cache = NULL;
 }
 
 #ifndef CONFIG_USER_ONLY
@@ -81,14 +81,22 @@ QEMU_BUILD_BUG_ON(sizeof(target_ulong) > sizeof(run_on_cpu_data));
 QEMU_BUILD_BUG_ON(NB_MMU_MODES > 16);
 #define ALL_MMUIDX_BITS ((1 << NB_MMU_MODES) - 1)
 
+unsigned tcg_tlb_ways = 1;
+unsigned tcg_tlb_victim_size = CPU_VTLB_SIZE;
+
 static inline size_t tlb_n_entries(CPUTLBDescFast *fast)
 {
-    return (fast->mask >> CPU_TLB_ENTRY_BITS) + 1;
+    return (fast->mask >> CPU_TLB_ENTRY_BITS) + tcg_tlb_ways;
 }
 
 static inline size_t sizeof_tlb(CPUTLBDescFast *fast)
 {
-    return fast->mask + (1 << CPU_TLB_ENTRY_BITS);
+    return fast->mask + (tcg_tlb_ways << CPU_TLB_ENTRY_BITS);
+}
+
+static inline uintptr_t tlb_mask_for(size_t n_entries)
+{
+    return (n_entries - tcg_tlb_ways) << CPU_TLB_ENTRY_BITS;
 }
 
 static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
@@ -96,15 +104,14 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
 {
     desc->window_begin_ns = ns;
     desc->window_max_entries = max_entries;
+    desc->window_max_evictions = 0;
 }
 
 static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
 {
-    unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
-
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
-    }
+    tb_jmp_cache_clear_range(cpu->tb_jmp_cache,
+                             tb_jmp_cache_hash_page(page_addr),
+                             TB_JMP_PAGE_SIZE);
 }
 
 static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
@@ -113,6 +120,7 @@ static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
        overlap the flushed page.  */
     tb_jmp_cache_clear_page(cpu, addr - TARGET_PAGE_SIZE);
     tb_jmp_cache_clear_page(cpu, addr);
+    tb_ret_stack_clear(cpu);
 }
 
 /**
@@ -151,15 +159,24 @@ static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
  *
  * 3. Try to keep the maximum use rate in a time window in the 30-70% range,
  * since in that range performance is likely near-optimal. Recall that the TLB
- * is direct mapped, so we want the use rate to be low (or at least not too
- * high), since otherwise we are likely to have a significant amount of
- * conflict misses.
+ * is direct mapped or 2-way associative, so we want the use rate to be low
+ * (or at least not too high), since otherwise we are likely to have a
+ * significant amount of conflict misses.
+ *
+ * 4. Since the use rate only counts distinct pages, also grow the TLB when
+ * fills have evicted more than half of its entries into the victim TLB
+ * between two flushes, and do not shrink it while that is the case within
+ * the window: scattered access patterns can thrash a table that is mostly
+ * empty.
+ *
+ * All of this is tracked separately for each mmu_idx, so that for instance
+ * a large user-mode working set does not inflate the kernel-mode TLB.
  */
 static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
                                   int64_t now)
 {
     size_t old_size = tlb_n_entries(fast);
-    size_t rate;
+    size_t rate, conflict_rate;
     size_t new_size = old_size;
     int64_t window_len_ms = 100;
     int64_t window_len_ns = window_len_ms * 1000 * 1000;
@@ -168,9 +185,13 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     if (desc->n_used_entries > desc->window_max_entries) {
         desc->window_max_entries = desc->n_used_entries;
     }
+    if (desc->n_evictions > desc->window_max_evictions) {
+        desc->window_max_evictions = desc->n_evictions;
+    }
     rate = desc->window_max_entries * 100 / old_size;
+    conflict_rate = desc->window_max_evictions * 100 / old_size;
 
-    if (rate > 70) {
+    if (rate > 70 || conflict_rate > 50) {
         new_size = MIN(old_size << 1, 1 << CPU_TLB_DYN_MAX_BITS);
     } else if (rate < 30 && window_expired) {
         size_t ceil = pow2ceil(desc->window_max_entries);
@@ -204,7 +225,7 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 
     tlb_window_reset(desc, now, 0);
     /* desc->n_used_entries is cleared by the caller */
-    fast->mask = (new_size - 1) << CPU_TLB_ENTRY_BITS;
+    fast->mask = tlb_mask_for(new_size);
     fast->table = g_try_new(CPUTLBEntry, new_size);
     desc->iotlb = g_try_new(CPUIOTLBEntry, new_size);
 
@@ -221,7 +242,7 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
             abort();
         }
         new_size = MAX(new_size >> 1, 1 << CPU_TLB_DYN_MIN_BITS);
-        fast->mask = (new_size - 1) << CPU_TLB_ENTRY_BITS;
+        fast->mask = tlb_mask_for(new_size);
 
         g_free(fast->table);
         g_free(desc->iotlb);
@@ -233,11 +254,14 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
+    desc->n_evictions = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
+    desc->lindex = 0;
+    memset(desc->ltlb, 0, sizeof(desc->ltlb));
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
-    memset(desc->vtable, -1, sizeof(desc->vtable));
+    memset(desc->vtable, -1, tcg_tlb_victim_size * sizeof(CPUTLBEntry));
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
@@ -256,9 +280,11 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
 
     tlb_window_reset(desc, now, 0);
     desc->n_used_entries = 0;
-    fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
+    fast->mask = tlb_mask_for(n_entries);
     fast->table = g_new(CPUTLBEntry, n_entries);
     desc->iotlb = g_new(CPUIOTLBEntry, n_entries);
+    desc->vtable = g_new(CPUTLBEntry, tcg_tlb_victim_size);
+    desc->viotlb = g_new(CPUIOTLBEntry, tcg_tlb_victim_size);
     tlb_mmu_flush_locked(desc, fast);
 }
 
@@ -300,6 +326,8 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->iotlb);
+        g_free(desc->vtable);
+        g_free(desc->viotlb);
     }
 }
 
@@ -339,6 +367,26 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+void tlb_lookup_counts(size_t *pway, size_t *pvictim, size_t *pfill,
+                       size_t *plarge)
+{
+    CPUState *cpu;
+    size_t way = 0, victim = 0, fill = 0, large = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        way += qatomic_read(&env_tlb(env)->c.way_hit_count);
+        victim += qatomic_read(&env_tlb(env)->c.victim_hit_count);
+        fill += qatomic_read(&env_tlb(env)->c.fill_count);
+        large += qatomic_read(&env_tlb(env)->c.large_fill_count);
+    }
+    *pway = way;
+    *pvictim = victim;
+    *pfill = fill;
+    *plarge = large;
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -347,6 +395,7 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
     int64_t now = get_clock_realtime();
 
     assert_cpu_is_self(cpu);
+    qemu_plugin_vcpu_tlb_change(cpu);
 
     tlb_debug("mmu_idx:0x%04" PRIx16 "\n", asked);
 
@@ -480,7 +529,7 @@ static void tlb_flush_vtlb_page_mask_locked(CPUArchState *env, int mmu_idx,
     int k;
 
     assert_cpu_is_self(env_cpu(env));
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+    for (k = 0; k < tcg_tlb_victim_size; k++) {
         if (tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
             tlb_n_used_entries_dec(env, mmu_idx);
         }
@@ -493,6 +542,21 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(env, mmu_idx, page, -1);
 }
 
+/* Called with tlb_c.lock held; flush @page from all ways of its set.  */
+static void tlb_flush_set_page_mask_locked(CPUArchState *env, int mmu_idx,
+                                           target_ulong page,
+                                           target_ulong mask)
+{
+    CPUTLBEntry *te = tlb_entry(env, mmu_idx, page);
+    unsigned w;
+
+    for (w = 0; w < tcg_tlb_ways; w++) {
+        if (tlb_flush_entry_mask_locked(&te[w], page, mask)) {
+            tlb_n_used_entries_dec(env, mmu_idx);
+        }
+    }
+}
+
 static void tlb_flush_page_locked(CPUArchState *env, int midx,
                                   target_ulong page)
 {
@@ -506,9 +570,7 @@ static void tlb_flush_page_locked(CPUArchState *env, int midx,
                   midx, lp_addr, lp_mask);
         tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
     } else {
-        if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
-            tlb_n_used_entries_dec(env, midx);
-        }
+        tlb_flush_set_page_mask_locked(env, midx, page, -1);
         tlb_flush_vtlb_page_locked(env, midx, page);
     }
 }
@@ -530,6 +592,7 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
+    qemu_plugin_vcpu_tlb_change(cpu);
 
     tlb_debug("page addr:" TARGET_FMT_lx " mmu_map:0x%x\n", addr, idxmap);
 
@@ -748,11 +811,8 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
 
     for (target_ulong i = 0; i < len; i += TARGET_PAGE_SIZE) {
         target_ulong page = addr + i;
-        CPUTLBEntry *entry = tlb_entry(env, midx, page);
 
-        if (tlb_flush_entry_mask_locked(entry, page, mask)) {
-            tlb_n_used_entries_dec(env, midx);
-        }
+        tlb_flush_set_page_mask_locked(env, midx, page, mask);
         tlb_flush_vtlb_page_mask_locked(env, midx, page, mask);
     }
 }
@@ -771,6 +831,7 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
+    qemu_plugin_vcpu_tlb_change(cpu);
 
     tlb_debug("range:" TARGET_FMT_lx "/%u+" TARGET_FMT_lx " mmu_map:0x%x\n",
               d.addr, d.bits, d.len, d.idxmap);
@@ -1030,7 +1091,7 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                          start1, length);
         }
 
-        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        for (i = 0; i < tcg_tlb_victim_size; i++) {
             tlb_reset_dirty_range_locked(&env_tlb(env)->d[mmu_idx].vtable[i],
                                          start1, length);
         }
@@ -1059,18 +1120,37 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     vaddr &= TARGET_PAGE_MASK;
     qemu_spin_lock(&env_tlb(env)->c.lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_set_dirty1_locked(tlb_entry(env, mmu_idx, vaddr), vaddr);
+        CPUTLBEntry *te = tlb_entry(env, mmu_idx, vaddr);
+        int w;
+
+        for (w = 0; w < tcg_tlb_ways; w++) {
+            tlb_set_dirty1_locked(&te[w], vaddr);
+        }
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        for (k = 0; k < tcg_tlb_victim_size; k++) {
             tlb_set_dirty1_locked(&env_tlb(env)->d[mmu_idx].vtable[k], vaddr);
         }
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
+/* Called with tlb_c.lock held; move the entry at @index to the victim tlb. */
+static void tlb_evict_to_victim_locked(CPUArchState *env, int mmu_idx,
+                                       size_t index)
+{
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    unsigned vidx = desc->vindex++ % tcg_tlb_victim_size;
+
+    copy_tlb_helper_locked(&desc->vtable[vidx],
+                           &env_tlb(env)->f[mmu_idx].table[index]);
+    desc->viotlb[vidx] = desc->iotlb[index];
+    desc->n_evictions++;
+    tlb_n_used_entries_dec(env, mmu_idx);
+}
+
 /* Our TLB does not support large pages, so remember the area covered by
    large pages and trigger a full TLB flush if these are invalidated.  */
 static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
@@ -1095,6 +1175,41 @@ static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
     env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
 }
 
+/*
+ * Remember a large page that the target declared as PAGE_LINEAR.  Since
+ * it is also covered by the large page region above, any flush of one of
+ * its pages flushes the whole mmu_idx, and with it this entry.
+ */
+static void tlb_add_large_entry(CPUArchState *env, int mmu_idx,
+                                target_ulong vaddr, hwaddr paddr,
+                                MemTxAttrs attrs, int prot,
+                                target_ulong size)
+{
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    target_ulong mask = ~(size - 1);
+    CPUTLBLargeEntry *e = NULL;
+    int i;
+
+    vaddr &= TARGET_PAGE_MASK;
+    paddr &= TARGET_PAGE_MASK;
+    for (i = 0; i < CPU_LTLB_SIZE; i++) {
+        if (desc->ltlb[i].prot &&
+            desc->ltlb[i].vaddr == (vaddr & mask) &&
+            desc->ltlb[i].mask == mask) {
+            e = &desc->ltlb[i];
+            break;
+        }
+    }
+    if (!e) {
+        e = &desc->ltlb[desc->lindex++ % CPU_LTLB_SIZE];
+    }
+    e->vaddr = vaddr & mask;
+    e->mask = mask;
+    e->paddr = paddr - (vaddr & ~mask);
+    e->attrs = attrs;
+    e->prot = prot;
+}
+
 /* Add a new TLB entry. At most one entry for a given virtual address
  * is permitted. Only a single TARGET_PAGE_SIZE region is mapped, the
  * supplied size is only used by tlb_flush_page.
@@ -1122,11 +1237,16 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     bool is_ram, is_romd;
 
     assert_cpu_is_self(cpu);
+    qemu_plugin_vcpu_tlb_change(cpu);
 
     if (size <= TARGET_PAGE_SIZE) {
         sz = TARGET_PAGE_SIZE;
     } else {
         tlb_add_large_page(env, mmu_idx, vaddr, size);
+        if ((prot & PAGE_LINEAR) && !(prot & PAGE_WRITE_INV)) {
+            tlb_add_large_entry(env, mmu_idx, vaddr, paddr, attrs,
+                                prot, size);
+        }
         sz = size;
     }
     vaddr_page = vaddr & TARGET_PAGE_MASK;
@@ -1208,20 +1328,27 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
 
     /* Make sure there's no cached translation for the new page.  */
     tlb_flush_vtlb_page_locked(env, mmu_idx, vaddr_page);
+    if (tcg_tlb_ways == 2 && tlb_flush_entry_locked(te + 1, vaddr_page)) {
+        tlb_n_used_entries_dec(env, mmu_idx);
+    }
 
     /*
-     * Only evict the old entry to the victim tlb if it's for a
-     * different page; otherwise just overwrite the stale data.
+     * Only evict the old entry if it's for a different page; otherwise
+     * just overwrite the stale data.  With two ways, the old entry is
+     * demoted to the second way and the entry there is evicted instead.
      */
     if (!tlb_hit_page_anyprot(te, vaddr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
-        CPUTLBEntry *tv = &desc->vtable[vidx];
-
-        /* Evict the old entry into the victim tlb.  */
-        copy_tlb_helper_locked(tv, te);
-        desc->viotlb[vidx] = desc->iotlb[index];
-        tlb_n_used_entries_dec(env, mmu_idx);
+        if (tcg_tlb_ways == 2) {
+            if (!tlb_entry_is_empty(te + 1)) {
+                tlb_evict_to_victim_locked(env, mmu_idx, index + 1);
+            }
+            copy_tlb_helper_locked(te + 1, te);
+            desc->iotlb[index + 1] = desc->iotlb[index];
+        } else {
+            tlb_evict_to_victim_locked(env, mmu_idx, index);
+        }
     }
+    qatomic_set(&tlb->c.fill_count, tlb->c.fill_count + 1);
 
     /* refill the tlb */
     /*
@@ -1295,6 +1422,37 @@ static inline ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr)
     return ram_addr;
 }
 
+/*
+ * Fill the TLB entry for @addr from a large page that was mapped with
+ * PAGE_LINEAR, if there is one that allows @access_type.  This saves
+ * the guest page table walk for all but the first page of a large page.
+ */
+static bool tlb_fill_large(CPUState *cpu, target_ulong addr,
+                           MMUAccessType access_type, int mmu_idx)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    int need = (access_type == MMU_INST_FETCH ? PAGE_EXEC
+                : access_type == MMU_DATA_STORE ? PAGE_WRITE : PAGE_READ);
+    int i;
+
+    for (i = 0; i < CPU_LTLB_SIZE; i++) {
+        CPUTLBLargeEntry *e = &desc->ltlb[i];
+
+        if ((e->prot & need) && (addr & e->mask) == e->vaddr) {
+            target_ulong page = addr & TARGET_PAGE_MASK;
+
+            tlb_set_page_with_attrs(cpu, page, e->paddr + (page - e->vaddr),
+                                    e->attrs, e->prot, mmu_idx,
+                                    -e->mask);
+            qatomic_set(&env_tlb(env)->c.large_fill_count,
+                        env_tlb(env)->c.large_fill_count + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
 /*
  * Note: tlb_fill() can trigger a resize of the TLB. This means that all of the
  * caller's prior references to the TLB table (e.g. CPUTLBEntry pointers) must
@@ -1306,6 +1464,10 @@ static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
     CPUClass *cc = CPU_GET_CLASS(cpu);
     bool ok;
 
+    if (tlb_fill_large(cpu, addr, access_type, mmu_idx)) {
+        return;
+    }
+
     /*
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
@@ -1451,38 +1613,53 @@ static inline target_ulong tlb_read_ofs(CPUTLBEntry *entry, size_t ofs)
 #endif
 }
 
-/* Return true if ADDR is present in the victim tlb, and has been copied
-   back to the main tlb.  */
+/* Swap the two tlb entries, along with their iotlb entries.  */
+static void tlb_swap_entries(CPUArchState *env, CPUTLBEntry *a,
+                             CPUIOTLBEntry *ioa, CPUTLBEntry *b,
+                             CPUIOTLBEntry *iob)
+{
+    CPUTLBEntry tmptlb;
+    CPUIOTLBEntry tmpio;
+
+    /* batched records look up their hwaddr in the entry being moved */
+    qemu_plugin_vcpu_tlb_change(env_cpu(env));
+
+    qemu_spin_lock(&env_tlb(env)->c.lock);
+    copy_tlb_helper_locked(&tmptlb, a);
+    copy_tlb_helper_locked(a, b);
+    copy_tlb_helper_locked(b, &tmptlb);
+    qemu_spin_unlock(&env_tlb(env)->c.lock);
+
+    tmpio = *ioa; *ioa = *iob; *iob = tmpio;
+}
+
+/*
+ * Return true if ADDR is present in the second way of its set or in the
+ * victim tlb, and has been copied back to the first way of the main tlb.
+ */
 static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
                            size_t elt_ofs, target_ulong page)
 {
+    CPUTLB *tlb = env_tlb(env);
+    CPUTLBEntry *te = &tlb->f[mmu_idx].table[index];
+    CPUIOTLBEntry *io = &tlb->d[mmu_idx].iotlb[index];
     size_t vidx;
 
     assert_cpu_is_self(env_cpu(env));
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &env_tlb(env)->d[mmu_idx].vtable[vidx];
-        target_ulong cmp;
+    if (tcg_tlb_ways == 2 && tlb_read_ofs(te + 1, elt_ofs) == page) {
+        tlb_swap_entries(env, te, io, te + 1, io + 1);
+        qatomic_set(&tlb->c.way_hit_count, tlb->c.way_hit_count + 1);
+        return true;
+    }
 
-        /* elt_ofs might correspond to .addr_write, so use qatomic_read */
-#if TCG_OVERSIZED_GUEST
-        cmp = *(target_ulong *)((uintptr_t)vtlb + elt_ofs);
-#else
-        cmp = qatomic_read((target_ulong *)((uintptr_t)vtlb + elt_ofs));
-#endif
+    for (vidx = 0; vidx < tcg_tlb_victim_size; ++vidx) {
+        CPUTLBEntry *vtlb = &tlb->d[mmu_idx].vtable[vidx];
 
-        if (cmp == page) {
+        if (tlb_read_ofs(vtlb, elt_ofs) == page) {
             /* Found entry in victim tlb, swap tlb and iotlb.  */
-            CPUTLBEntry tmptlb, *tlb = &env_tlb(env)->f[mmu_idx].table[index];
-
-            qemu_spin_lock(&env_tlb(env)->c.lock);
-            copy_tlb_helper_locked(&tmptlb, tlb);
-            copy_tlb_helper_locked(tlb, vtlb);
-            copy_tlb_helper_locked(vtlb, &tmptlb);
-            qemu_spin_unlock(&env_tlb(env)->c.lock);
-
-            CPUIOTLBEntry tmpio, *io = &env_tlb(env)->d[mmu_idx].iotlb[index];
-            CPUIOTLBEntry *vio = &env_tlb(env)->d[mmu_idx].viotlb[vidx];
-            tmpio = *io; *io = *vio; *vio = tmpio;
+            tlb_swap_entries(env, te, io, vtlb, &tlb->d[mmu_idx].viotlb[vidx]);
+            qatomic_set(&tlb->c.victim_hit_count,
+                        tlb->c.victim_hit_count + 1);
             return true;
         }
     }
@@ -1608,7 +1785,8 @@ static int probe_access_internal(CPUArchState *env, target_ulong addr,
             CPUState *cs = env_cpu(env);
             CPUClass *cc = CPU_GET_CLASS(cs);
 
-            if (!cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
+            if (!tlb_fill_large(cs, addr, access_type, mmu_idx) &&
+                !cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
                                        mmu_idx, nonfault, retaddr)) {
                 /* Non-faulting page table read failed.  */
                 *phost = NULL;
@@ -1727,6 +1905,13 @@ bool tlb_plugin_lookup(CPUState *cpu, target_ulong addr, int mmu_idx,
     uintptr_t index = tlb_index(env, mmu_idx, addr);
     target_ulong tlb_addr = is_store ? tlb_addr_write(tlbe) : tlbe->addr_read;
 
+    /* The backend may have hit in the second way without promoting it.  */
+    if (tcg_tlb_ways == 2 && !tlb_hit(tlb_addr, addr)) {
+        tlbe++;
+        index++;
+        tlb_addr = is_store ? tlb_addr_write(tlbe) : tlbe->addr_read;
+    }
+
     if (likely(tlb_hit(tlb_addr, addr))) {
         /* We must have an iotlb entry for MMIO */
         if (tlb_addr & TLB_MMIO) {
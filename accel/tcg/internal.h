@@ -15,7 +15,15 @@ TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
                               target_ulong cs_base, uint32_t flags,
                               int cflags);
 G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
+void tb_remove_pred(TranslationBlock *orig);
+void tb_gen_dump_info(GString *buf);
 void page_init(void);
+void cpu_exec_atomic_init(bool locked);
 void tb_htable_init(void);
 
+void tb_prefetch_init(const char *path);
+void tb_prefetch_record(void);
+void tb_prefetch_page(CPUState *cpu, TranslationBlock *tb);
+void tb_prefetch_dump_info(GString *buf);
+
 #endif /* ACCEL_TCG_INTERNAL_H */
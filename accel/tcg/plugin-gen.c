@@ -43,6 +43,7 @@
  * CPU's index into a TCG temp, since the first callback did it already.
  */
 #include "qemu/osdep.h"
+#include "qemu/bitmap.h"
 #include "tcg/tcg.h"
 #include "tcg/tcg-op.h"
 #include "exec/exec-all.h"
@@ -74,6 +75,9 @@ enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
     PLUGIN_GEN_CB_INLINE,
     PLUGIN_GEN_CB_MEM,
+    PLUGIN_GEN_CB_COND,
+    PLUGIN_GEN_CB_MEM_TRACE,
+    PLUGIN_GEN_CB_MEM_TRACE_FLUSH,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
     PLUGIN_GEN_DISABLE_MEM_HELPER,
     PLUGIN_GEN_N_CBS,
@@ -91,6 +95,11 @@ void HELPER(plugin_vcpu_mem_cb)(unsigned int vcpu_index,
                                 void *userdata)
 { }
 
+void HELPER(plugin_mem_trace_flush)(CPUArchState *env)
+{
+    qemu_plugin_vcpu_mem_trace_flush(env_cpu(env));
+}
+
 static void do_gen_mem_cb(TCGv vaddr, uint32_t info)
 {
     TCGv_i32 cpu_index = tcg_temp_new_i32();
@@ -123,21 +132,75 @@ static void gen_empty_udata_cb(void)
     tcg_temp_free_i32(cpu_index);
 }
 
+/*
+ * Compute into @ptr the address of the counter of the current vCPU, i.e.
+ * base + cpu_index * stride. The base (in @ptr) and the stride are
+ * overwritten later; a zero stride yields a counter shared by all vCPUs.
+ */
+static void gen_empty_vcpu_counter_ptr(TCGv_ptr ptr, TCGv_i32 cpu_index)
+{
+    TCGv_i32 offset = tcg_temp_new_i32();
+    TCGv_ptr offset_ptr = tcg_temp_new_ptr();
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    /* pass a multiplier that is not a power of 2 to get a mul_i32 */
+    tcg_gen_muli_i32(offset, cpu_index, 0xdeadface);
+    tcg_gen_ext_i32_ptr(offset_ptr, offset);
+    tcg_gen_add_ptr(ptr, ptr, offset_ptr);
+
+    tcg_temp_free_ptr(offset_ptr);
+    tcg_temp_free_i32(offset);
+}
+
 /*
  * For now we only support addi_i64.
  * When we support more ops, we can generate one empty inline cb for each.
  */
 static void gen_empty_inline_cb(void)
 {
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
     TCGv_i64 val = tcg_temp_new_i64();
     TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
 
+    gen_empty_vcpu_counter_ptr(ptr, cpu_index);
     tcg_gen_ld_i64(val, ptr, 0);
     /* pass an immediate != 0 so that it doesn't get optimized away */
     tcg_gen_addi_i64(val, val, 0xdeadface);
     tcg_gen_st_i64(val, ptr, 0);
     tcg_temp_free_ptr(ptr);
     tcg_temp_free_i64(val);
+    tcg_temp_free_i32(cpu_index);
+}
+
+/*
+ * Call the udata helper only if the current vCPU's counter satisfies a
+ * condition. The condition, the immediate and the label are overwritten
+ * later, each copy getting a label of its own. Temps do not survive the
+ * branch, so the call's arguments are set up after it.
+ */
+static void gen_empty_cond_cb(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
+    TCGv_ptr udata;
+    TCGLabel *skip = gen_new_label();
+
+    gen_empty_vcpu_counter_ptr(ptr, cpu_index);
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_brcondi_i64(TCG_COND_EQ, val, 0xdeadface, skip);
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    udata = tcg_const_ptr(NULL); /* overwritten later */
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+    gen_set_label(skip);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_i32(cpu_index);
 }
 
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
@@ -145,6 +208,75 @@ static void gen_empty_mem_cb(TCGv addr, uint32_t info)
     do_gen_mem_cb(addr, info);
 }
 
+/*
+ * Unlike the other templates, the memory trace ones are used as they are:
+ * the buffer is the same for all plugins, and the pc and meminfo of the
+ * record are known at translation time already.
+ */
+static void gen_empty_mem_trace(TCGv addr, uint32_t info)
+{
+    TCGv_ptr trace = tcg_temp_new_ptr();
+    TCGv_ptr rec = tcg_temp_new_ptr();
+    TCGv_i32 len = tcg_temp_new_i32();
+    TCGv_i32 val32 = tcg_temp_new_i32();
+    TCGv_i64 val64 = tcg_temp_new_i64();
+
+    tcg_gen_ld_ptr(trace, cpu_env, offsetof(CPUState, plugin_mem_trace) -
+                                   offsetof(ArchCPU, env));
+    tcg_gen_ld_i32(len, trace, offsetof(struct qemu_plugin_mem_trace, len));
+    tcg_gen_muli_i32(val32, len, sizeof(struct qemu_plugin_mem_record));
+    tcg_gen_ext_i32_ptr(rec, val32);
+    tcg_gen_add_ptr(rec, rec, trace);
+
+    tcg_gen_extu_tl_i64(val64, addr);
+    tcg_gen_st_i64(val64, rec, offsetof(struct qemu_plugin_mem_trace,
+                                        records[0].vaddr));
+    tcg_gen_movi_i64(val64, tcg_ctx->plugin_insn->vaddr);
+    tcg_gen_st_i64(val64, rec, offsetof(struct qemu_plugin_mem_trace,
+                                        records[0].pc));
+    tcg_gen_movi_i32(val32, info);
+    tcg_gen_st_i32(val32, rec, offsetof(struct qemu_plugin_mem_trace,
+                                        records[0].info));
+
+    tcg_gen_addi_i32(len, len, 1);
+    tcg_gen_st_i32(len, trace, offsetof(struct qemu_plugin_mem_trace, len));
+
+    tcg_temp_free_i64(val64);
+    tcg_temp_free_i32(val32);
+    tcg_temp_free_i32(len);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_ptr(trace);
+}
+
+/* Kept before every QEMU_PLUGIN_MEM_TRACE_TB_MAX'th traced access */
+static void gen_empty_mem_trace_flush(TCGv addr, uint32_t info)
+{
+    gen_helper_plugin_mem_trace_flush(cpu_env);
+}
+
+/*
+ * On TB entry, hand the buffer over if the TB's accesses might not fit.
+ * This is the only place where a branch does not end the live range of
+ * guest temps, hence the fixed threshold.
+ */
+static void gen_empty_mem_trace_check(void)
+{
+    TCGv_ptr trace = tcg_temp_new_ptr();
+    TCGv_i32 len = tcg_temp_new_i32();
+    TCGLabel *skip = gen_new_label();
+
+    tcg_gen_ld_ptr(trace, cpu_env, offsetof(CPUState, plugin_mem_trace) -
+                                   offsetof(ArchCPU, env));
+    tcg_gen_ld_i32(len, trace, offsetof(struct qemu_plugin_mem_trace, len));
+    tcg_gen_brcondi_i32(TCG_COND_LEU, len, QEMU_PLUGIN_MEM_TRACE_THRESHOLD,
+                        skip);
+    gen_helper_plugin_mem_trace_flush(cpu_env);
+    gen_set_label(skip);
+
+    tcg_temp_free_i32(len);
+    tcg_temp_free_ptr(trace);
+}
+
 /*
  * Share the same function for enable/disable. When enabling, the NULL
  * pointer will be overwritten later.
@@ -189,8 +321,13 @@ static void plugin_gen_empty_callback(enum plugin_gen_from from)
                     gen_empty_mem_helper);
         /* fall through */
     case PLUGIN_GEN_FROM_TB:
+        if (from == PLUGIN_GEN_FROM_TB) {
+            gen_wrapped(from, PLUGIN_GEN_CB_MEM_TRACE,
+                        gen_empty_mem_trace_check);
+        }
         gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        gen_wrapped(from, PLUGIN_GEN_CB_COND, gen_empty_cond_cb);
         break;
     default:
         g_assert_not_reached();
@@ -226,6 +363,12 @@ void plugin_gen_empty_mem_callback(TCGv addr, uint32_t info)
 
     fn.inline_fn = gen_empty_inline_cb;
     gen_mem_wrapped(PLUGIN_GEN_CB_INLINE, &fn, 0, info, false);
+
+    fn.mem_fn = gen_empty_mem_trace_flush;
+    gen_mem_wrapped(PLUGIN_GEN_CB_MEM_TRACE_FLUSH, &fn, addr, info, true);
+
+    fn.mem_fn = gen_empty_mem_trace;
+    gen_mem_wrapped(PLUGIN_GEN_CB_MEM_TRACE, &fn, addr, info, true);
 }
 
 static TCGOp *find_op(TCGOp *op, TCGOpcode opc)
@@ -366,6 +509,64 @@ static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
     return op;
 }
 
+static TCGOp *copy_mul_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static TCGOp *copy_ext_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* mov_i32 */
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        /* ext_i32_i64 */
+        op = copy_op(begin_op, op, INDEX_op_ext_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* add_i32 */
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        /* add_i64 */
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_brcondi_i64(TCGOp **begin_op, TCGOp *op, TCGCond cond,
+                               uint64_t v, TCGLabel *l)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        op = copy_op(begin_op, op, INDEX_op_brcond2_i32);
+        op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+        op->args[3] = tcgv_i32_arg(tcg_constant_i32(v >> 32));
+        op->args[4] = cond;
+        op->args[5] = label_arg(l);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_brcond_i64);
+        op->args[1] = tcgv_i64_arg(tcg_constant_i64(v));
+        op->args[2] = cond;
+        op->args[3] = label_arg(l);
+    }
+    l->refs++;
+    return op;
+}
+
+static TCGOp *copy_set_label(TCGOp **begin_op, TCGOp *op, TCGLabel *l)
+{
+    op = copy_op(begin_op, op, INDEX_op_set_label);
+    op->args[0] = label_arg(l);
+    l->present = 1;
+    return op;
+}
+
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -417,9 +618,49 @@ static TCGOp *copy_call(TCGOp **begin_op, TCGOp *op, void *empty_func,
  * empty callbacks. This will assert very quickly in a debug build as
  * we assert the ops we are replacing are the correct ones.
  */
+/*
+ * The udata helper is TCG_CALL_NO_RWG, so globals may still live in host
+ * registers when it runs. Store those that the callback reads to env.
+ */
+static TCGOp *append_reg_sync(const struct qemu_plugin_reg_sync *sync,
+                              TCGOp *op)
+{
+    size_t n = sync->all ? tcg_ctx->nb_globals : sync->n;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        TCGTemp *ts = &tcg_ctx->temps[sync->all ? i : sync->globals[i]];
+        TCGOpcode opc;
+
+        if (ts->kind != TEMP_GLOBAL) {
+            continue;
+        }
+        switch (ts->type) {
+        case TCG_TYPE_I32:
+            opc = INDEX_op_st_i32;
+            break;
+        case TCG_TYPE_I64:
+            opc = INDEX_op_st_i64;
+            break;
+        default:
+            continue;
+        }
+        op = tcg_op_insert_after(tcg_ctx, op, opc);
+        op->args[0] = temp_arg(ts);
+        op->args[1] = temp_arg(ts->mem_base);
+        op->args[2] = ts->mem_offset;
+    }
+    return op;
+}
+
 static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
                               TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
+    /* globals are already in env at the start of a TB */
+    if (cb->regs && begin_op->args[0] != PLUGIN_GEN_FROM_TB) {
+        op = append_reg_sync(cb->regs, op);
+    }
+
     /* const_ptr */
     op = copy_const_ptr(&begin_op, op, cb->userp);
 
@@ -438,12 +679,52 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+/*
+ * Base address and stride of the counter an inline op or conditional
+ * callback acts on. Plain pointers are shared by all vCPUs.
+ */
+static void *vcpu_counter_base(qemu_plugin_u64 entry, void *ptr,
+                               uint32_t *stride)
+{
+    if (entry.score == NULL) {
+        *stride = 0;
+        return ptr;
+    }
+    *stride = g_array_get_element_size(entry.score->data);
+    return entry.score->data->data + entry.offset;
+}
+
+/* copy the ops of gen_empty_vcpu_counter_ptr() */
+static TCGOp *copy_vcpu_counter_ptr(TCGOp **begin_op, TCGOp *op,
+                                    uint32_t stride)
+{
+    /* ld_i32 */
+    op = copy_op(begin_op, op, INDEX_op_ld_i32);
+
+    /* mul_i32 */
+    op = copy_mul_i32(begin_op, op, stride);
+
+    /* ext_i32_ptr */
+    op = copy_ext_i32_ptr(begin_op, op);
+
+    /* add_ptr */
+    op = copy_add_ptr(begin_op, op);
+
+    return op;
+}
+
 static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
+    uint32_t stride;
+    void *base = vcpu_counter_base(cb->inline_insn.entry, cb->userp, &stride);
+
     /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    op = copy_const_ptr(&begin_op, op, base);
+
+    /* counter address of the current vCPU */
+    op = copy_vcpu_counter_ptr(&begin_op, op, stride);
 
     /* ld_i64 */
     op = copy_ld_i64(&begin_op, op);
@@ -457,6 +738,64 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+static TCGCond plugin_cond_to_tcgcond(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        /* ALWAYS and NEVER are handled at registration time */
+        g_assert_not_reached();
+    }
+}
+
+static TCGOp *append_cond_cb(const struct qemu_plugin_dyn_cb *cb,
+                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    TCGCond cond = plugin_cond_to_tcgcond(cb->cond.cond);
+    TCGLabel *skip = gen_new_label();
+    uint32_t stride;
+    void *base = vcpu_counter_base(cb->cond.entry, NULL, &stride);
+
+    /* const_ptr */
+    op = copy_const_ptr(&begin_op, op, base);
+
+    /* counter address of the current vCPU */
+    op = copy_vcpu_counter_ptr(&begin_op, op, stride);
+
+    /* ld_i64 */
+    op = copy_ld_i64(&begin_op, op);
+
+    /* skip the call unless the condition holds */
+    op = copy_brcondi_i64(&begin_op, op, tcg_invert_cond(cond),
+                          cb->cond.imm, skip);
+
+    /* ld_i32 */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+
+    /* const_ptr */
+    op = copy_const_ptr(&begin_op, op, cb->userp);
+
+    /* call */
+    op = copy_call(&begin_op, op, HELPER(plugin_vcpu_udata_cb),
+                   cb->f.vcpu_udata, cb_idx);
+
+    /* set_label */
+    op = copy_set_label(&begin_op, op, skip);
+
+    return op;
+}
+
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
@@ -548,12 +887,33 @@ inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
     inject_cb_type(cbs, begin_op, append_inline_cb, ok);
 }
 
+static void
+inject_cond_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_cond_cb, op_ok);
+}
+
 static void
 inject_mem_cb(const GArray *cbs, TCGOp *begin_op)
 {
     inject_cb_type(cbs, begin_op, append_mem_cb, op_rw);
 }
 
+/* keep a memory trace template by removing the markers around it */
+static void inject_mem_trace(TCGOp *begin_op, bool enable)
+{
+    TCGOp *end_op;
+
+    if (!enable) {
+        rm_ops(begin_op);
+        return;
+    }
+    end_op = find_op(begin_op, INDEX_op_plugin_cb_end);
+    tcg_debug_assert(end_op);
+    rm_ops_range(end_op, end_op);
+    rm_ops_range(begin_op, begin_op);
+}
+
 /* we could change the ops in place, but we can reuse more code by copying */
 static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 {
@@ -588,12 +948,13 @@ static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 static void inject_mem_enable_helper(struct qemu_plugin_insn *plugin_insn,
                                      TCGOp *begin_op)
 {
-    GArray *cbs[2];
+    GArray *cbs[3];
     GArray *arr;
     size_t n_cbs, i;
 
     cbs[0] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR];
     cbs[1] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE];
+    cbs[2] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_TRACE];
 
     n_cbs = 0;
     for (i = 0; i < ARRAY_SIZE(cbs); i++) {
@@ -655,6 +1016,32 @@ static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
 }
 
+static bool plugin_gen_tb_cond(const struct qemu_plugin_tb *ptb,
+                               TCGOp *begin_op)
+{
+    const GArray *cbs = ptb->cbs[PLUGIN_CB_COND];
+
+    inject_cond_cb(cbs, begin_op);
+    return cbs && cbs->len;
+}
+
+static void plugin_gen_tb_mem_trace(const struct qemu_plugin_tb *ptb,
+                                    TCGOp *begin_op)
+{
+    bool enable = false;
+    size_t i;
+
+    for (i = 0; i < ptb->n; i++) {
+        struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, i);
+
+        if (insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_TRACE]->len) {
+            enable = true;
+            break;
+        }
+    }
+    inject_mem_trace(begin_op, enable);
+}
+
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
                                   TCGOp *begin_op, int insn_idx)
 {
@@ -671,6 +1058,69 @@ static void plugin_gen_insn_inline(const struct qemu_plugin_tb *ptb,
                      begin_op, op_ok);
 }
 
+static bool plugin_gen_insn_cond(const struct qemu_plugin_tb *ptb,
+                                 TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+    const GArray *cbs = insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_COND];
+
+    inject_cond_cb(cbs, begin_op);
+    return cbs && cbs->len;
+}
+
+/*
+ * The branch of a conditional callback and its label end the TCG basic
+ * block.  Translators may carry a value from one insn to the next in a
+ * normal or EBB temp, e.g. the AVR skip condition or the HPPA nullify
+ * operands, and such a temp would be lost across the callback.  Turn
+ * every temp that is live across a branch or label into a local temp,
+ * which the register allocator preserves across basic blocks.  Temps of
+ * code without conditional callbacks are never live there, so they are
+ * not affected.
+ */
+static void plugin_gen_keep_live_temps(void)
+{
+    TCGContext *s = tcg_ctx;
+    unsigned long *live = bitmap_new(s->nb_temps);
+    TCGOp *op;
+
+    QTAILQ_FOREACH_REVERSE(op, &s->ops, link) {
+        const TCGOpDef *def = &tcg_op_defs[op->opc];
+        int nb_oargs, nb_iargs, i;
+
+        /* at this point, @live holds the temps live after @op */
+        if ((def->flags & TCG_OPF_BB_END) && !(def->flags & TCG_OPF_BB_EXIT)) {
+            for (i = find_first_bit(live, s->nb_temps); i < s->nb_temps;
+                 i = find_next_bit(live, s->nb_temps, i + 1)) {
+                TCGTemp *ts = &s->temps[i];
+
+                if (ts->kind == TEMP_NORMAL ||
+                    (ts->kind == TEMP_EBB &&
+                     !(def->flags & TCG_OPF_COND_BRANCH))) {
+                    ts->kind = TEMP_LOCAL;
+                }
+            }
+        }
+
+        if (op->opc == INDEX_op_call) {
+            nb_oargs = TCGOP_CALLO(op);
+            nb_iargs = TCGOP_CALLI(op);
+        } else {
+            nb_oargs = def->nb_oargs;
+            nb_iargs = def->nb_iargs;
+        }
+        for (i = 0; i < nb_oargs; i++) {
+            clear_bit(temp_idx(arg_temp(op->args[i])), live);
+        }
+        for (i = nb_oargs; i < nb_oargs + nb_iargs; i++) {
+            if (op->args[i] != TCG_CALL_DUMMY_ARG) {
+                set_bit(temp_idx(arg_temp(op->args[i])), live);
+            }
+        }
+    }
+    g_free(live);
+}
+
 static void plugin_gen_mem_regular(const struct qemu_plugin_tb *ptb,
                                    TCGOp *begin_op, int insn_idx)
 {
@@ -688,6 +1138,42 @@ static void plugin_gen_mem_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(cbs, begin_op, op_rw);
 }
 
+static bool mem_traced(const struct qemu_plugin_tb *ptb,
+                       TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+    const GArray *cbs = insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_TRACE];
+
+    /* there is at most one request, see plugin_register_vcpu_mem_trace */
+    return cbs->len &&
+           op_rw(begin_op, &g_array_index(cbs, struct qemu_plugin_dyn_cb, 0));
+}
+
+/*
+ * The check on TB entry only leaves room for QEMU_PLUGIN_MEM_TRACE_TB_MAX
+ * records. Hand the buffer over before each further batch of them, which
+ * costs a call only in TBs with that many traced accesses.
+ */
+static void plugin_gen_mem_trace_flush(const struct qemu_plugin_tb *ptb,
+                                       TCGOp *begin_op, int insn_idx,
+                                       int n_traced)
+{
+    bool enable = n_traced && n_traced % QEMU_PLUGIN_MEM_TRACE_TB_MAX == 0 &&
+                  mem_traced(ptb, begin_op, insn_idx);
+
+    inject_mem_trace(begin_op, enable);
+}
+
+/* returns true if the access is traced */
+static bool plugin_gen_mem_trace(const struct qemu_plugin_tb *ptb,
+                                 TCGOp *begin_op, int insn_idx)
+{
+    bool enable = mem_traced(ptb, begin_op, insn_idx);
+
+    inject_mem_trace(begin_op, enable);
+    return enable;
+}
+
 static void plugin_gen_enable_mem_helper(const struct qemu_plugin_tb *ptb,
                                          TCGOp *begin_op, int insn_idx)
 {
@@ -740,6 +1226,15 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_MEM:
                 type = "mem";
                 break;
+            case PLUGIN_GEN_CB_COND:
+                type = "cond";
+                break;
+            case PLUGIN_GEN_CB_MEM_TRACE:
+                type = "mem trace";
+                break;
+            case PLUGIN_GEN_CB_MEM_TRACE_FLUSH:
+                type = "mem trace flush";
+                break;
             case PLUGIN_GEN_ENABLE_MEM_HELPER:
                 type = "enable mem helper";
                 break;
@@ -760,6 +1255,8 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
 {
     TCGOp *op;
     int insn_idx = -1;
+    int n_traced = 0;
+    bool has_cond = false;
 
     pr_ops();
 
@@ -785,6 +1282,12 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_tb_inline(plugin_tb, op);
                     break;
+                case PLUGIN_GEN_CB_COND:
+                    has_cond |= plugin_gen_tb_cond(plugin_tb, op);
+                    break;
+                case PLUGIN_GEN_CB_MEM_TRACE:
+                    plugin_gen_tb_mem_trace(plugin_tb, op);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -801,6 +1304,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_insn_inline(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_COND:
+                    has_cond |= plugin_gen_insn_cond(plugin_tb, op, insn_idx);
+                    break;
                 case PLUGIN_GEN_ENABLE_MEM_HELPER:
                     plugin_gen_enable_mem_helper(plugin_tb, op, insn_idx);
                     break;
@@ -820,6 +1326,15 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_mem_inline(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_MEM_TRACE_FLUSH:
+                    plugin_gen_mem_trace_flush(plugin_tb, op, insn_idx,
+                                               n_traced);
+                    break;
+                case PLUGIN_GEN_CB_MEM_TRACE:
+                    if (plugin_gen_mem_trace(plugin_tb, op, insn_idx)) {
+                        n_traced++;
+                    }
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -849,6 +1364,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
             break;
         }
     }
+    if (has_cond) {
+        plugin_gen_keep_live_temps();
+    }
     pr_ops();
 }
 
@@ -22,6 +22,7 @@
 
 #include "qemu/thread.h"
 #include "qemu/qht.h"
+#include "qemu/stats64.h"
 
 #define CODE_GEN_HTABLE_BITS     15
 #define CODE_GEN_HTABLE_SIZE     (1 << CODE_GEN_HTABLE_BITS)
@@ -34,7 +35,20 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    unsigned tb_partial_flush_count;
+    size_t tb_partial_flush_regions;
     unsigned tb_phys_invalidate_count;
+    /* cpu_exec_step_atomic calls, by how other vCPUs were held off */
+    unsigned atomic_exclusive_count;
+    unsigned atomic_locked_count;
+
+    /* translations done on a lookup miss, see cpu_exec */
+    unsigned tb_gen_inflight;
+    Stat64 tb_gen_inflight_max;
+    Stat64 tb_gen_count;
+    Stat64 tb_gen_aborted;
+    Stat64 tb_gen_time_ns;
+    Stat64 tb_gen_time_max_ns;
 };
 
 extern TBContext tb_ctx;
@@ -0,0 +1,190 @@
+/*
+ * The per-CPU TranslationBlock jump cache.
+ *
+ *  Copyright (c) 2003 Fabrice Bellard
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_JMP_CACHE_H
+#define ACCEL_TCG_TB_JMP_CACHE_H
+
+#include "qemu/bitmap.h"
+#include "qemu/cacheinfo.h"
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+
+#define TB_JMP_CACHE_BITS 11
+#define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_WAYS 2
+
+/*
+ * The lookup key is stored next to the TB pointer, so that a hit only
+ * touches the bucket and not the TranslationBlock itself.  There is no
+ * need to store trace_vcpu_dstate, since the cache is cleared whenever
+ * it changes.
+ *
+ * Entries are written only by the CPU owning the cache, but other threads
+ * may reset @tb to NULL when the TB is invalidated.  Hence @tb must be
+ * accessed atomically, and the other fields are only meaningful to the
+ * owner while @tb is non-NULL.  The owner may still insert a TB that is
+ * being invalidated, after the invalidating thread has cleared the cache,
+ * so a hit must also check CF_INVALID.
+ */
+typedef struct CPUJumpCacheEntry {
+    TranslationBlock *tb;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} CPUJumpCacheEntry;
+
+/* One host cache line, with the most recently inserted entry first. */
+typedef struct CPUJumpCacheBucket {
+    CPUJumpCacheEntry way[TB_JMP_CACHE_WAYS];
+} QEMU_ALIGNED(64) CPUJumpCacheBucket;
+
+QEMU_BUILD_BUG_ON(sizeof(CPUJumpCacheBucket) != 64);
+
+typedef struct CPUJumpCache {
+    CPUJumpCacheBucket bucket[TB_JMP_CACHE_SIZE];
+    /*
+     * Buckets that may hold an entry, so that clearing the cache does not
+     * need to walk all of it.  Only accessed by the owning CPU, or when
+     * all CPUs are stopped.
+     */
+    DECLARE_BITMAP(used, TB_JMP_CACHE_SIZE);
+} CPUJumpCache;
+
+static inline TranslationBlock *
+tb_jmp_cache_get(CPUJumpCache *jc, uint32_t hash, target_ulong pc,
+                 target_ulong cs_base, uint32_t flags, uint32_t cflags)
+{
+    CPUJumpCacheBucket *b = &jc->bucket[hash];
+    int i;
+
+    for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        CPUJumpCacheEntry *e = &b->way[i];
+        TranslationBlock *tb = qatomic_rcu_read(&e->tb);
+
+        if (likely(tb &&
+                   e->pc == pc &&
+                   e->cs_base == cs_base &&
+                   e->flags == flags &&
+                   e->cflags == cflags)) {
+            return likely(!(tb_cflags(tb) & CF_INVALID)) ? tb : NULL;
+        }
+    }
+    return NULL;
+}
+
+static inline void tb_jmp_cache_set_entry(CPUJumpCacheEntry *e,
+                                          TranslationBlock *tb,
+                                          target_ulong pc,
+                                          target_ulong cs_base,
+                                          uint32_t flags, uint32_t cflags)
+{
+    e->pc = pc;
+    e->cs_base = cs_base;
+    e->flags = flags;
+    e->cflags = cflags;
+    qatomic_set(&e->tb, tb);
+}
+
+/*
+ * Drop @tb from @e if it was invalidated while being inserted.  The
+ * barrier pairs with the one in tb_detach(): either the invalidating
+ * thread sees @tb in @e and clears it, or we see CF_INVALID here.
+ */
+static inline void tb_jmp_cache_recheck(CPUJumpCacheEntry *e,
+                                        TranslationBlock *tb)
+{
+    smp_mb();
+    if (unlikely(tb_cflags(tb) & CF_INVALID)) {
+        qatomic_cmpxchg(&e->tb, tb, NULL);
+    }
+}
+
+/* Insert @tb, looked up with the given key, evicting the older way. */
+static inline void tb_jmp_cache_insert(CPUJumpCache *jc, uint32_t hash,
+                                       TranslationBlock *tb, target_ulong pc,
+                                       target_ulong cs_base, uint32_t flags,
+                                       uint32_t cflags)
+{
+    CPUJumpCacheBucket *b = &jc->bucket[hash];
+    CPUJumpCacheEntry *e0 = &b->way[0];
+    TranslationBlock *old = qatomic_read(&e0->tb);
+    bool demoted = false;
+
+    if (old && old != tb && !(tb_cflags(old) & CF_INVALID)) {
+        tb_jmp_cache_set_entry(&b->way[1], old, e0->pc, e0->cs_base,
+                               e0->flags, e0->cflags);
+        demoted = true;
+    }
+    tb_jmp_cache_set_entry(e0, tb, pc, cs_base, flags, cflags);
+    set_bit(hash, jc->used);
+
+    /* Another thread may have removed either TB since we read it. */
+    tb_jmp_cache_recheck(e0, tb);
+    if (demoted) {
+        tb_jmp_cache_recheck(&b->way[1], old);
+    }
+}
+
+/* Called from any thread when @tb, which hashed to @hash, is invalidated. */
+static inline void tb_jmp_cache_remove(CPUJumpCache *jc, uint32_t hash,
+                                       TranslationBlock *tb)
+{
+    CPUJumpCacheBucket *b = &jc->bucket[hash];
+    int i;
+
+    for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        if (qatomic_read(&b->way[i].tb) == tb) {
+            qatomic_set(&b->way[i].tb, NULL);
+        }
+    }
+}
+
+/* Clear the @n buckets starting at @first. */
+static inline void tb_jmp_cache_clear_range(CPUJumpCache *jc,
+                                            unsigned int first,
+                                            unsigned int n)
+{
+    unsigned long i = find_next_bit(jc->used, first + n, first);
+
+    while (i < first + n) {
+        int w;
+
+        for (w = 0; w < TB_JMP_CACHE_WAYS; w++) {
+            qatomic_set(&jc->bucket[i].way[w].tb, NULL);
+        }
+        clear_bit(i, jc->used);
+        i = find_next_bit(jc->used, first + n, i + 1);
+    }
+}
+
+/*
+ * The return stack links TBs by virtual address, like the jump cache, and
+ * must be cleared along with it.  Called from @cpu's thread, or while all
+ * CPUs are stopped.
+ */
+static inline void tb_ret_stack_clear(CPUState *cpu)
+{
+    CPURetStack *rs = &cpu_neg(cpu)->ret_stack;
+
+    memset(rs->e, 0, sizeof(rs->e));
+}
+
+/*
+ * The code of a TB immediately follows it in the code buffer, see
+ * tcg_tb_alloc and tb_gen_code.  Computing its address avoids loading
+ * tb->tc.ptr, and with it a cache line of the TB, on the lookup fast path.
+ */
+static inline const void *tb_jmp_cache_code_ptr(TranslationBlock *tb)
+{
+    uintptr_t code = ROUND_UP((uintptr_t)(tb + 1), qemu_icache_linesize);
+
+    return tcg_splitwx_to_rx((void *)code);
+}
+
+#endif /* ACCEL_TCG_TB_JMP_CACHE_H */
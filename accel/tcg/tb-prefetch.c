@@ -0,0 +1,513 @@
+/*
+ * Translation prefetch across runs
+ *
+ * Copyright (c) 2026 The QEMU Project
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * The translation prefetcher remembers which blocks of guest code were
+ * translated during a previous run, so that a later run can translate
+ * them in bulk instead of taking one lookup miss per block.
+ *
+ * This is not a code cache: nothing produced by the translator is reused
+ * across runs.  Host code embeds absolute addresses of helpers, of the
+ * epilogue and of the TB structures, none of which are stable, so reusing
+ * it would need relocations that the backends do not record.  What is
+ * saved is the key of each TB (physical pc, cs_base, flags and cflags)
+ * together with a checksum of the guest bytes it was translated from.
+ * After a vCPU has missed on a page that has recorded entries, every entry
+ * of that page whose guest bytes still match its checksum is translated,
+ * while the page is known to be mapped.  Every block is still translated
+ * once per run; what prefetching saves is the exit to the main loop and
+ * the hash table lookup of each later miss on the page, and only blocks
+ * that the next run actually executes make that worthwhile.
+ *
+ * Entries are validated one by one against the current guest bytes, so a
+ * different guest image or self-modifying code never results in the reuse
+ * of a translation for other bytes than the ones it was made from.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/crc32c.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/xxhash.h"
+#include "qemu/rcu.h"
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+#if defined(CONFIG_USER_ONLY)
+#include "exec/cpu_ldst.h"
+#else
+#include "exec/ram_addr.h"
+#include "sysemu/runstate.h"
+#endif
+#include "tb-hash.h"
+#include "tb-context.h"
+#include "internal.h"
+
+#define TB_PREFETCH_MAGIC      "QEMUTBP"
+#define TB_PREFETCH_VERSION    1
+
+/* Upper bound on the number of distinct TBs accumulated for saving. */
+#define TB_PREFETCH_MAX_ENTRIES (1 << 20)
+
+/*
+ * Prefetching stops when less than this fraction of the code buffer is
+ * free, so that it never causes a flush or an eviction by itself.
+ */
+#define TB_PREFETCH_MIN_FREE_SHIFT 3
+
+typedef struct TBPrefetchHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_bits;
+    char target[16];
+    char qemu_version[32];
+    uint64_t nb_entries;
+} TBPrefetchHeader;
+
+typedef struct TBPrefetchEntry {
+    uint64_t phys_pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t size;
+    uint32_t crc;
+} TBPrefetchEntry;
+
+typedef struct TBPrefetch {
+    char *path;
+
+    /* entries loaded from @path, sorted by phys_pc */
+    GMappedFile *file;
+    const TBPrefetchEntry *entries;
+    size_t nb_entries;
+    /* set for each loaded entry once it has been considered */
+    unsigned long *consumed;
+
+    /* entries collected during this run, written out at exit */
+    QemuMutex lock;
+    GHashTable *collected;
+
+    /* statistics */
+    /* lookup misses on pages with loaded entries */
+    size_t lookups;
+    /* ... whose missed block was itself a loaded entry */
+    size_t known;
+    /* loaded entries whose guest bytes changed */
+    size_t stale;
+    /* loaded entries translated ahead of their first use */
+    size_t prefetched;
+} TBPrefetch;
+
+static TBPrefetch tb_prefetch;
+
+static guint tb_prefetch_entry_hash(gconstpointer p)
+{
+    const TBPrefetchEntry *e = p;
+
+    return qemu_xxhash6(e->phys_pc, e->cs_base, e->flags, e->cflags);
+}
+
+static gboolean tb_prefetch_entry_equal(gconstpointer ap, gconstpointer bp)
+{
+    const TBPrefetchEntry *a = ap;
+    const TBPrefetchEntry *b = bp;
+
+    return a->phys_pc == b->phys_pc &&
+        a->cs_base == b->cs_base &&
+        a->flags == b->flags &&
+        a->cflags == b->cflags;
+}
+
+static int tb_prefetch_entry_cmp(const void *ap, const void *bp)
+{
+    const TBPrefetchEntry *a = ap;
+    const TBPrefetchEntry *b = bp;
+
+    if (a->phys_pc != b->phys_pc) {
+        return a->phys_pc < b->phys_pc ? -1 : 1;
+    }
+    if (a->cs_base != b->cs_base) {
+        return a->cs_base < b->cs_base ? -1 : 1;
+    }
+    if (a->flags != b->flags) {
+        return a->flags < b->flags ? -1 : 1;
+    }
+    if (a->cflags != b->cflags) {
+        return a->cflags < b->cflags ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ * Return a host pointer to @size bytes of guest code at @phys, or NULL if
+ * they cannot be read.  @phys and @size must not cross a target page.
+ */
+static const uint8_t *tb_prefetch_code_ptr(tb_page_addr_t phys, uint32_t size)
+{
+    if (size == 0 ||
+        (phys & ~TARGET_PAGE_MASK) + size > TARGET_PAGE_SIZE) {
+        return NULL;
+    }
+#ifdef CONFIG_SOFTMMU
+    return qemu_map_ram_ptr(NULL, phys);
+#else
+    if (!(page_get_flags(phys) & PAGE_READ)) {
+        return NULL;
+    }
+    return g2h_untagged(phys);
+#endif
+}
+
+static bool tb_prefetch_code_crc(tb_page_addr_t phys, uint32_t size,
+                              uint32_t *crc)
+{
+    const uint8_t *p = tb_prefetch_code_ptr(phys, size);
+
+    if (p == NULL) {
+        return false;
+    }
+    *crc = crc32c(0xffffffff, p, size);
+    return true;
+}
+
+/* Index of the first loaded entry with phys_pc >= @phys. */
+static size_t tb_prefetch_lower_bound(tb_page_addr_t phys)
+{
+    size_t lo = 0, hi = tb_prefetch.nb_entries;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (tb_prefetch.entries[mid].phys_pc < phys) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Atomically mark loaded entry @i as considered; return its old state. */
+static bool tb_prefetch_claim(size_t i)
+{
+    unsigned long mask = BIT_MASK(i);
+
+    return qatomic_fetch_or(&tb_prefetch.consumed[BIT_WORD(i)], mask) & mask;
+}
+
+static bool tb_prefetch_load(const char *path)
+{
+    g_autoptr(GError) gerr = NULL;
+    const TBPrefetchHeader *hdr;
+    size_t len;
+
+    tb_prefetch.file = g_mapped_file_new(path, FALSE, &gerr);
+    if (!tb_prefetch.file) {
+        /* A missing file is normal on the first run. */
+        if (!g_error_matches(gerr, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            warn_report("tb-prefetch: cannot map %s: %s", path, gerr->message);
+        }
+        return false;
+    }
+
+    len = g_mapped_file_get_length(tb_prefetch.file);
+    hdr = (const TBPrefetchHeader *)g_mapped_file_get_contents(tb_prefetch.file);
+    if (len < sizeof(*hdr) ||
+        memcmp(hdr->magic, TB_PREFETCH_MAGIC, sizeof(TB_PREFETCH_MAGIC)) ||
+        hdr->version != TB_PREFETCH_VERSION ||
+        hdr->page_bits != TARGET_PAGE_BITS ||
+        strncmp(hdr->target, TARGET_NAME, sizeof(hdr->target)) ||
+        strncmp(hdr->qemu_version, QEMU_VERSION, sizeof(hdr->qemu_version)) ||
+        hdr->nb_entries > (len - sizeof(*hdr)) / sizeof(TBPrefetchEntry)) {
+        warn_report("tb-prefetch: ignoring incompatible file %s", path);
+        g_mapped_file_unref(tb_prefetch.file);
+        tb_prefetch.file = NULL;
+        return false;
+    }
+
+    tb_prefetch.entries = (const TBPrefetchEntry *)(hdr + 1);
+    tb_prefetch.nb_entries = hdr->nb_entries;
+    tb_prefetch.consumed = bitmap_new(tb_prefetch.nb_entries);
+    return true;
+}
+
+static void tb_prefetch_collect_tb(void *p, uint32_t hash, void *userp)
+{
+    const TranslationBlock *tb = p;
+    TBPrefetchEntry e, *n;
+    tb_page_addr_t phys_pc;
+
+    if (tb->page_addr[1] != -1 ||
+        g_hash_table_size(tb_prefetch.collected) >= TB_PREFETCH_MAX_ENTRIES) {
+        return;
+    }
+    phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
+
+    e.phys_pc = phys_pc;
+    e.cs_base = tb->cs_base;
+    e.flags = tb->flags;
+    e.cflags = tb_cflags(tb) & ~CF_INVALID;
+    e.size = tb->size;
+    if (!tb_prefetch_code_crc(phys_pc, tb->size, &e.crc)) {
+        return;
+    }
+
+    n = g_hash_table_lookup(tb_prefetch.collected, &e);
+    if (n == NULL) {
+        n = g_memdup2(&e, sizeof(e));
+        g_hash_table_add(tb_prefetch.collected, n);
+    } else {
+        *n = e;
+    }
+}
+
+/*
+ * Remember the TBs currently in the hash table.  Called before a flush
+ * throws them away, and at exit.
+ */
+void tb_prefetch_record(void)
+{
+#ifdef CONFIG_USER_ONLY
+    PageRangeLock range;
+#endif
+
+    if (!tb_prefetch.path) {
+        return;
+    }
+
+#ifdef CONFIG_USER_ONLY
+    /* Keep syscalls from unmapping or protecting the code being read. */
+    mmap_lock();
+    page_range_lock(&range, 0, -1);
+#endif
+    WITH_RCU_READ_LOCK_GUARD() {
+        qemu_mutex_lock(&tb_prefetch.lock);
+        qht_iter(&tb_ctx.htable, tb_prefetch_collect_tb, NULL);
+        qemu_mutex_unlock(&tb_prefetch.lock);
+    }
+#ifdef CONFIG_USER_ONLY
+    page_range_unlock(&range);
+    mmap_unlock();
+#endif
+}
+
+/* Call with no vCPU running guest code. */
+static void tb_prefetch_save(void)
+{
+    g_autofree char *tmp = g_strdup_printf("%s.tmp", tb_prefetch.path);
+    g_autoptr(GArray) arr = NULL;
+    GHashTableIter iter;
+    TBPrefetchHeader hdr = { };
+    TBPrefetchEntry *e;
+    FILE *f;
+    bool ok;
+
+    tb_prefetch_record();
+
+    qemu_mutex_lock(&tb_prefetch.lock);
+    arr = g_array_sized_new(FALSE, FALSE, sizeof(TBPrefetchEntry),
+                            g_hash_table_size(tb_prefetch.collected));
+    g_hash_table_iter_init(&iter, tb_prefetch.collected);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&e, NULL)) {
+        g_array_append_val(arr, *e);
+    }
+    qemu_mutex_unlock(&tb_prefetch.lock);
+    g_array_sort(arr, tb_prefetch_entry_cmp);
+
+    memcpy(hdr.magic, TB_PREFETCH_MAGIC, sizeof(TB_PREFETCH_MAGIC));
+    hdr.version = TB_PREFETCH_VERSION;
+    hdr.page_bits = TARGET_PAGE_BITS;
+    pstrcpy(hdr.target, sizeof(hdr.target), TARGET_NAME);
+    pstrcpy(hdr.qemu_version, sizeof(hdr.qemu_version), QEMU_VERSION);
+    hdr.nb_entries = arr->len;
+
+    /* Write to a temporary file, the old one may still be mapped. */
+    f = fopen(tmp, "wb");
+    if (f == NULL) {
+        warn_report("tb-prefetch: cannot create %s: %s", tmp, strerror(errno));
+        return;
+    }
+    ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+         (arr->len == 0 ||
+          fwrite(arr->data, sizeof(TBPrefetchEntry), arr->len, f) == arr->len);
+    ok &= fclose(f) == 0;
+    if (!ok || rename(tmp, tb_prefetch.path) < 0) {
+        warn_report("tb-prefetch: cannot write %s: %s",
+                    tb_prefetch.path, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+#ifdef CONFIG_USER_ONLY
+/*
+ * Called by exit_group before the process goes away; exit handlers do
+ * not run in that case.  Other threads may still be inside cpu_exec.
+ */
+void tb_prefetch_user_exit(void)
+{
+    if (tb_prefetch.path) {
+        start_exclusive();
+        tb_prefetch_save();
+        end_exclusive();
+    }
+}
+#else
+static void tb_prefetch_atexit(void)
+{
+    /*
+     * qemu_cleanup() pauses the vCPUs before exit handlers run.  After
+     * an error exit they may still be running, and nothing is saved.
+     */
+    if (!runstate_is_running()) {
+        tb_prefetch_save();
+    }
+}
+#endif
+
+void tb_prefetch_init(const char *path)
+{
+    size_t i;
+
+    tb_prefetch.path = g_strdup(path);
+    qemu_mutex_init(&tb_prefetch.lock);
+    tb_prefetch.collected = g_hash_table_new_full(tb_prefetch_entry_hash,
+                                               tb_prefetch_entry_equal,
+                                               g_free, NULL);
+
+    /*
+     * Entries from the previous run are kept for the next one even if
+     * this run never translates them.
+     */
+    if (tb_prefetch_load(path)) {
+        for (i = 0; i < tb_prefetch.nb_entries; i++) {
+            g_hash_table_add(tb_prefetch.collected,
+                             g_memdup2(&tb_prefetch.entries[i],
+                                       sizeof(TBPrefetchEntry)));
+        }
+    }
+#ifndef CONFIG_USER_ONLY
+    atexit(tb_prefetch_atexit);
+#endif
+}
+
+static bool tb_prefetch_space_low(void)
+{
+    size_t capacity = tcg_code_capacity();
+
+    return capacity - tcg_code_size() <
+           capacity >> TB_PREFETCH_MIN_FREE_SHIFT;
+}
+
+static bool tb_prefetch_on_page(size_t i, tb_page_addr_t page)
+{
+    return i < tb_prefetch.nb_entries &&
+           tb_prefetch.entries[i].phys_pc < page + TARGET_PAGE_SIZE;
+}
+
+/*
+ * Called after @tb has been generated on a lookup miss, once the lookup
+ * is complete and @tb is in the jump cache.  Takes mmap_lock itself.
+ */
+void tb_prefetch_page(CPUState *cpu, TranslationBlock *tb)
+{
+    tb_page_addr_t page, phys_pc;
+    target_ulong vpage;
+    uint32_t cflags;
+    size_t i;
+
+    if (tb_prefetch.entries == NULL || tb->page_addr[0] == -1) {
+        return;
+    }
+    page = tb->page_addr[0];
+    i = tb_prefetch_lower_bound(page);
+    if (!tb_prefetch_on_page(i, page)) {
+        return;
+    }
+    qatomic_inc(&tb_prefetch.lookups);
+    if (tb_prefetch_space_low()) {
+        return;
+    }
+
+    vpage = tb->pc & TARGET_PAGE_MASK;
+    phys_pc = page + (tb->pc & ~TARGET_PAGE_MASK);
+    cflags = tb_cflags(tb);
+
+    mmap_lock();
+#ifdef CONFIG_USER_ONLY
+    /* cpu_exec dropped mmap_lock after the miss */
+    if (!(page_get_flags(vpage) & PAGE_EXEC)) {
+        mmap_unlock();
+        return;
+    }
+#endif
+    for (; tb_prefetch_on_page(i, page); i++) {
+        const TBPrefetchEntry *e = &tb_prefetch.entries[i];
+        target_ulong pc;
+        uint32_t crc;
+
+        /*
+         * Only translate blocks of the mode the vCPU is currently in:
+         * the virtual page is known to be mapped to @page with this
+         * cs_base/flags/cflags, so translation cannot fault.  Given the
+         * same guest bytes and the same flags the translator produces
+         * a TB of the same size, which did not cross the page.
+         */
+        if (e->cs_base != tb->cs_base ||
+            e->flags != tb->flags ||
+            e->cflags != cflags) {
+            continue;
+        }
+        if (tb_prefetch_claim(i)) {
+            continue;
+        }
+        if (!tb_prefetch_code_crc(e->phys_pc, e->size, &crc)) {
+            continue;
+        }
+        if (crc != e->crc) {
+            qatomic_inc(&tb_prefetch.stale);
+            continue;
+        }
+        if (e->phys_pc == phys_pc) {
+            /* translated on demand before its page could be prefetched */
+            qatomic_inc(&tb_prefetch.known);
+            continue;
+        }
+
+        pc = vpage | (e->phys_pc & ~TARGET_PAGE_MASK);
+        if (tb_htable_lookup(cpu, pc, e->cs_base, e->flags, e->cflags)) {
+            continue;
+        }
+        tb_gen_code(cpu, pc, e->cs_base, e->flags, e->cflags);
+        qatomic_inc(&tb_prefetch.prefetched);
+    }
+    mmap_unlock();
+}
+
+void tb_prefetch_dump_info(GString *buf)
+{
+    size_t lookups = qatomic_read(&tb_prefetch.lookups);
+    size_t known = qatomic_read(&tb_prefetch.known);
+    guint recorded;
+
+    if (!tb_prefetch.path) {
+        return;
+    }
+    qemu_mutex_lock(&tb_prefetch.lock);
+    recorded = g_hash_table_size(tb_prefetch.collected);
+    qemu_mutex_unlock(&tb_prefetch.lock);
+
+    g_string_append_printf(buf, "TB prefetch entries %zu loaded, %u recorded\n",
+                           tb_prefetch.nb_entries, recorded);
+    g_string_append_printf(buf, "TB prefetch misses  %zu on recorded pages, "
+                           "%zu (%zu%%) of recorded blocks, stale=%zu\n",
+                           lookups, known,
+                           lookups ? known * 100 / lookups : 0,
+                           qatomic_read(&tb_prefetch.stale));
+    g_string_append_printf(buf, "TB prefetched       %zu\n",
+                           qatomic_read(&tb_prefetch.prefetched));
+}
@@ -43,6 +43,12 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    char *tb_prefetch;
+    TCGCodeHugePages code_hugepages;
+    bool code_numa;
+    bool atomic_step_locked;
+    uint32_t tlb_ways;
+    uint32_t tlb_victim_size;
 };
 typedef struct TCGState TCGState;
 
@@ -98,6 +104,11 @@ static void tcg_accel_instance_init(Object *obj)
     TCGState *s = TCG_STATE(obj);
 
     s->mttcg_enabled = default_mttcg_enabled();
+    s->code_hugepages = TCG_CODE_HUGEPAGES_AUTO;
+#if !defined(CONFIG_USER_ONLY)
+    s->tlb_ways = 1;
+    s->tlb_victim_size = CPU_VTLB_SIZE;
+#endif
 
     /* If debugging enabled, default "auto on", otherwise off. */
 #if defined(CONFIG_DEBUG_TCG) && !defined(CONFIG_USER_ONLY)
@@ -120,10 +131,19 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+#if !defined(CONFIG_USER_ONLY)
+    tcg_tlb_ways = s->tlb_ways;
+    tcg_tlb_victim_size = s->tlb_victim_size;
+#endif
 
     page_init();
     tb_htable_init();
-    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
+    cpu_exec_atomic_init(s->atomic_step_locked);
+    tcg_init(s->tb_size * MiB, s->splitwx_enabled, s->code_hugepages,
+             s->code_numa, max_cpus);
+    if (s->tb_prefetch) {
+        tb_prefetch_init(s->tb_prefetch);
+    }
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -195,6 +215,149 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static char *tcg_get_tb_prefetch(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_prefetch);
+}
+
+static void tcg_set_tb_prefetch(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_prefetch);
+    s->tb_prefetch = g_strdup(value);
+}
+
+static const char *const code_hugepages_names[] = {
+    [TCG_CODE_HUGEPAGES_AUTO] = "auto",
+    [TCG_CODE_HUGEPAGES_OFF] = "off",
+    [TCG_CODE_HUGEPAGES_TRANSPARENT] = "transparent",
+    [TCG_CODE_HUGEPAGES_EXPLICIT] = "explicit",
+};
+
+static char *tcg_get_code_hugepages(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(code_hugepages_names[s->code_hugepages]);
+}
+
+static void tcg_set_code_hugepages(Object *obj, const char *value,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(code_hugepages_names); i++) {
+        if (strcmp(value, code_hugepages_names[i]) == 0) {
+            s->code_hugepages = i;
+            return;
+        }
+    }
+    error_setg(errp, "Invalid 'code-hugepages' setting %s", value);
+}
+
+static char *tcg_get_atomic_step(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->atomic_step_locked ? "locked" : "exclusive");
+}
+
+static void tcg_set_atomic_step(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    if (strcmp(value, "exclusive") == 0) {
+        s->atomic_step_locked = false;
+    } else if (strcmp(value, "locked") == 0) {
+        s->atomic_step_locked = true;
+    } else {
+        error_setg(errp, "Invalid 'atomic-step' setting %s", value);
+    }
+}
+
+static bool tcg_get_code_numa(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->code_numa;
+}
+
+static void tcg_set_code_numa(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+#ifndef CONFIG_NUMA
+    if (value) {
+        error_setg(errp, "NUMA placement is not supported by this QEMU");
+        return;
+    }
+#endif
+    s->code_numa = value;
+}
+
+#if !defined(CONFIG_USER_ONLY)
+static void tcg_get_tlb_ways(Object *obj, Visitor *v,
+                             const char *name, void *opaque,
+                             Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tlb_ways;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tlb_ways(Object *obj, Visitor *v,
+                             const char *name, void *opaque,
+                             Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value != 1 && value != 2) {
+        error_setg(errp, "tlb-ways must be 1 or 2");
+        return;
+    }
+
+    s->tlb_ways = value;
+}
+
+static void tcg_get_tlb_victim_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tlb_victim_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tlb_victim_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value < 1 || value > CPU_VTLB_MAX_SIZE) {
+        error_setg(errp, "tlb-victim-size must be between 1 and %d",
+                   CPU_VTLB_MAX_SIZE);
+        return;
+    }
+
+    s->tlb_victim_size = value;
+}
+#endif
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -224,10 +387,48 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add_str(oc, "tb-prefetch",
+                                  tcg_get_tb_prefetch,
+                                  tcg_set_tb_prefetch);
+    object_class_property_set_description(oc, "tb-prefetch",
+        "File listing the TBs to translate ahead of use in the next run");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add_str(oc, "code-hugepages",
+                                  tcg_get_code_hugepages,
+                                  tcg_set_code_hugepages);
+    object_class_property_set_description(oc, "code-hugepages",
+        "Back jit pages with huge pages (auto, off, transparent, explicit)");
+
+    object_class_property_add_bool(oc, "code-numa",
+        tcg_get_code_numa, tcg_set_code_numa);
+    object_class_property_set_description(oc, "code-numa",
+        "Place each jit region on the host NUMA node of its vCPU thread");
+
+    object_class_property_add_str(oc, "atomic-step",
+                                  tcg_get_atomic_step,
+                                  tcg_set_atomic_step);
+    object_class_property_set_description(oc, "atomic-step",
+        "How insns that need a serial context are made atomic "
+        "(exclusive, locked; locked is not atomic against other atomics)");
+
+#if !defined(CONFIG_USER_ONLY)
+    object_class_property_add(oc, "tlb-ways", "int",
+        tcg_get_tlb_ways, tcg_set_tlb_ways,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tlb-ways",
+        "Associativity of the softmmu TLB fast path (1 or 2)");
+
+    object_class_property_add(oc, "tlb-victim-size", "int",
+        tcg_get_tlb_victim_size, tcg_set_tlb_victim_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tlb-victim-size",
+        "Number of entries in the softmmu victim TLB of each MMU mode");
+#endif
 }
 
 static const TypeInfo tcg_accel_type = {
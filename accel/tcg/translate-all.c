@@ -112,7 +112,6 @@ typedef struct PageDesc {
     unsigned long *code_bitmap;
     unsigned int code_write_count;
 #else
-    unsigned long flags;
     void *target_data;
 #endif
 #ifndef CONFIG_USER_ONLY
@@ -166,9 +165,9 @@ struct page_collection {
 
 /* list iterators for lists of tagged pointers in TranslationBlock */
 #define TB_FOR_EACH_TAGGED(head, tb, n, field)                          \
-    for (n = (head) & 1, tb = (TranslationBlock *)((head) & ~1);        \
-         tb; tb = (TranslationBlock *)tb->field[n], n = (uintptr_t)tb & 1, \
-             tb = (TranslationBlock *)((uintptr_t)tb & ~1))
+    for (n = (head) & 3, tb = (TranslationBlock *)((head) & ~3);        \
+         tb; tb = (TranslationBlock *)tb->field[n], n = (uintptr_t)tb & 3, \
+             tb = (TranslationBlock *)((uintptr_t)tb & ~3))
 
 #define PAGE_FOR_EACH_TB(pagedesc, tb, n)                       \
     TB_FOR_EACH_TAGGED((pagedesc)->first_tb, tb, n, page_next)
@@ -218,6 +217,25 @@ static int v_l2_levels;
 
 static void *l1_map[V_L1_MAX_SIZE];
 
+#ifdef CONFIG_USER_ONLY
+/*
+ * The flags of user-mode pages live in a radix tree of their own, laid
+ * out like l1_map but with one int per page at the bottom level. Mapped
+ * pages without translated code need no PageDesc, and scans of the flags
+ * touch a sixth of the memory. Nodes are never freed, so the flags can
+ * be read without locks; see page_range_lock() for the writers.
+ */
+static void *pageflags_map[V_L1_MAX_SIZE];
+
+/*
+ * Internal page flag: code was translated from the page since it was
+ * mapped. It is set by page_protect() before the translator reads the
+ * page, and tells page_range_has_code() that making the page writable
+ * must wait for the mmap_lock.
+ */
+#define PAGE_TRANSLATED  0x40000000
+#endif
+
 TBContext tb_ctx;
 
 static void page_table_config_init(void)
@@ -400,10 +418,19 @@ bool cpu_restore_state(CPUState *cpu, uintptr_t host_pc, bool will_exit)
     return false;
 }
 
+#ifdef CONFIG_USER_ONLY
+static QemuMutex page_range_mutex;
+static QemuCond page_range_cond;
+#endif
+
 void page_init(void)
 {
     page_size_init();
     page_table_config_init();
+#ifdef CONFIG_USER_ONLY
+    qemu_mutex_init(&page_range_mutex);
+    qemu_cond_init(&page_range_cond);
+#endif
 
 #if defined(CONFIG_BSD) && defined(CONFIG_USER_ONLY)
     {
@@ -984,6 +1011,9 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
                tcg_code_size(), nb_tbs, nb_tbs > 0 ? host_size / nb_tbs : 0);
     }
 
+    /* Remember what is about to be thrown away for the next run. */
+    tb_prefetch_record();
+
     CPU_FOREACH(cpu) {
         cpu_tb_jmp_cache_clear(cpu);
     }
@@ -1142,10 +1172,58 @@ static inline void tb_remove_from_jmp_list(TranslationBlock *orig, int n_orig)
    another TB */
 static inline void tb_reset_jump(TranslationBlock *tb, int n)
 {
-    uintptr_t addr = (uintptr_t)(tb->tc.ptr + tb->jmp_reset_offset[n]);
+    uintptr_t addr;
+
+    if (n == TB_JMP_PRED) {
+        qatomic_set(&tb->jmp_pred, NULL);
+        return;
+    }
+    if (n == TB_JMP_RET) {
+        qatomic_set(&tb->jmp_ret, NULL);
+        return;
+    }
+    addr = (uintptr_t)(tb->tc.ptr + tb->jmp_reset_offset[n]);
     tb_set_jmp_target(tb, n, addr);
 }
 
+/*
+ * Drop the indirect branch prediction of @orig, so that a new one can be
+ * set with tb_add_jump.  Nothing is done if @orig is being invalidated.
+ */
+void tb_remove_pred(TranslationBlock *orig)
+{
+    uintptr_t ptr = qatomic_read(&orig->jmp_dest[TB_JMP_PRED]);
+    TranslationBlock *dest = (TranslationBlock *)ptr;
+    TranslationBlock *tb;
+    uintptr_t *pprev;
+    int n;
+
+    if (dest == NULL || (ptr & 1)) {
+        return;
+    }
+
+    qemu_spin_lock(&dest->jmp_lock);
+    /*
+     * If the jump was unlinked by tb_jmp_unlink(dest), or @orig started
+     * being invalidated, there is nothing left to do here.
+     */
+    if (qatomic_cmpxchg(&orig->jmp_dest[TB_JMP_PRED], ptr,
+                        (uintptr_t)NULL) != ptr) {
+        qemu_spin_unlock(&dest->jmp_lock);
+        return;
+    }
+    pprev = &dest->jmp_list_head;
+    TB_FOR_EACH_JMP(dest, tb, n) {
+        if (tb == orig && n == TB_JMP_PRED) {
+            *pprev = tb->jmp_list_next[n];
+            break;
+        }
+        pprev = &tb->jmp_list_next[n];
+    }
+    qatomic_set(&orig->jmp_pred, NULL);
+    qemu_spin_unlock(&dest->jmp_lock);
+}
+
 /* remove any jumps to the TB */
 static inline void tb_jmp_unlink(TranslationBlock *dest)
 {
@@ -1164,6 +1242,41 @@ static inline void tb_jmp_unlink(TranslationBlock *dest)
     qemu_spin_unlock(&dest->jmp_lock);
 }
 
+/* Remove all the direct jumps from and to @tb, which has CF_INVALID set.  */
+static void tb_detach(TranslationBlock *tb)
+{
+    CPUState *cpu;
+    uint32_t h;
+
+    /*
+     * remove the TB from the jump caches; CF_INVALID must be visible to
+     * a concurrent tb_jmp_cache_insert before we look at its entries.
+     */
+    smp_mb();
+    h = tb_jmp_cache_hash_func(tb->pc);
+    CPU_FOREACH(cpu) {
+        if (cpu->tb_jmp_cache) {
+            tb_jmp_cache_remove(cpu->tb_jmp_cache, h, tb);
+        }
+    }
+
+    /* suppress this TB from the jump lists */
+    tb_remove_from_jmp_list(tb, 0);
+    tb_remove_from_jmp_list(tb, 1);
+    tb_remove_from_jmp_list(tb, TB_JMP_PRED);
+    tb_remove_from_jmp_list(tb, TB_JMP_RET);
+    /*
+     * The predictions may still be followed from the return stack of a
+     * vCPU, so they must not be left pointing to a TB that is later
+     * invalidated without @tb in its jump list.
+     */
+    qatomic_set(&tb->jmp_pred, NULL);
+    qatomic_set(&tb->jmp_ret, NULL);
+
+    /* suppress any remaining jumps to this TB */
+    tb_jmp_unlink(tb);
+}
+
 /*
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
@@ -1171,7 +1284,6 @@ static inline void tb_jmp_unlink(TranslationBlock *dest)
  */
 static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 {
-    CPUState *cpu;
     PageDesc *p;
     uint32_t h;
     tb_page_addr_t phys_pc;
@@ -1204,20 +1316,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
         }
     }
 
-    /* remove the TB from the hash list */
-    h = tb_jmp_cache_hash_func(tb->pc);
-    CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
-        }
-    }
-
-    /* suppress this TB from the two jump lists */
-    tb_remove_from_jmp_list(tb, 0);
-    tb_remove_from_jmp_list(tb, 1);
-
-    /* suppress any remaining jumps to this TB */
-    tb_jmp_unlink(tb);
+    tb_detach(tb);
 
     qatomic_set(&tb_ctx.tb_phys_invalidate_count,
                 tb_ctx.tb_phys_invalidate_count + 1);
@@ -1245,6 +1344,87 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     }
 }
 
+/* Called by tcg_region_evict on each TB of an evicted region.  */
+static void tb_evict_one(TranslationBlock *tb)
+{
+    if (tb->page_addr[0] != -1) {
+        /* Nothing to do if the TB was already invalidated.  */
+        tb_phys_invalidate(tb, -1);
+    } else {
+        /*
+         * A one-insn TB is not in the hash table, and invalidating it
+         * does not unlink it; but it may still be in the jump cache and
+         * the jump lists.
+         */
+        qemu_spin_lock(&tb->jmp_lock);
+        qatomic_set(&tb->cflags, tb->cflags | CF_INVALID);
+        qemu_spin_unlock(&tb->jmp_lock);
+        tb_detach(tb);
+    }
+}
+
+/*
+ * Reclaim part of the code buffer by evicting its least recently executed
+ * regions, and fall back to a full flush if there is none to evict.
+ * @tb_flush_epoch is the sum of the full and partial flush counts at the
+ * time of the request.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_epoch)
+{
+    unsigned tb_flush_count;
+    size_t n = 0;
+
+    mmap_lock();
+    tb_flush_count = tb_ctx.tb_flush_count;
+    /* If space was already reclaimed on request of another CPU, retry.  */
+    if (tb_flush_count + tb_ctx.tb_partial_flush_count !=
+        tb_flush_epoch.host_int) {
+        mmap_unlock();
+        return;
+    }
+
+    /*
+     * Instrumented code refers to callback data that is only released by
+     * qemu_plugin_flush_cb, after a full flush.
+     */
+    if (!test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS, cpu->plugin_mask)) {
+        qemu_thread_jit_write();
+        n = tcg_region_evict(tb_evict_one);
+        qemu_thread_jit_execute();
+    }
+
+    if (n) {
+        CPUState *other;
+
+        /* The return stacks may point to an evicted TB.  */
+        CPU_FOREACH(other) {
+            tb_ret_stack_clear(other);
+        }
+        tb_ctx.tb_partial_flush_regions += n;
+        qatomic_mb_set(&tb_ctx.tb_partial_flush_count,
+                       tb_ctx.tb_partial_flush_count + 1);
+    }
+    mmap_unlock();
+
+    if (!n) {
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
+/* Make room in the code buffer for the TB being generated by @cpu.  */
+static void tb_reclaim(CPUState *cpu)
+{
+    unsigned tb_flush_epoch = qatomic_mb_read(&tb_ctx.tb_flush_count) +
+                              qatomic_mb_read(&tb_ctx.tb_partial_flush_count);
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(tb_flush_epoch));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict,
+                              RUN_ON_CPU_HOST_INT(tb_flush_epoch));
+    }
+}
+
 #ifdef CONFIG_SOFTMMU
 /* call with @p->lock held */
 static void build_page_bitmap(PageDesc *p)
@@ -1298,7 +1478,7 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
 
 #if defined(CONFIG_USER_ONLY)
     /* translator_loop() must have made all TB pages non-writable */
-    assert(!(p->flags & PAGE_WRITE));
+    assert(!(page_get_flags(page_addr) & PAGE_WRITE));
 #else
     /* if some code is already present, then the pages are already
        protected. So we handle the case where only the first TB is
@@ -1412,8 +1592,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_reclaim(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1422,6 +1602,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
     gen_code_buf = tcg_ctx->code_gen_ptr;
     tb->tc.ptr = tcg_splitwx_to_rx(gen_code_buf);
+    tcg_debug_assert(tb->tc.ptr == tb_jmp_cache_code_ptr(tb));
     tb->pc = pc;
     tb->cs_base = cs_base;
     tb->flags = flags;
@@ -1608,8 +1789,14 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->jmp_list_head = (uintptr_t)NULL;
     tb->jmp_list_next[0] = (uintptr_t)NULL;
     tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_list_next[TB_JMP_PRED] = (uintptr_t)NULL;
+    tb->jmp_list_next[TB_JMP_RET] = (uintptr_t)NULL;
     tb->jmp_dest[0] = (uintptr_t)NULL;
     tb->jmp_dest[1] = (uintptr_t)NULL;
+    tb->jmp_dest[TB_JMP_PRED] = (uintptr_t)NULL;
+    tb->jmp_dest[TB_JMP_RET] = (uintptr_t)NULL;
+    tb->jmp_pred = NULL;
+    tb->jmp_ret = NULL;
 
     /* init original jump addresses which have been set during tcg_gen_code() */
     if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
@@ -2076,6 +2263,7 @@ void dump_exec_info(GString *buf)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t tlb_way, tlb_victim, tlb_miss, tlb_large;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2088,6 +2276,7 @@ void dump_exec_info(GString *buf)
      */
     g_string_append_printf(buf, "gen code size       %zu/%zu\n",
                            tcg_code_size(), tcg_code_capacity());
+    tcg_region_dump_info(buf);
     g_string_append_printf(buf, "TB count            %zu\n", nb_tbs);
     g_string_append_printf(buf, "TB avg target size  %zu max=%zu bytes\n",
                            nb_tbs ? tst.target_size / nb_tbs : 0,
@@ -2114,13 +2303,30 @@ void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB partial flushes  %u "
+                           "(%zu regions evicted)\n",
+                           qatomic_read(&tb_ctx.tb_partial_flush_count),
+                           tb_ctx.tb_partial_flush_regions);
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    g_string_append_printf(buf, "atomic steps        %u exclusive, "
+                           "%u locked\n",
+                           qatomic_read(&tb_ctx.atomic_exclusive_count),
+                           qatomic_read(&tb_ctx.atomic_locked_count));
+    tb_gen_dump_info(buf);
+    tb_prefetch_dump_info(buf);
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    tlb_lookup_counts(&tlb_way, &tlb_victim, &tlb_miss, &tlb_large);
+    g_string_append_printf(buf, "TLB associativity   %u-way, %u victim "
+                           "entries\n", tcg_tlb_ways, tcg_tlb_victim_size);
+    g_string_append_printf(buf, "TLB slow path hits  %zu way 2, "
+                           "%zu victim\n", tlb_way, tlb_victim);
+    g_string_append_printf(buf, "TLB misses          %zu (%zu from large "
+                           "pages)\n", tlb_miss, tlb_large);
     tcg_dump_info(buf);
 }
 
@@ -2171,10 +2377,10 @@ static int walk_memory_regions_1(struct walk_memory_regions_data *data,
     }
 
     if (level == 0) {
-        PageDesc *pd = *lp;
+        int *pf = *lp;
 
         for (i = 0; i < V_L2_SIZE; ++i) {
-            int prot = pd[i].flags;
+            int prot = qatomic_read(&pf[i]) & ~PAGE_TRANSLATED;
 
             pa = base | (i << TARGET_PAGE_BITS);
             if (prot != data->prot) {
@@ -2212,7 +2418,8 @@ int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
 
     for (i = 0; i < l1_sz; i++) {
         target_ulong base = i << (v_l1_shift + TARGET_PAGE_BITS);
-        int rc = walk_memory_regions_1(&data, base, v_l2_levels, l1_map + i);
+        int rc = walk_memory_regions_1(&data, base, v_l2_levels,
+                                       pageflags_map + i);
         if (rc != 0) {
             return rc;
         }
@@ -2245,15 +2452,173 @@ void page_dump(FILE *f)
     walk_memory_regions(f, dump_region);
 }
 
+static int *pageflags_find_alloc(tb_page_addr_t index, bool alloc)
+{
+    void **lp;
+    int *pf;
+    int i;
+
+    /* Level 1.  Always allocated.  */
+    lp = pageflags_map + ((index >> v_l1_shift) & (v_l1_size - 1));
+
+    /* Level 2..N-1.  */
+    for (i = v_l2_levels; i > 0; i--) {
+        void **p = qatomic_rcu_read(lp);
+
+        if (p == NULL) {
+            void *existing;
+
+            if (!alloc) {
+                return NULL;
+            }
+            p = g_new0(void *, V_L2_SIZE);
+            existing = qatomic_cmpxchg(lp, NULL, p);
+            if (unlikely(existing)) {
+                g_free(p);
+                p = existing;
+            }
+        }
+
+        lp = p + ((index >> (i * V_L2_BITS)) & (V_L2_SIZE - 1));
+    }
+
+    pf = qatomic_rcu_read(lp);
+    if (pf == NULL) {
+        void *existing;
+
+        if (!alloc) {
+            return NULL;
+        }
+        pf = g_new0(int, V_L2_SIZE);
+        existing = qatomic_cmpxchg(lp, NULL, pf);
+        if (unlikely(existing)) {
+            g_free(pf);
+            pf = existing;
+        }
+    }
+
+    return pf + (index & (V_L2_SIZE - 1));
+}
+
+static inline int *pageflags_find(tb_page_addr_t index)
+{
+    return pageflags_find_alloc(index, false);
+}
+
+/*
+ * Writers of the page flags lock the range of guest addresses they
+ * change, so that changes to disjoint ranges, e.g. target_mprotect() of
+ * different mappings, proceed in parallel with each other and with
+ * translation. Readers take no lock. mmap_lock, when needed, must be
+ * taken first. A thread may lock a subrange of a range it already holds,
+ * e.g. target_mmap() calling target_mprotect(); locks are released in
+ * reverse order.
+ */
+static QLIST_HEAD(, PageRangeLock) page_range_locks =
+    QLIST_HEAD_INITIALIZER(page_range_locks);
+static __thread PageRangeLock *page_range_held;
+
+bool have_page_range_lock(target_ulong start, target_ulong last)
+{
+    PageRangeLock *l;
+
+    for (l = page_range_held; l; l = l->outer) {
+        if (l->start <= start && last <= l->last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool page_range_held_overlaps(target_ulong start, target_ulong last)
+{
+    PageRangeLock *l;
+
+    for (l = page_range_held; l; l = l->outer) {
+        if (l->start <= last && start <= l->last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool page_range_busy(target_ulong start, target_ulong last)
+{
+    PageRangeLock *l;
+
+    QLIST_FOREACH(l, &page_range_locks, next) {
+        if (l->start <= last && start <= l->last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void page_range_lock(PageRangeLock *l, target_ulong start, target_ulong last)
+{
+    l->start = start;
+    l->last = last;
+    l->linked = !have_page_range_lock(start, last);
+    l->outer = page_range_held;
+
+    if (l->linked) {
+        qemu_mutex_lock(&page_range_mutex);
+        /* waiting for a range of our own would never end */
+        tcg_debug_assert(!page_range_held_overlaps(start, last));
+        while (page_range_busy(start, last)) {
+            qemu_cond_wait(&page_range_cond, &page_range_mutex);
+        }
+        QLIST_INSERT_HEAD(&page_range_locks, l, next);
+        qemu_mutex_unlock(&page_range_mutex);
+    }
+    page_range_held = l;
+}
+
+void page_range_unlock(PageRangeLock *l)
+{
+    tcg_debug_assert(l && l == page_range_held);
+    page_range_held = l->outer;
+    if (l->linked) {
+        qemu_mutex_lock(&page_range_mutex);
+        QLIST_REMOVE(l, next);
+        qemu_cond_broadcast(&page_range_cond);
+        qemu_mutex_unlock(&page_range_mutex);
+    }
+}
+
+/*
+ * Called in the child after fork, with the whole address space locked
+ * by the forking thread, which is the only one left.
+ */
+void page_range_fork_child(void)
+{
+    qemu_mutex_init(&page_range_mutex);
+    qemu_cond_init(&page_range_cond);
+}
+
 int page_get_flags(target_ulong address)
 {
-    PageDesc *p;
+    int *pf = pageflags_find(address >> TARGET_PAGE_BITS);
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        return 0;
+    return pf ? qatomic_read(pf) & ~PAGE_TRANSLATED : 0;
+}
+
+bool page_range_has_code(target_ulong start, target_ulong end)
+{
+    target_ulong addr;
+
+    assert(start < end);
+    start = start & TARGET_PAGE_MASK;
+    end = TARGET_PAGE_ALIGN(end);
+
+    for (addr = start; addr - start < end - start; addr += TARGET_PAGE_SIZE) {
+        int *pf = pageflags_find(addr >> TARGET_PAGE_BITS);
+
+        if (pf && (qatomic_read(pf) & PAGE_TRANSLATED)) {
+            return true;
+        }
     }
-    return p->flags;
+    return false;
 }
 
 /*
@@ -2263,15 +2628,18 @@ int page_get_flags(target_ulong address)
 #ifndef PAGE_TARGET_STICKY
 #define PAGE_TARGET_STICKY  0
 #endif
-#define PAGE_STICKY  (PAGE_ANON | PAGE_TARGET_STICKY)
+#define PAGE_STICKY  (PAGE_ANON | PAGE_TARGET_STICKY | PAGE_TRANSLATED)
 
 /* Modify the flags of a page and invalidate the code if necessary.
    The flag PAGE_WRITE_ORG is positioned automatically depending
-   on PAGE_WRITE.  The mmap_lock should already be held.  */
+   on PAGE_WRITE.  The mmap_lock or a range lock covering the pages
+   should already be held.  Code is only invalidated with the mmap_lock,
+   see page_range_has_code().  */
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
     target_ulong addr, len;
     bool reset_target_data;
+    bool invalidate = have_mmap_lock();
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2280,7 +2648,7 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     assert(start < end);
     /* Only set PAGE_ANON with new mappings. */
     assert(!(flags & PAGE_ANON) || (flags & PAGE_RESET));
-    assert_memory_lock();
+    tcg_debug_assert(invalidate || have_page_range_lock(start, end - 1));
 
     start = start & TARGET_PAGE_MASK;
     end = TARGET_PAGE_ALIGN(end);
@@ -2294,22 +2662,27 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     for (addr = start, len = end - start;
          len != 0;
          len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
+        int *pf = pageflags_find_alloc(addr >> TARGET_PAGE_BITS, true);
+        PageDesc *p = page_find(addr >> TARGET_PAGE_BITS);
+        int old_flags = qatomic_read(pf);
 
         /* If the write protection bit is set, then we invalidate
            the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
+        if (invalidate && p &&
+            !(old_flags & PAGE_WRITE) &&
             (flags & PAGE_WRITE) &&
             p->first_tb) {
             tb_invalidate_phys_page(addr, 0);
         }
         if (reset_target_data) {
-            g_free(p->target_data);
-            p->target_data = NULL;
-            p->flags = flags;
+            if (p) {
+                g_free(p->target_data);
+                p->target_data = NULL;
+            }
+            qatomic_set(pf, flags);
         } else {
             /* Using mprotect on a page does not change sticky bits. */
-            p->flags = (p->flags & PAGE_STICKY) | flags;
+            qatomic_set(pf, (old_flags & PAGE_STICKY) | flags);
         }
     }
 }
@@ -2333,10 +2706,12 @@ void page_reset_target_data(target_ulong start, target_ulong end)
     for (addr = start, len = end - start;
          len != 0;
          len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
+        PageDesc *p = page_find(addr >> TARGET_PAGE_BITS);
 
-        g_free(p->target_data);
-        p->target_data = NULL;
+        if (p) {
+            g_free(p->target_data);
+            p->target_data = NULL;
+        }
     }
 }
 
@@ -2348,10 +2723,11 @@ void *page_get_target_data(target_ulong address)
 
 void *page_alloc_target_data(target_ulong address, size_t size)
 {
-    PageDesc *p = page_find(address >> TARGET_PAGE_BITS);
     void *ret = NULL;
 
-    if (p->flags & PAGE_VALID) {
+    if (page_get_flags(address) & PAGE_VALID) {
+        PageDesc *p = page_find_alloc(address >> TARGET_PAGE_BITS, 1);
+
         ret = p->target_data;
         if (!ret) {
             p->target_data = ret = g_malloc0(size);
@@ -2362,7 +2738,6 @@ void *page_alloc_target_data(target_ulong address, size_t size)
 
 int page_check_range(target_ulong start, target_ulong len, int flags)
 {
-    PageDesc *p;
     target_ulong end;
     target_ulong addr;
 
@@ -2388,24 +2763,22 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
     for (addr = start, len = end - start;
          len != 0;
          len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
-        if (!p) {
-            return -1;
-        }
-        if (!(p->flags & PAGE_VALID)) {
+        int page_flags = page_get_flags(addr);
+
+        if (!(page_flags & PAGE_VALID)) {
             return -1;
         }
 
-        if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
+        if ((flags & PAGE_READ) && !(page_flags & PAGE_READ)) {
             return -1;
         }
         if (flags & PAGE_WRITE) {
-            if (!(p->flags & PAGE_WRITE_ORG)) {
+            if (!(page_flags & PAGE_WRITE_ORG)) {
                 return -1;
             }
             /* unprotect the page if it was put read-only because it
                contains translated code */
-            if (!(p->flags & PAGE_WRITE)) {
+            if (!(page_flags & PAGE_WRITE)) {
                 if (!page_unprotect(addr, 0)) {
                     return -1;
                 }
@@ -2417,27 +2790,33 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
 
 void page_protect(tb_page_addr_t page_addr)
 {
+    tb_page_addr_t host_addr = page_addr & qemu_host_page_mask;
+    PageRangeLock range;
     target_ulong addr;
-    PageDesc *p;
+    int *pf;
     int prot;
 
-    p = page_find(page_addr >> TARGET_PAGE_BITS);
-    if (p && (p->flags & PAGE_WRITE)) {
+    assert_memory_lock();
+    page_range_lock(&range, host_addr, host_addr + qemu_host_page_size - 1);
+    pf = pageflags_find(page_addr >> TARGET_PAGE_BITS);
+    if (pf) {
+        qatomic_set(pf, *pf | PAGE_TRANSLATED);
+    }
+    if (page_get_flags(page_addr) & PAGE_WRITE) {
         /*
          * Force the host page as non writable (writes will have a page fault +
          * mprotect overhead).
          */
-        page_addr &= qemu_host_page_mask;
+        page_addr = host_addr;
         prot = 0;
         for (addr = page_addr; addr < page_addr + qemu_host_page_size;
              addr += TARGET_PAGE_SIZE) {
-
-            p = page_find(addr >> TARGET_PAGE_BITS);
-            if (!p) {
+            pf = pageflags_find(addr >> TARGET_PAGE_BITS);
+            if (!pf) {
                 continue;
             }
-            prot |= p->flags;
-            p->flags &= ~PAGE_WRITE;
+            prot |= *pf;
+            qatomic_set(pf, *pf & ~PAGE_WRITE);
         }
         mprotect(g2h_untagged(page_addr), qemu_host_page_size,
                  (prot & PAGE_BITS) & ~PAGE_WRITE);
@@ -2445,6 +2824,7 @@ void page_protect(tb_page_addr_t page_addr)
             printf("protecting code page: 0x" TB_PAGE_ADDR_FMT "\n", page_addr);
         }
     }
+    page_range_unlock(&range);
 }
 
 /* called from signal handler: invalidate the code and unprotect the
@@ -2457,25 +2837,26 @@ int page_unprotect(target_ulong address, uintptr_t pc)
 {
     unsigned int prot;
     bool current_tb_invalidated;
-    PageDesc *p;
+    int page_flags;
     target_ulong host_start, host_end, addr;
+    PageRangeLock range;
 
     /* Technically this isn't safe inside a signal handler.  However we
        know this only ever happens in a synchronous SEGV handler, so in
        practice it seems to be ok.  */
     mmap_lock();
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        mmap_unlock();
-        return 0;
-    }
+    host_start = address & qemu_host_page_mask;
+    host_end = host_start + qemu_host_page_size;
+    page_range_lock(&range, host_start, host_end - 1);
+
+    page_flags = page_get_flags(address);
 
     /* if the page was really writable, then we change its
        protection back to writable */
-    if (p->flags & PAGE_WRITE_ORG) {
+    if (page_flags & PAGE_WRITE_ORG) {
         current_tb_invalidated = false;
-        if (p->flags & PAGE_WRITE) {
+        if (page_flags & PAGE_WRITE) {
             /* If the page is actually marked WRITE then assume this is because
              * this thread raced with another one which got here first and
              * set the page to PAGE_WRITE and did the TB invalidate for us.
@@ -2487,14 +2868,14 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             }
 #endif
         } else {
-            host_start = address & qemu_host_page_mask;
-            host_end = host_start + qemu_host_page_size;
-
             prot = 0;
             for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
-                p = page_find(addr >> TARGET_PAGE_BITS);
-                p->flags |= PAGE_WRITE;
-                prot |= p->flags;
+                int *pf = pageflags_find(addr >> TARGET_PAGE_BITS);
+
+                if (pf) {
+                    qatomic_set(pf, *pf | PAGE_WRITE);
+                    prot |= *pf;
+                }
 
                 /* and since the content will be modified, we must invalidate
                    the corresponding translated code. */
@@ -2508,10 +2889,12 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             mprotect((void *)g2h_untagged(host_start), qemu_host_page_size,
                      prot & PAGE_BITS);
         }
+        page_range_unlock(&range);
         mmap_unlock();
         /* If current TB was invalidated return to main loop */
         return current_tb_invalidated ? 2 : 1;
     }
+    page_range_unlock(&range);
     mmap_unlock();
     return 0;
 }
@@ -106,17 +106,18 @@ static void plugin_init(void)
     pages = g_hash_table_new(NULL, g_direct_equal);
 }
 
-static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
-                       uint64_t vaddr, void *udata)
+static void vcpu_haddr(unsigned int cpu_index,
+                       const struct qemu_plugin_mem_record *rec)
 {
-    struct qemu_plugin_hwaddr *hwaddr = qemu_plugin_get_hwaddr(meminfo, vaddr);
+    struct qemu_plugin_hwaddr *hwaddr = qemu_plugin_get_hwaddr(rec->info,
+                                                               rec->vaddr);
     uint64_t page;
     PageCounters *count;
 
     /* We only get a hwaddr for system emulation */
     if (track_io) {
         if (hwaddr && qemu_plugin_hwaddr_is_io(hwaddr)) {
-            page = vaddr;
+            page = rec->vaddr;
         } else {
             return;
         }
@@ -124,12 +125,11 @@ static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
         if (hwaddr && !qemu_plugin_hwaddr_is_io(hwaddr)) {
             page = (uint64_t) qemu_plugin_hwaddr_phys_addr(hwaddr);
         } else {
-            page = vaddr;
+            page = rec->vaddr;
         }
     }
     page &= ~page_mask;
 
-    g_mutex_lock(&lock);
     count = (PageCounters *) g_hash_table_lookup(pages, GUINT_TO_POINTER(page));
 
     if (!count) {
@@ -137,14 +137,26 @@ static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
         count->page_address = page;
         g_hash_table_insert(pages, GUINT_TO_POINTER(page), (gpointer) count);
     }
-    if (qemu_plugin_mem_is_store(meminfo)) {
+    if (qemu_plugin_mem_is_store(rec->info)) {
         count->writes++;
         count->cpu_write |= (1 << cpu_index);
     } else {
         count->reads++;
         count->cpu_read |= (1 << cpu_index);
     }
+}
+
+/* Accesses come in batches, so the lock is taken once per batch */
+static void vcpu_mem_batch(qemu_plugin_id_t id, unsigned int cpu_index,
+                           const struct qemu_plugin_mem_record *records,
+                           size_t n, void *udata)
+{
+    size_t i;
 
+    g_mutex_lock(&lock);
+    for (i = 0; i < n; i++) {
+        vcpu_haddr(cpu_index, &records[i]);
+    }
     g_mutex_unlock(&lock);
 }
 
@@ -155,9 +167,7 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 
     for (i = 0; i < n; i++) {
         struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
-        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_haddr,
-                                         QEMU_PLUGIN_CB_NO_REGS,
-                                         rw, NULL);
+        qemu_plugin_register_vcpu_mem_trace(insn, rw);
     }
 }
 
@@ -197,6 +207,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
 
     plugin_init();
 
+    qemu_plugin_register_vcpu_mem_batch_cb(id, vcpu_mem_batch,
+                                           QEMU_PLUGIN_MEM_TRACE_HWADDR, NULL);
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
     return 0;
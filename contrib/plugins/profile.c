@@ -0,0 +1,159 @@
+/*
+ * Profile - statistical profiler based on vCPU sampling
+ *
+ * Every sampling period the running vCPUs report the guest PC they
+ * are at. Translated code is not instrumented, so the plugin can stay
+ * loaded on long running workloads. At exit the samples are printed in
+ * the "folded stacks" format understood by flamegraph.pl and similar
+ * tools, one "root;symbol count" line per symbol.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+/* Plugins need to take care of their own locking */
+static GMutex lock;
+/* block start address -> symbol, filled in at translation time */
+static GHashTable *symbols;
+/* sampled pc -> number of samples */
+static GHashTable *samples;
+static uint64_t period_us = 1000;
+static const char *root = "guest";
+
+typedef struct {
+    const char *frame;
+    uint64_t count;
+} FoldedStack;
+
+static gint cmp_count(gconstpointer a, gconstpointer b)
+{
+    const FoldedStack *fa = a;
+    const FoldedStack *fb = b;
+
+    return fa->count > fb->count ? -1 : (fa->count < fb->count);
+}
+
+static void fold_sample(gpointer key, gpointer value, gpointer user_data)
+{
+    GHashTable *folded = user_data;
+    uint64_t pc = (uint64_t) key;
+    const char *sym = g_hash_table_lookup(symbols, key);
+    g_autofree char *addr = NULL;
+    FoldedStack *stack;
+
+    if (!sym) {
+        addr = g_strdup_printf("0x%" PRIx64, pc);
+        sym = addr;
+    }
+    stack = g_hash_table_lookup(folded, sym);
+    if (!stack) {
+        stack = g_new0(FoldedStack, 1);
+        stack->frame = g_strdup(sym);
+        g_hash_table_insert(folded, (gpointer) stack->frame, stack);
+    }
+    stack->count += (uint64_t) value;
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new("");
+    g_autoptr(GHashTable) folded = g_hash_table_new_full(g_str_hash,
+                                                         g_str_equal,
+                                                         g_free, g_free);
+    GList *stacks, *it;
+
+    /* stop sampling before walking the tables */
+    qemu_plugin_register_vcpu_sample_cb(id, NULL, 0, NULL);
+
+    g_mutex_lock(&lock);
+    g_hash_table_foreach(samples, fold_sample, folded);
+    g_mutex_unlock(&lock);
+
+    stacks = g_list_sort(g_hash_table_get_values(folded), cmp_count);
+    for (it = stacks; it; it = it->next) {
+        FoldedStack *stack = it->data;
+
+        g_string_append_printf(report, "%s;%s %" PRIu64 "\n",
+                               root, stack->frame, stack->count);
+    }
+    g_list_free(stacks);
+
+    qemu_plugin_outs(report->str);
+}
+
+static void vcpu_sample(qemu_plugin_id_t id, unsigned int cpu_index,
+                        uint64_t pc, void *udata)
+{
+    gpointer key = (gpointer) pc;
+    uint64_t count;
+
+    g_mutex_lock(&lock);
+    count = (uint64_t) g_hash_table_lookup(samples, key);
+    g_hash_table_insert(samples, key, (gpointer) (count + 1));
+    g_mutex_unlock(&lock);
+}
+
+/*
+ * Samples are taken at block boundaries, so recording the symbol of the
+ * first instruction of each block is enough to name every sample.
+ */
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, 0);
+    const char *sym = qemu_plugin_insn_symbol(insn);
+    gpointer key = (gpointer) qemu_plugin_tb_vaddr(tb);
+
+    if (sym) {
+        g_mutex_lock(&lock);
+        g_hash_table_insert(symbols, key, (gpointer) sym);
+        g_mutex_unlock(&lock);
+    }
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    g_autofree char *path = NULL;
+
+    for (int i = 0; i < argc; i++) {
+        char *opt = argv[i];
+        g_autofree char **tokens = g_strsplit(opt, "=", 2);
+        if (g_strcmp0(tokens[0], "period") == 0) {
+            period_us = tokens[1] ? g_ascii_strtoull(tokens[1], NULL, 10) : 0;
+            if (!period_us) {
+                fprintf(stderr, "invalid sampling period: %s\n", opt);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+
+    path = (char *) qemu_plugin_path_to_binary();
+    if (path) {
+        root = g_path_get_basename(path);
+    }
+
+    symbols = g_hash_table_new(NULL, g_direct_equal);
+    samples = g_hash_table_new(NULL, g_direct_equal);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_vcpu_sample_cb(id, vcpu_sample, period_us * 1000,
+                                        NULL);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -216,9 +216,9 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 #endif
 
 /*
- * Some targets clear the FP flags before most FP operations. This prevents
- * the use of hardfloat, since hardfloat relies on the inexact flag being
- * already set.
+ * Some targets clear the FP flags before most FP operations. Hardfloat
+ * would then have to work out the inexact flag for each of them (see
+ * can_use_fpu_err), and is not worth its checks.
  */
 #if defined(TARGET_PPC) || defined(__FAST_MATH__)
 # if defined(__FAST_MATH__)
@@ -241,6 +241,87 @@ static inline bool can_use_fpu(const float_status *s)
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * Outside of can_use_fpu(), the host FPU is still usable if the rounding
+ * error of each result is computed as well (see the err_* functions
+ * below).  Whether the error is zero tells whether to raise inexact, so
+ * that guests which clear their exception flags often, or whose results
+ * happen to be exact, are not stuck in soft-fp.  The inexact flag is thus
+ * only worked out until it is set, like the other flags that the targets
+ * only gather when the guest reads them.
+ *
+ * The host FPU always rounds to nearest even, since changing its rounding
+ * mode costs more than soft-fp does.  Directed rounding is obtained from
+ * the sign of the error instead: when it points away from the direction
+ * of rounding, the result moves by one ulp.
+ *
+ * Computing the error exactly requires that intermediate results are not
+ * kept with extra precision.
+ */
+#if !QEMU_NO_HARDFLOAT && defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+# define QEMU_HARDFLOAT_ERR 1
+#else
+# define QEMU_HARDFLOAT_ERR 0
+#endif
+
+static inline bool can_use_fpu_err(const float_status *s)
+{
+    if (!QEMU_HARDFLOAT_ERR) {
+        return false;
+    }
+    switch (s->float_rounding_mode) {
+    case float_round_nearest_even:
+    case float_round_to_zero:
+    case float_round_up:
+    case float_round_down:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* As can_use_fpu_err(), for operations that only round to nearest even. */
+static inline bool can_use_fpu_err_rne(const float_status *s)
+{
+    return QEMU_HARDFLOAT_ERR &&
+           s->float_rounding_mode == float_round_nearest_even;
+}
+
+/*
+ * Given @r, finite, nonzero and rounded to nearest, and @err_neg/@err_pos
+ * telling whether the exact result is below or above it, return @r
+ * rounded according to @rmode instead.  Stepping the encoding by one
+ * moves the magnitude by one ulp, across binades too.
+ */
+static inline uint64_t round_directed_bits(uint64_t r, bool neg, bool err_neg,
+                                           bool err_pos, FloatRoundMode rmode)
+{
+    bool inc;
+
+    switch (rmode) {
+    case float_round_nearest_even:
+        return r;
+    case float_round_to_zero:
+        /* Move toward zero if the exact result has a smaller magnitude. */
+        return (neg ? err_pos : err_neg) ? r - 1 : r;
+    case float_round_up:
+        if (!err_pos) {
+            return r;
+        }
+        inc = !neg;
+        break;
+    case float_round_down:
+        if (!err_neg) {
+            return r;
+        }
+        inc = neg;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    return inc ? r + 1 : r - 1;
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -270,6 +351,12 @@ typedef float32 (*soft_f32_op2_fn)(float32 a, float32 b, float_status *s);
 typedef float64 (*soft_f64_op2_fn)(float64 a, float64 b, float_status *s);
 typedef float   (*hard_f32_op2_fn)(float a, float b);
 typedef double  (*hard_f64_op2_fn)(double a, double b);
+/*
+ * Return a value with the sign of the exact result minus @r, zero if @r
+ * is exact, or NaN if the sign cannot be determined cheaply.
+ */
+typedef double  (*hard_f32_err2_fn)(float a, float b, float r);
+typedef double  (*hard_f64_err2_fn)(double a, double b, double r);
 
 /* 2-input is-zero-or-normal */
 static inline bool f32_is_zon2(union_float32 a, union_float32 b)
@@ -339,10 +426,68 @@ static inline bool f64_is_inf(union_float64 a)
     return float64_is_infinity(a.s);
 }
 
+/*
+ * Overflow, and results near or at zero (whose sign depends on the
+ * rounding mode), are left to soft-fp.
+ */
+static float32 QEMU_SOFTFLOAT_ATTR
+float32_gen2_err(union_float32 ua, union_float32 ub, float_status *s,
+                      hard_f32_op2_fn hard, hard_f32_err2_fn err,
+                      soft_f32_op2_fn soft)
+{
+    union_float32 ur;
+    double e;
+
+    ur.h = hard(ua.h, ub.h);
+    if (unlikely(f32_is_inf(ur) || fabsf(ur.h) <= FLT_MIN)) {
+        return soft(ua.s, ub.s, s);
+    }
+    e = err(ua.h, ub.h, ur.h);
+    if (unlikely(isnan(e))) {
+        return soft(ua.s, ub.s, s);
+    }
+    if (e != 0) {
+        ur.s = round_directed_bits(ur.s, float32_is_neg(ur.s), e < 0, e > 0,
+                                   s->float_rounding_mode);
+        if (unlikely(f32_is_inf(ur))) {
+            return soft(ua.s, ub.s, s);
+        }
+        float_raise(float_flag_inexact, s);
+    }
+    return ur.s;
+}
+
+static float64 QEMU_SOFTFLOAT_ATTR
+float64_gen2_err(union_float64 ua, union_float64 ub, float_status *s,
+                      hard_f64_op2_fn hard, hard_f64_err2_fn err,
+                      soft_f64_op2_fn soft)
+{
+    union_float64 ur;
+    double e;
+
+    ur.h = hard(ua.h, ub.h);
+    if (unlikely(f64_is_inf(ur) || fabs(ur.h) <= DBL_MIN)) {
+        return soft(ua.s, ub.s, s);
+    }
+    e = err(ua.h, ub.h, ur.h);
+    if (unlikely(isnan(e))) {
+        return soft(ua.s, ub.s, s);
+    }
+    if (e != 0) {
+        ur.s = round_directed_bits(ur.s, float64_is_neg(ur.s), e < 0, e > 0,
+                                   s->float_rounding_mode);
+        if (unlikely(f64_is_inf(ur))) {
+            return soft(ua.s, ub.s, s);
+        }
+        float_raise(float_flag_inexact, s);
+    }
+    return ur.s;
+}
+
 static inline float32
 float32_gen2(float32 xa, float32 xb, float_status *s,
-             hard_f32_op2_fn hard, soft_f32_op2_fn soft,
-             f32_check_fn pre, f32_check_fn post)
+             hard_f32_op2_fn hard, hard_f32_err2_fn err,
+             soft_f32_op2_fn soft, f32_check_fn pre, f32_check_fn post)
 {
     union_float32 ua, ub, ur;
 
@@ -350,6 +495,12 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
     ub.s = xb;
 
     if (unlikely(!can_use_fpu(s))) {
+        if (can_use_fpu_err(s)) {
+            float32_input_flush2(&ua.s, &ub.s, s);
+            if (pre(ua, ub)) {
+                return float32_gen2_err(ua, ub, s, hard, err, soft);
+            }
+        }
         goto soft;
     }
 
@@ -372,8 +523,8 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
 
 static inline float64
 float64_gen2(float64 xa, float64 xb, float_status *s,
-             hard_f64_op2_fn hard, soft_f64_op2_fn soft,
-             f64_check_fn pre, f64_check_fn post)
+             hard_f64_op2_fn hard, hard_f64_err2_fn err,
+             soft_f64_op2_fn soft, f64_check_fn pre, f64_check_fn post)
 {
     union_float64 ua, ub, ur;
 
@@ -381,6 +532,12 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
     ub.s = xb;
 
     if (unlikely(!can_use_fpu(s))) {
+        if (can_use_fpu_err(s)) {
+            float64_input_flush2(&ua.s, &ub.s, s);
+            if (pre(ua, ub)) {
+                return float64_gen2_err(ua, ub, s, hard, err, soft);
+            }
+        }
         goto soft;
     }
 
@@ -401,6 +558,148 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
     return soft(ua.s, ub.s, s);
 }
 
+/*
+ * float16 and bfloat16 arithmetic is done on the host in single precision,
+ * followed by a rounding to the narrower format.  Since float32 has more
+ * than twice the precision of either format plus two bits, the double
+ * rounding gives the correctly rounded result for add, sub, mul and div
+ * (S. Figueroa, "When is double rounding innocuous?", 1995).  Directed
+ * rounding is left to soft-fp.  Until inexact is set, both roundings are
+ * checked for exactness.
+ */
+typedef float16 (*soft_f16_op2_fn)(float16 a, float16 b, float_status *s);
+typedef bfloat16 (*soft_bf16_op2_fn)(bfloat16 a, bfloat16 b,
+                                     float_status *s);
+
+static inline bool f16_is_zon(float16 a)
+{
+    return float16_is_zero(a) || float16_is_normal(a);
+}
+
+static inline bool bf16_is_zon(bfloat16 a)
+{
+    return bfloat16_is_zero(a) || bfloat16_is_normal(a);
+}
+
+/* Widen a zero or normal float16 exactly.  */
+static inline float f16_to_host(float16 a)
+{
+    union_float32 u;
+    uint32_t sign = (uint32_t)(a & 0x8000) << 16;
+    uint32_t em = a & 0x7fff;
+
+    u.s = make_float32(em ? sign | ((em + ((127 - 15) << 10)) << 13) : sign);
+    return u.h;
+}
+
+static inline float bf16_to_host(bfloat16 a)
+{
+    union_float32 u;
+
+    u.s = make_float32((uint32_t)a << 16);
+    return u.h;
+}
+
+/*
+ * Round @f to nearest even float16.  Return false if the result could be
+ * tiny, or would overflow, which is left to soft-fp.  As in float32_gen2,
+ * a result equal to the smallest normal may have been rounded up from a
+ * tiny one.
+ */
+static inline bool f16_from_host(float f, float16 *r)
+{
+    union_float32 u = { .h = f };
+    uint32_t x = float32_val(u.s) & 0x7fffffff;
+    uint32_t sign = (float32_val(u.s) >> 16) & 0x8000;
+
+    if (x == 0) {
+        *r = make_float16(sign);
+        return true;
+    }
+    if (x <= (127 - 14) << 23) {
+        return false;
+    }
+    x -= (127 - 15) << 23;
+    x += 0xfff + ((x >> 13) & 1);
+    x >>= 13;
+    if (x >= 0x7c00) {
+        return false;
+    }
+    *r = make_float16(sign | x);
+    return true;
+}
+
+static inline bool bf16_from_host(float f, bfloat16 *r)
+{
+    union_float32 u = { .h = f };
+    uint32_t x = float32_val(u.s);
+
+    if ((x & 0x7fffffff) == 0) {
+        *r = x >> 16;
+        return true;
+    }
+    if ((x & 0x7fffffff) <= 0x00800000) {
+        return false;
+    }
+    x += 0x7fff + ((x >> 16) & 1);
+    if ((x & 0x7f800000) == 0x7f800000) {
+        return false;
+    }
+    *r = x >> 16;
+    return true;
+}
+
+static inline float16
+float16_gen2(float16 a, float16 b, float_status *s, hard_f32_op2_fn hard,
+             hard_f32_err2_fn err, soft_f16_op2_fn soft, bool is_div)
+{
+    bool track_inexact = !can_use_fpu(s);
+    float16 r;
+
+    if (likely(!track_inexact || can_use_fpu_err_rne(s)) &&
+        likely(f16_is_zon(a) && f16_is_zon(b) &&
+               !(is_div && float16_is_zero(b)))) {
+        float ha = f16_to_host(a), hb = f16_to_host(b);
+        float h = hard(ha, hb);
+
+        /* Unless an input is zero, a zero result may have underflowed. */
+        if ((h != 0 || float16_is_zero(a) || float16_is_zero(b)) &&
+            likely(f16_from_host(h, &r))) {
+            if (track_inexact &&
+                (f16_to_host(r) != h || err(ha, hb, h) != 0)) {
+                float_raise(float_flag_inexact, s);
+            }
+            return r;
+        }
+    }
+    return soft(a, b, s);
+}
+
+static inline bfloat16
+bfloat16_gen2(bfloat16 a, bfloat16 b, float_status *s, hard_f32_op2_fn hard,
+              hard_f32_err2_fn err, soft_bf16_op2_fn soft, bool is_div)
+{
+    bool track_inexact = !can_use_fpu(s);
+    bfloat16 r;
+
+    if (likely(!track_inexact || can_use_fpu_err_rne(s)) &&
+        likely(bf16_is_zon(a) && bf16_is_zon(b) &&
+               !(is_div && bfloat16_is_zero(b)))) {
+        float ha = bf16_to_host(a), hb = bf16_to_host(b);
+        float h = hard(ha, hb);
+
+        if ((h != 0 || bfloat16_is_zero(a) || bfloat16_is_zero(b)) &&
+            likely(bf16_from_host(h, &r))) {
+            if (track_inexact &&
+                (bf16_to_host(r) != h || err(ha, hb, h) != 0)) {
+                float_raise(float_flag_inexact, s);
+            }
+            return r;
+        }
+    }
+    return soft(a, b, s);
+}
+
 /*
  * Classify a floating point number. Everything above float_class_qnan
  * is a NaN so cls >= float_class_qnan is any NaN.
@@ -1843,8 +2142,8 @@ static floatx80 floatx80_round_pack_canonical(FloatParts128 *p,
  * Addition and subtraction
  */
 
-static float16 QEMU_FLATTEN
-float16_addsub(float16 a, float16 b, float_status *status, bool subtract)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_addsub(float16 a, float16 b, float_status *status, bool subtract)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -1855,14 +2154,14 @@ float16_addsub(float16 a, float16 b, float_status *status, bool subtract)
     return float16_round_pack_canonical(pr, status);
 }
 
-float16 float16_add(float16 a, float16 b, float_status *status)
+static float16 soft_f16_add(float16 a, float16 b, float_status *status)
 {
-    return float16_addsub(a, b, status, false);
+    return soft_f16_addsub(a, b, status, false);
 }
 
-float16 float16_sub(float16 a, float16 b, float_status *status)
+static float16 soft_f16_sub(float16 a, float16 b, float_status *status)
 {
-    return float16_addsub(a, b, status, true);
+    return soft_f16_addsub(a, b, status, true);
 }
 
 static float32 QEMU_SOFTFLOAT_ATTR
@@ -1929,6 +2228,31 @@ static double hard_f64_sub(double a, double b)
     return a - b;
 }
 
+/* The rounding error of a sum is exactly representable (Knuth's TwoSum). */
+static double err_f32_add(float a, float b, float r)
+{
+    float bv = r - a;
+
+    return (a - (r - bv)) + (b - bv);
+}
+
+static double err_f32_sub(float a, float b, float r)
+{
+    return err_f32_add(a, -b, r);
+}
+
+static double err_f64_add(double a, double b, double r)
+{
+    double bv = r - a;
+
+    return (a - (r - bv)) + (b - bv);
+}
+
+static double err_f64_sub(double a, double b, double r)
+{
+    return err_f64_add(a, -b, r);
+}
+
 static bool f32_addsubmul_post(union_float32 a, union_float32 b)
 {
     if (QEMU_HARDFLOAT_2F32_USE_FP) {
@@ -1947,41 +2271,57 @@ static bool f64_addsubmul_post(union_float64 a, union_float64 b)
 }
 
 static float32 float32_addsub(float32 a, float32 b, float_status *s,
-                              hard_f32_op2_fn hard, soft_f32_op2_fn soft)
+                              hard_f32_op2_fn hard, hard_f32_err2_fn err,
+                              soft_f32_op2_fn soft)
 {
-    return float32_gen2(a, b, s, hard, soft,
+    return float32_gen2(a, b, s, hard, err, soft,
                         f32_is_zon2, f32_addsubmul_post);
 }
 
 static float64 float64_addsub(float64 a, float64 b, float_status *s,
-                              hard_f64_op2_fn hard, soft_f64_op2_fn soft)
+                              hard_f64_op2_fn hard, hard_f64_err2_fn err,
+                              soft_f64_op2_fn soft)
 {
-    return float64_gen2(a, b, s, hard, soft,
+    return float64_gen2(a, b, s, hard, err, soft,
                         f64_is_zon2, f64_addsubmul_post);
 }
 
 float32 QEMU_FLATTEN
 float32_add(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_add, soft_f32_add);
+    return float32_addsub(a, b, s, hard_f32_add, err_f32_add, soft_f32_add);
 }
 
 float32 QEMU_FLATTEN
 float32_sub(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_sub, soft_f32_sub);
+    return float32_addsub(a, b, s, hard_f32_sub, err_f32_sub, soft_f32_sub);
 }
 
 float64 QEMU_FLATTEN
 float64_add(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_add, soft_f64_add);
+    return float64_addsub(a, b, s, hard_f64_add, err_f64_add, soft_f64_add);
 }
 
 float64 QEMU_FLATTEN
 float64_sub(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub);
+    return float64_addsub(a, b, s, hard_f64_sub, err_f64_sub, soft_f64_sub);
+}
+
+float16 QEMU_FLATTEN
+float16_add(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_add, err_f32_add, soft_f16_add,
+                        false);
+}
+
+float16 QEMU_FLATTEN
+float16_sub(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_sub, err_f32_sub, soft_f16_sub,
+                        false);
 }
 
 static float64 float64r32_addsub(float64 a, float64 b, float_status *status,
@@ -2006,8 +2346,8 @@ float64 float64r32_sub(float64 a, float64 b, float_status *status)
     return float64r32_addsub(a, b, status, true);
 }
 
-static bfloat16 QEMU_FLATTEN
-bfloat16_addsub(bfloat16 a, bfloat16 b, float_status *status, bool subtract)
+static bfloat16 QEMU_SOFTFLOAT_ATTR
+soft_bf16_addsub(bfloat16 a, bfloat16 b, float_status *status, bool subtract)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2018,14 +2358,28 @@ bfloat16_addsub(bfloat16 a, bfloat16 b, float_status *status, bool subtract)
     return bfloat16_round_pack_canonical(pr, status);
 }
 
-bfloat16 bfloat16_add(bfloat16 a, bfloat16 b, float_status *status)
+static bfloat16 soft_bf16_add(bfloat16 a, bfloat16 b, float_status *status)
+{
+    return soft_bf16_addsub(a, b, status, false);
+}
+
+static bfloat16 soft_bf16_sub(bfloat16 a, bfloat16 b, float_status *status)
 {
-    return bfloat16_addsub(a, b, status, false);
+    return soft_bf16_addsub(a, b, status, true);
 }
 
-bfloat16 bfloat16_sub(bfloat16 a, bfloat16 b, float_status *status)
+bfloat16 QEMU_FLATTEN
+bfloat16_add(bfloat16 a, bfloat16 b, float_status *s)
 {
-    return bfloat16_addsub(a, b, status, true);
+    return bfloat16_gen2(a, b, s, hard_f32_add, err_f32_add, soft_bf16_add,
+                         false);
+}
+
+bfloat16 QEMU_FLATTEN
+bfloat16_sub(bfloat16 a, bfloat16 b, float_status *s)
+{
+    return bfloat16_gen2(a, b, s, hard_f32_sub, err_f32_sub, soft_bf16_sub,
+                         false);
 }
 
 static float128 QEMU_FLATTEN
@@ -2078,7 +2432,8 @@ floatx80 floatx80_sub(floatx80 a, floatx80 b, float_status *status)
  * Multiplication
  */
 
-float16 QEMU_FLATTEN float16_mul(float16 a, float16 b, float_status *status)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_mul(float16 a, float16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2123,20 +2478,45 @@ static double hard_f64_mul(double a, double b)
     return a * b;
 }
 
+/* The product of two floats, and its error, are exact in double precision. */
+static double err_f32_mul(float a, float b, float r)
+{
+    return (double)a * b - r;
+}
+
+/*
+ * The error is a multiple of ulp(a) * ulp(b), and fma() computes it
+ * exactly unless that underflows.
+ */
+static double err_f64_mul(double a, double b, double r)
+{
+    if (unlikely(fabs(r) < 0x1p-900)) {
+        return NAN;
+    }
+    return fma(a, b, -r);
+}
+
 float32 QEMU_FLATTEN
 float32_mul(float32 a, float32 b, float_status *s)
 {
-    return float32_gen2(a, b, s, hard_f32_mul, soft_f32_mul,
+    return float32_gen2(a, b, s, hard_f32_mul, err_f32_mul, soft_f32_mul,
                         f32_is_zon2, f32_addsubmul_post);
 }
 
 float64 QEMU_FLATTEN
 float64_mul(float64 a, float64 b, float_status *s)
 {
-    return float64_gen2(a, b, s, hard_f64_mul, soft_f64_mul,
+    return float64_gen2(a, b, s, hard_f64_mul, err_f64_mul, soft_f64_mul,
                         f64_is_zon2, f64_addsubmul_post);
 }
 
+float16 QEMU_FLATTEN
+float16_mul(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_mul, err_f32_mul, soft_f16_mul,
+                        false);
+}
+
 float64 float64r32_mul(float64 a, float64 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
@@ -2148,8 +2528,8 @@ float64 float64r32_mul(float64 a, float64 b, float_status *status)
     return float64r32_round_pack_canonical(pr, status);
 }
 
-bfloat16 QEMU_FLATTEN
-bfloat16_mul(bfloat16 a, bfloat16 b, float_status *status)
+static bfloat16 QEMU_SOFTFLOAT_ATTR
+soft_bf16_mul(bfloat16 a, bfloat16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2160,6 +2540,13 @@ bfloat16_mul(bfloat16 a, bfloat16 b, float_status *status)
     return bfloat16_round_pack_canonical(pr, status);
 }
 
+bfloat16 QEMU_FLATTEN
+bfloat16_mul(bfloat16 a, bfloat16 b, float_status *s)
+{
+    return bfloat16_gen2(a, b, s, hard_f32_mul, err_f32_mul, soft_bf16_mul,
+                         false);
+}
+
 float128 QEMU_FLATTEN
 float128_mul(float128 a, float128 b, float_status *status)
 {
@@ -2418,7 +2805,8 @@ float128 QEMU_FLATTEN float128_muladd(float128 a, float128 b, float128 c,
  * Division
  */
 
-float16 float16_div(float16 a, float16 b, float_status *status)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_div(float16 a, float16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2463,6 +2851,28 @@ static double hard_f64_div(double a, double b)
     return a / b;
 }
 
+/*
+ * The remainder a - r * b is exactly representable, and has the sign of
+ * the error of the quotient multiplied by that of @b.
+ */
+static double err_f32_div(float a, float b, float r)
+{
+    double rem = a - (double)r * b;
+
+    return b < 0 ? -rem : rem;
+}
+
+static double err_f64_div(double a, double b, double r)
+{
+    double rem;
+
+    if (unlikely(fabs(a) < 0x1p-900)) {
+        return NAN;
+    }
+    rem = fma(-r, b, a);
+    return b < 0 ? -rem : rem;
+}
+
 static bool f32_div_pre(union_float32 a, union_float32 b)
 {
     if (QEMU_HARDFLOAT_2F32_USE_FP) {
@@ -2500,17 +2910,24 @@ static bool f64_div_post(union_float64 a, union_float64 b)
 float32 QEMU_FLATTEN
 float32_div(float32 a, float32 b, float_status *s)
 {
-    return float32_gen2(a, b, s, hard_f32_div, soft_f32_div,
+    return float32_gen2(a, b, s, hard_f32_div, err_f32_div, soft_f32_div,
                         f32_div_pre, f32_div_post);
 }
 
 float64 QEMU_FLATTEN
 float64_div(float64 a, float64 b, float_status *s)
 {
-    return float64_gen2(a, b, s, hard_f64_div, soft_f64_div,
+    return float64_gen2(a, b, s, hard_f64_div, err_f64_div, soft_f64_div,
                         f64_div_pre, f64_div_post);
 }
 
+float16 QEMU_FLATTEN
+float16_div(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_div, err_f32_div, soft_f16_div,
+                        true);
+}
+
 float64 float64r32_div(float64 a, float64 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
@@ -2522,8 +2939,8 @@ float64 float64r32_div(float64 a, float64 b, float_status *status)
     return float64r32_round_pack_canonical(pr, status);
 }
 
-bfloat16 QEMU_FLATTEN
-bfloat16_div(bfloat16 a, bfloat16 b, float_status *status)
+static bfloat16 QEMU_SOFTFLOAT_ATTR
+soft_bf16_div(bfloat16 a, bfloat16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2534,6 +2951,13 @@ bfloat16_div(bfloat16 a, bfloat16 b, float_status *status)
     return bfloat16_round_pack_canonical(pr, status);
 }
 
+bfloat16 QEMU_FLATTEN
+bfloat16_div(bfloat16 a, bfloat16 b, float_status *s)
+{
+    return bfloat16_gen2(a, b, s, hard_f32_div, err_f32_div, soft_bf16_div,
+                         true);
+}
+
 float128 QEMU_FLATTEN
 float128_div(float128 a, float128 b, float_status *status)
 {
@@ -2730,6 +3154,13 @@ float32 float16_to_float32(float16 a, bool ieee, float_status *s)
     const FloatFmt *fmt16 = ieee ? &float16_params : &float16_params_ahp;
     FloatParts64 p;
 
+    if (likely(f16_is_zon(a))) {
+        /* Widening conversion can never produce inexact results.  */
+        union_float32 uf;
+        uf.h = f16_to_host(a);
+        return uf.s;
+    }
+
     float16a_unpack_canonical(&p, a, s, fmt16);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -2750,6 +3181,20 @@ float16 float32_to_float16(float32 a, bool ieee, float_status *s)
     FloatParts64 p;
     const FloatFmt *fmt;
 
+    if (likely(ieee && float32_is_zero_or_normal(a)) &&
+        (can_use_fpu(s) || can_use_fpu_err_rne(s))) {
+        union_float32 uf;
+        float16 r;
+
+        uf.s = a;
+        if (likely(f16_from_host(uf.h, &r))) {
+            if (f16_to_host(r) != uf.h) {
+                float_raise(float_flag_inexact, s);
+            }
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     if (ieee) {
         parts_float_to_float(&p, s);
@@ -2803,7 +3248,8 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(&p, s, fmt);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2812,10 +3258,56 @@ float32 float64_to_float32(float64 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    union_float64 ud;
+    union_float32 uf;
+    bool inexact = false;
+
+    if (unlikely(!float64_is_zero_or_normal(a))) {
+        return soft_float64_to_float32(a, s);
+    }
+    if (float64_is_zero(a)) {
+        return float32_set_sign(float32_zero, float64_is_neg(a));
+    }
+    ud.s = a;
+    if (likely(can_use_fpu(s))) {
+        uf.h = ud.h;
+    } else if (can_use_fpu_err(s)) {
+        uf.h = ud.h;
+        if (likely(!f32_is_inf(uf) && fabsf(uf.h) > FLT_MIN)) {
+            /* The difference between a double and its rounding is exact. */
+            double e = ud.h - uf.h;
+
+            if (e != 0) {
+                uf.s = round_directed_bits(uf.s, float32_is_neg(uf.s),
+                                           e < 0, e > 0,
+                                           s->float_rounding_mode);
+                inexact = true;
+            }
+        }
+    } else {
+        return soft_float64_to_float32(a, s);
+    }
+    if (unlikely(f32_is_inf(uf) || fabsf(uf.h) <= FLT_MIN)) {
+        return soft_float64_to_float32(a, s);
+    }
+    if (inexact) {
+        float_raise(float_flag_inexact, s);
+    }
+    return uf.s;
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (likely(bf16_is_zon(a))) {
+        union_float32 uf;
+        uf.h = bf16_to_host(a);
+        return uf.s;
+    }
+
     bfloat16_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -2834,6 +3326,20 @@ bfloat16 float32_to_bfloat16(float32 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (likely(float32_is_zero_or_normal(a)) &&
+        (can_use_fpu(s) || can_use_fpu_err_rne(s))) {
+        union_float32 uf;
+        bfloat16 r;
+
+        uf.s = a;
+        if (likely(bf16_from_host(uf.h, &r))) {
+            if (bf16_to_host(r) != uf.h) {
+                float_raise(float_flag_inexact, s);
+            }
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return bfloat16_round_pack_canonical(&p, s);
@@ -3021,6 +3527,49 @@ floatx80 floatx80_round_to_int(floatx80 a, float_status *status)
  * Floating-point to signed integer conversions
  */
 
+/*
+ * Convert the zero or normal @d, which is a float32 or float64 widened
+ * exactly, with the host FPU.  Return false if the rounding mode is not
+ * supported or the result does not fit between @min and -@min - 1, which
+ * is left to soft-fp.
+ */
+static bool hard_float_to_sint(double d, FloatRoundMode rmode, int64_t min,
+                               float_status *s, int64_t *ret)
+{
+    double r;
+
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    switch (rmode) {
+    case float_round_nearest_even:
+        r = rint(d);
+        break;
+    case float_round_ties_away:
+        r = round(d);
+        break;
+    case float_round_to_zero:
+        r = trunc(d);
+        break;
+    case float_round_up:
+        r = ceil(d);
+        break;
+    case float_round_down:
+        r = floor(d);
+        break;
+    default:
+        return false;
+    }
+    if (unlikely(!(r >= (double)min && r < -(double)min))) {
+        return false;
+    }
+    if (r != d) {
+        float_raise(float_flag_inexact, s);
+    }
+    *ret = r;
+    return true;
+}
+
 int8_t float16_to_int8_scalbn(float16 a, FloatRoundMode rmode, int scale,
                               float_status *s)
 {
@@ -3070,6 +3619,15 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (likely(scale == 0 && float32_is_zero_or_normal(a))) {
+        union_float32 u = { .s = a };
+
+        if (likely(hard_float_to_sint(u.h, rmode, INT32_MIN, s, &r))) {
+            return r;
+        }
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3079,6 +3637,15 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (likely(scale == 0 && float32_is_zero_or_normal(a))) {
+        union_float32 u = { .s = a };
+
+        if (likely(hard_float_to_sint(u.h, rmode, INT64_MIN, s, &r))) {
+            return r;
+        }
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3097,6 +3664,15 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (likely(scale == 0 && float64_is_zero_or_normal(a))) {
+        union_float64 u = { .s = a };
+
+        if (likely(hard_float_to_sint(u.h, rmode, INT32_MIN, s, &r))) {
+            return r;
+        }
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3106,6 +3682,15 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (likely(scale == 0 && float64_is_zero_or_normal(a))) {
+        union_float64 u = { .s = a };
+
+        if (likely(hard_float_to_sint(u.h, rmode, INT64_MIN, s, &r))) {
+            return r;
+        }
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3802,8 +4387,12 @@ float32 int64_to_float32_scalbn(int64_t a, int scale, float_status *status)
 {
     FloatParts64 p;
 
-    /* Without scaling, there are no overflow concerns. */
-    if (likely(scale == 0) && can_use_fpu(status)) {
+    /*
+     * Without scaling, there are no overflow concerns.  Integers that fit
+     * in the significand convert exactly, whatever the flags and rounding.
+     */
+    if (likely(scale == 0) &&
+        (likely(a >= -(1 << 24) && a <= (1 << 24)) || can_use_fpu(status))) {
         union_float32 ur;
         ur.h = a;
         return ur.s;
@@ -3842,8 +4431,13 @@ float64 int64_to_float64_scalbn(int64_t a, int scale, float_status *status)
 {
     FloatParts64 p;
 
-    /* Without scaling, there are no overflow concerns. */
-    if (likely(scale == 0) && can_use_fpu(status)) {
+    /*
+     * Without scaling, there are no overflow concerns.  Integers that fit
+     * in the significand convert exactly, whatever the flags and rounding.
+     */
+    if (likely(scale == 0) &&
+        (likely(a >= -(1ll << 53) && a <= (1ll << 53)) ||
+         can_use_fpu(status))) {
         union_float64 ur;
         ur.h = a;
         return ur.s;
@@ -4012,8 +4606,12 @@ float32 uint64_to_float32_scalbn(uint64_t a, int scale, float_status *status)
 {
     FloatParts64 p;
 
-    /* Without scaling, there are no overflow concerns. */
-    if (likely(scale == 0) && can_use_fpu(status)) {
+    /*
+     * Without scaling, there are no overflow concerns.  Integers that fit
+     * in the significand convert exactly, whatever the flags and rounding.
+     */
+    if (likely(scale == 0) &&
+        (likely(a <= (1 << 24)) || can_use_fpu(status))) {
         union_float32 ur;
         ur.h = a;
         return ur.s;
@@ -4052,8 +4650,12 @@ float64 uint64_to_float64_scalbn(uint64_t a, int scale, float_status *status)
 {
     FloatParts64 p;
 
-    /* Without scaling, there are no overflow concerns. */
-    if (likely(scale == 0) && can_use_fpu(status)) {
+    /*
+     * Without scaling, there are no overflow concerns.  Integers that fit
+     * in the significand convert exactly, whatever the flags and rounding.
+     */
+    if (likely(scale == 0) &&
+        (likely(a <= (1ull << 53)) || can_use_fpu(status))) {
         union_float64 ur;
         ur.h = a;
         return ur.s;
@@ -4247,6 +4849,17 @@ float16_do_compare(float16 a, float16 b, float_status *s, bool is_quiet)
 {
     FloatParts64 pa, pb;
 
+    /* Zeros and normals are ordered and compare without raising flags. */
+    if (likely(f16_is_zon(a) && f16_is_zon(b))) {
+        float ha = f16_to_host(a), hb = f16_to_host(b);
+
+        if (isless(ha, hb)) {
+            return float_relation_less;
+        }
+        return isgreater(ha, hb) ? float_relation_greater
+                                 : float_relation_equal;
+    }
+
     float16_unpack_canonical(&pa, a, s);
     float16_unpack_canonical(&pb, b, s);
     return parts_compare(&pa, &pb, s, is_quiet);
@@ -4367,6 +4980,16 @@ bfloat16_do_compare(bfloat16 a, bfloat16 b, float_status *s, bool is_quiet)
 {
     FloatParts64 pa, pb;
 
+    if (likely(bf16_is_zon(a) && bf16_is_zon(b))) {
+        float ha = bf16_to_host(a), hb = bf16_to_host(b);
+
+        if (isless(ha, hb)) {
+            return float_relation_less;
+        }
+        return isgreater(ha, hb) ? float_relation_greater
+                                 : float_relation_equal;
+    }
+
     bfloat16_unpack_canonical(&pa, a, s);
     bfloat16_unpack_canonical(&pb, b, s);
     return parts_compare(&pa, &pb, s, is_quiet);
@@ -949,7 +949,108 @@ static const char *get_feature_xml(const char *p, const char **newp,
     return name ? xml_builtin[i][1] : NULL;
 }
 
-static int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
+/* Look up an XML feature description by file name. */
+static const char *gdb_find_feature_xml(CPUState *cpu, const char *name)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    int i;
+
+    if (cc->gdb_get_dynamic_xml) {
+        const char *xml = cc->gdb_get_dynamic_xml(cpu, name);
+
+        if (xml) {
+            return xml;
+        }
+    }
+    for (i = 0; xml_builtin[i][0]; i++) {
+        if (strcmp(xml_builtin[i][0], name) == 0) {
+            return xml_builtin[i][1];
+        }
+    }
+    return NULL;
+}
+
+/* Return the value of attribute @attr of the XML element at @elem, if any. */
+static char *gdb_xml_attr(const char *elem, const char *attr)
+{
+    g_autofree char *pattern = g_strdup_printf(" %s=\"", attr);
+    const char *end = strchr(elem, '>');
+    const char *val = strstr(elem, pattern);
+
+    if (!end || !val || val > end) {
+        return NULL;
+    }
+    val += strlen(pattern);
+    return g_strndup(val, strcspn(val, "\""));
+}
+
+/*
+ * Append the registers described by @xml, which QEMU numbers from
+ * @base_reg. Register numbers in the XML are absolute, so we only use
+ * them relative to the first register of the feature.
+ */
+static void gdb_append_feature_regs(GArray *regs, const char *xml,
+                                    int base_reg, int num_regs)
+{
+    g_autofree char *feature = NULL;
+    const char *feature_name = NULL;
+    const char *p;
+    int first = -1;
+    int num = 0;
+
+    p = strstr(xml, "<feature ");
+    if (p) {
+        feature = gdb_xml_attr(p, "name");
+    }
+    if (feature) {
+        feature_name = g_intern_string(feature);
+    }
+
+    for (p = strstr(xml, "<reg "); p; p = strstr(p + 1, "<reg ")) {
+        g_autofree char *name = gdb_xml_attr(p, "name");
+        g_autofree char *regnum = gdb_xml_attr(p, "regnum");
+
+        if (regnum) {
+            num = atoi(regnum);
+        }
+        if (first < 0) {
+            first = num;
+        }
+        if (name && num >= first && num - first < num_regs) {
+            GDBRegDesc desc = {
+                .gdb_reg = base_reg + num - first,
+                .name = g_intern_string(name),
+                .feature_name = feature_name,
+            };
+            g_array_append_val(regs, desc);
+        }
+        num++;
+    }
+}
+
+GArray *gdb_get_register_list(CPUState *cpu)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    GArray *regs = g_array_new(false, false, sizeof(GDBRegDesc));
+    GDBRegisterState *r;
+    const char *xml;
+
+    if (cc->gdb_core_xml_file) {
+        xml = gdb_find_feature_xml(cpu, cc->gdb_core_xml_file);
+        if (xml) {
+            gdb_append_feature_regs(regs, xml, 0, cc->gdb_num_core_regs);
+        }
+    }
+    for (r = cpu->gdb_regs; r; r = r->next) {
+        xml = gdb_find_feature_xml(cpu, r->xml);
+        if (xml) {
+            gdb_append_feature_regs(regs, xml, r->base_reg, r->num_regs);
+        }
+    }
+    return regs;
+}
+
+int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
     CPUArchState *env = cpu->env_ptr;
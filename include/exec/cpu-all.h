@@ -261,6 +261,13 @@ extern const TargetPageBits target_page;
 /* Target-specific bits that will be used via page_get_flags().  */
 #define PAGE_TARGET_1  0x0200
 #define PAGE_TARGET_2  0x0400
+/*
+ * The whole naturally aligned region of the size passed along with this
+ * flag to tlb_set_page_with_attrs() maps linearly to physical memory,
+ * with the same permissions and attributes, so the softmmu TLB may fill
+ * its other pages without calling back into the target.
+ */
+#define PAGE_LINEAR    0x0800
 
 #if defined(CONFIG_USER_ONLY)
 void page_dump(FILE *f);
@@ -274,6 +281,48 @@ void page_set_flags(target_ulong start, target_ulong end, int flags);
 void page_reset_target_data(target_ulong start, target_ulong end);
 int page_check_range(target_ulong start, target_ulong len, int flags);
 
+/* A range locked by page_range_lock(); the storage belongs to the caller */
+typedef struct PageRangeLock {
+    target_ulong start;
+    target_ulong last;
+    /* false if nested in a range this thread holds */
+    bool linked;
+    /* the lock this thread took before, if any */
+    struct PageRangeLock *outer;
+    QLIST_ENTRY(PageRangeLock) next;
+} PageRangeLock;
+
+/**
+ * page_range_lock(l, start, last)
+ * @l: storage for the lock, valid until page_range_unlock(@l)
+ * @start: first guest address of the range
+ * @last: last guest address of the range, inclusive
+ *
+ * Lock a range of guest addresses against changes of the page flags by
+ * other threads. Changes to disjoint ranges proceed in parallel, and
+ * page_get_flags() never waits. If the mmap_lock is needed as well, it
+ * must be taken first. Ranges within one already held by the thread are
+ * granted at once. Locks are released with page_range_unlock(), in the
+ * reverse order. Nothing is allocated, so that page_unprotect() can lock
+ * from the SIGSEGV handler with @l on its stack.
+ */
+void page_range_lock(PageRangeLock *l, target_ulong start, target_ulong last);
+void page_range_unlock(PageRangeLock *l);
+bool have_page_range_lock(target_ulong start, target_ulong last);
+void page_range_fork_child(void);
+
+/**
+ * page_range_has_code(start, end)
+ * @start: first guest address of the range
+ * @end: end of the range, exclusive
+ *
+ * Return true if code was translated from a page of the range since it
+ * was mapped. Making such pages writable needs the mmap_lock, which
+ * invalidates the code and waits for a translation in progress. Call
+ * with the range locked.
+ */
+bool page_range_has_code(target_ulong start, target_ulong end);
+
 /**
  * page_alloc_target_data(address, size)
  * @address: guest virtual address
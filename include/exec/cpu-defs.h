@@ -76,8 +76,15 @@ typedef uint64_t target_ulong;
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 
-/* use a fully associative victim tlb of 8 entries */
+/*
+ * Use a fully associative victim tlb of 8 entries by default; the size
+ * can be changed with the tlb-victim-size accelerator property.
+ */
 #define CPU_VTLB_SIZE 8
+#define CPU_VTLB_MAX_SIZE 256
+
+/* use a fully associative tlb of 8 guest large pages, see PAGE_LINEAR */
+#define CPU_LTLB_SIZE 8
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -150,6 +157,19 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/*
+ * A guest mapping larger than a target page, which is used to fill
+ * target pages within it without walking the guest page tables again.
+ * The entry is unused if @prot is 0.
+ */
+typedef struct CPUTLBLargeEntry {
+    target_ulong vaddr;
+    target_ulong mask;
+    hwaddr paddr;
+    MemTxAttrs attrs;
+    int prot;
+} CPUTLBLargeEntry;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
@@ -163,16 +183,29 @@ typedef struct CPUTLBDesc {
      */
     target_ulong large_page_addr;
     target_ulong large_page_mask;
+    /*
+     * The large pages mapped with PAGE_LINEAR, all of which lie within
+     * the region above, and the next one to replace.
+     */
+    CPUTLBLargeEntry ltlb[CPU_LTLB_SIZE];
+    size_t lindex;
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
     size_t n_used_entries;
+    /*
+     * Number of valid entries evicted by a fill since the last flush,
+     * and its maximum in the window; a high value means that the table
+     * suffers conflict misses even if its use rate is low.
+     */
+    size_t n_evictions;
+    size_t window_max_evictions;
     /* The next index to use in the tlb victim table.  */
     size_t vindex;
-    /* The tlb victim table, in two parts.  */
-    CPUTLBEntry vtable[CPU_VTLB_SIZE];
-    CPUIOTLBEntry viotlb[CPU_VTLB_SIZE];
+    /* The tlb victim table, in two parts, of tcg_tlb_victim_size entries. */
+    CPUTLBEntry *vtable;
+    CPUIOTLBEntry *viotlb;
     /* The iotlb.  */
     CPUIOTLBEntry *iotlb;
 } CPUTLBDesc;
@@ -182,7 +215,10 @@ typedef struct CPUTLBDesc {
  * The structure is aligned to aid loading the pair with one insn.
  */
 typedef struct CPUTLBDescFast {
-    /* Contains (n_entries - 1) << CPU_TLB_ENTRY_BITS */
+    /*
+     * Contains (n_entries - tcg_tlb_ways) << CPU_TLB_ENTRY_BITS, so that
+     * masking the shifted address yields the first entry of its set.
+     */
     uintptr_t mask;
     /* The array of tlb entries itself. */
     CPUTLBEntry *table;
@@ -208,6 +244,15 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /*
+     * Lookups that missed the first way of the fast path and were
+     * resolved by the second way, by the victim tlb, or by a fill.
+     */
+    size_t way_hit_count;
+    size_t victim_hit_count;
+    size_t fill_count;
+    /* Fills that were resolved from a large page without tlb_fill.  */
+    size_t large_fill_count;
 } CPUTLBCommon;
 
 /*
@@ -233,11 +278,32 @@ typedef struct CPUTLB { } CPUTLB;
 
 #endif  /* !CONFIG_USER_ONLY && CONFIG_TCG */
 
+/*
+ * Shadow stack of guest return addresses, pushed by calls and checked by
+ * returns in the generated code; see tcg_gen_ret_push.  Like the TB jump
+ * cache, it is cleared whenever the virtual address mapping changes.
+ */
+#define CPU_RET_STACK_BITS 4
+#define CPU_RET_STACK_SIZE (1 << CPU_RET_STACK_BITS)
+
+typedef struct CPURetStackEntry {
+    target_ulong pc;
+    /* The TranslationBlock containing the call, or 0 if invalid */
+    uintptr_t tb;
+} CPURetStackEntry;
+
+typedef struct CPURetStack {
+    CPURetStackEntry e[CPU_RET_STACK_SIZE];
+    /* Byte offset of the top entry within e[] */
+    uint32_t top;
+} CPURetStack;
+
 /*
  * This structure must be placed in ArchCPU immediately
  * before CPUArchState, as a field named "neg".
  */
 typedef struct CPUNegativeOffsetState {
+    CPURetStack ret_stack;
     CPUTLB tlb;
     IcountDecr icount_decr;
 } CPUNegativeOffsetState;
@@ -82,6 +82,14 @@ static inline bool cpu_loop_exit_requested(CPUState *cpu)
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 /* cputlb.c */
+/*
+ * Associativity of the fast path TLB (1 or 2) and number of entries in
+ * the victim TLB, per mmu_idx.  Set before any CPU is created, and
+ * constant afterwards since the backends bake the former into the
+ * generated code.
+ */
+extern unsigned tcg_tlb_ways;
+extern unsigned tcg_tlb_victim_size;
 /**
  * tlb_init - initialize a CPU's TLB
  * @cpu: CPU whose TLB should be initialized
@@ -277,8 +285,9 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
  * which provoked the TLB miss.
  *
  * At most one entry for a given virtual address is permitted. Only a
- * single TARGET_PAGE_SIZE region is mapped; the supplied @size is only
- * used by tlb_flush_page.
+ * single TARGET_PAGE_SIZE region is mapped; the supplied @size is used
+ * by tlb_flush_page, and also to fill the rest of the region on later
+ * misses if @prot includes PAGE_LINEAR.
  */
 void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
                              hwaddr paddr, MemTxAttrs attrs,
@@ -506,7 +515,9 @@ struct TranslationBlock {
      * indirect native jump instructions. These jumps are reset so that the TB
      * just continues its execution. The TB can be linked to another one by
      * setting one of the jump targets (or patching the jump instruction). Only
-     * two of such jumps are supported.
+     * two of such jumps are supported.  Two more, indirect, links are kept
+     * for the predicted destinations of indirect branches and returns, see
+     * jmp_pred and jmp_ret.
      */
     uint16_t jmp_reset_offset[2]; /* offset of original jump target */
 #define TB_JMP_RESET_OFFSET_INVALID 0xffff /* indicates no jump generated */
@@ -514,10 +525,10 @@ struct TranslationBlock {
 
     /*
      * Each TB has a NULL-terminated list (jmp_list_head) of incoming jumps.
-     * Each TB can have two outgoing jumps, and therefore can participate
-     * in two lists. The list entries are kept in jmp_list_next[2]. The least
-     * significant bit (LSB) of the pointers in these lists is used to encode
-     * which of the two list entries is to be used in the pointed TB.
+     * Each TB can have four outgoing jumps, and therefore can participate
+     * in four lists. The list entries are kept in jmp_list_next[4]. The two
+     * least significant bits of the pointers in these lists are used to
+     * encode which of the list entries is to be used in the pointed TB.
      *
      * List traversals are protected by jmp_lock. The destination TB of each
      * outgoing jump is kept in jmp_dest[] so that the appropriate jmp_lock
@@ -530,8 +541,25 @@ struct TranslationBlock {
      * to a destination TB that has CF_INVALID set.
      */
     uintptr_t jmp_list_head;
-    uintptr_t jmp_list_next[2];
-    uintptr_t jmp_dest[2];
+    uintptr_t jmp_list_next[4];
+    uintptr_t jmp_dest[4];
+
+    /*
+     * The destination last taken by the indirect branch that ends this TB,
+     * checked inline by tcg_gen_lookup_and_goto_ptr_pred before calling
+     * helper_lookup_tb_ptr.  It is linked as jump TB_JMP_PRED of this TB,
+     * so that it is reset when the destination is invalidated.
+     */
+    TranslationBlock *jmp_pred;
+#define TB_JMP_PRED 2
+
+    /*
+     * The TB at the return address of the call ending this TB, checked
+     * inline by tcg_gen_lookup_and_goto_ptr_ret.  It is linked as jump
+     * TB_JMP_RET of this TB.
+     */
+    TranslationBlock *jmp_ret;
+#define TB_JMP_RET 3
 };
 
 /* Hide the qatomic_read to make code a little easier on the eyes */
@@ -602,6 +630,7 @@ struct MemoryRegionSection *iotlb_to_section(CPUState *cpu,
 void mmap_lock(void);
 void mmap_unlock(void);
 bool have_mmap_lock(void);
+void tb_prefetch_user_exit(void);
 
 /**
  * get_page_addr_code() - user-mode version
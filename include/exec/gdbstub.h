@@ -133,6 +133,32 @@ void gdb_register_coprocessor(CPUState *cpu,
                               gdb_get_reg_cb get_reg, gdb_set_reg_cb set_reg,
                               int num_regs, const char *xml, int g_pos);
 
+typedef struct {
+    int gdb_reg;
+    const char *name;
+    const char *feature_name;
+} GDBRegDesc;
+
+/**
+ * gdb_get_register_list() - get the registers described to gdb
+ * @cpu: the CPU to query
+ *
+ * Walk the XML of the core registers and of each coprocessor registered
+ * with gdb_register_coprocessor(). Names are interned strings. The
+ * caller frees the returned array of GDBRegDesc.
+ */
+GArray *gdb_get_register_list(CPUState *cpu);
+
+/**
+ * gdb_read_register() - read a register in target byte order
+ * @cpu: the CPU to read from
+ * @buf: the array the value is appended to
+ * @reg: the gdb register number, as in GDBRegDesc
+ *
+ * Returns the size of the register, or 0 if @reg is not known.
+ */
+int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg);
+
 /*
  * The GDB remote protocol transfers values in target byte order. As
  * the gdbstub may be batching up several register values we always
@@ -230,9 +230,6 @@ struct kvm_run;
 struct hax_vcpu_state;
 struct hvf_vcpu_state;
 
-#define TB_JMP_CACHE_BITS 12
-#define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
-
 /* work queue */
 
 /* The union type allows passing of 64 bit target pointers on 32 bit
@@ -361,8 +358,8 @@ struct CPUState {
     CPUArchState *env_ptr;
     IcountDecr *icount_decr_ptr;
 
-    /* Accessed in parallel; all accesses must be atomic */
-    TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    /* See accel/tcg/tb-jmp-cache.h; allocated by tcg_exec_realizefn */
+    struct CPUJumpCache *tb_jmp_cache;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -398,6 +395,10 @@ struct CPUState {
 
 #ifdef CONFIG_PLUGIN
     GArray *plugin_mem_cbs;
+    /* accesses recorded for the memory trace batch callbacks */
+    struct qemu_plugin_mem_trace *plugin_mem_trace;
+    /* set by the plugin sampler, consumed at the next TB boundary */
+    bool plugin_sample_pending;
     /* saved iotlb data from io_writex */
     SavedIOTLB saved_iotlb;
 #endif
@@ -448,14 +449,13 @@ extern CPUTailQ cpus;
 
 extern __thread CPUState *current_cpu;
 
-static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
-{
-    unsigned int i;
-
-    for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i], NULL);
-    }
-}
+/**
+ * cpu_tb_jmp_cache_clear:
+ * @cpu: The CPU whose TB jump cache is cleared.
+ *
+ * Must be called from @cpu's thread, or while all CPUs are stopped.
+ */
+void cpu_tb_jmp_cache_clear(CPUState *cpu);
 
 /**
  * qemu_tcg_mttcg_enabled:
@@ -27,6 +27,8 @@ enum qemu_plugin_event {
     QEMU_PLUGIN_EV_VCPU_SYSCALL_RET,
     QEMU_PLUGIN_EV_FLUSH,
     QEMU_PLUGIN_EV_ATEXIT,
+    QEMU_PLUGIN_EV_VCPU_SAMPLE,
+    QEMU_PLUGIN_EV_VCPU_MEM_BATCH,
     QEMU_PLUGIN_EV_MAX, /* total number of plugin events we support */
 };
 
@@ -76,6 +78,8 @@ union qemu_plugin_cb_sig {
     qemu_plugin_vcpu_mem_cb_t        vcpu_mem;
     qemu_plugin_vcpu_syscall_cb_t    vcpu_syscall;
     qemu_plugin_vcpu_syscall_ret_cb_t vcpu_syscall_ret;
+    qemu_plugin_vcpu_sample_cb_t     vcpu_sample;
+    qemu_plugin_vcpu_mem_batch_cb_t  vcpu_mem_batch;
     void *generic;
 };
 
@@ -88,6 +92,8 @@ enum plugin_dyn_cb_type {
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_COND,
+    PLUGIN_CB_TRACE,
     PLUGIN_N_CB_SUBTYPES,
 };
 
@@ -96,21 +102,74 @@ enum plugin_dyn_cb_subtype {
  * Usually the insertion point is somewhere in the code cache; think for
  * instance of a callback to be called upon the execution of a particular TB.
  */
+/*
+ * TCG globals to store to env before a callback that reads registers,
+ * as indexes into tcg_ctx->temps. Globals are created before the TCG
+ * contexts are cloned, so the indexes are valid in all of them. Sets
+ * are shared by callbacks that read the same registers and never freed.
+ */
+struct qemu_plugin_reg_sync {
+    /* store all globals, e.g. for registers that no global backs */
+    bool all;
+    size_t n;
+    size_t globals[];
+};
+
 struct qemu_plugin_dyn_cb {
     union qemu_plugin_cb_sig f;
     void *userp;
     enum plugin_dyn_cb_subtype type;
+    /* @regs applies to regular udata callbacks only, NULL to sync nothing */
+    const struct qemu_plugin_reg_sync *regs;
     /* @rw applies to mem callbacks only (both regular and inline) */
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
         struct {
+            /* @entry.score is NULL for ops on the shared @userp counter */
+            qemu_plugin_u64 entry;
             enum qemu_plugin_op op;
             uint64_t imm;
         } inline_insn;
+        struct {
+            qemu_plugin_u64 entry;
+            enum qemu_plugin_cond cond;
+            uint64_t imm;
+        } cond;
+        struct {
+            /* for accesses from helpers, which cannot embed it */
+            uint64_t pc;
+        } trace;
     };
 };
 
+/*
+ * Per-vCPU memory trace buffer, see qemu_plugin_register_vcpu_mem_trace().
+ * Translated code appends to @records without bounds checks: TBs flush
+ * the buffer on entry once @len exceeds QEMU_PLUGIN_MEM_TRACE_THRESHOLD,
+ * and again before every QEMU_PLUGIN_MEM_TRACE_TB_MAX'th traced access
+ * after that, which only the largest TBs reach.
+ */
+#define QEMU_PLUGIN_MEM_TRACE_SIZE      4096
+#define QEMU_PLUGIN_MEM_TRACE_TB_MAX    512
+#define QEMU_PLUGIN_MEM_TRACE_THRESHOLD \
+    (QEMU_PLUGIN_MEM_TRACE_SIZE - QEMU_PLUGIN_MEM_TRACE_TB_MAX)
+
+struct qemu_plugin_mem_trace {
+    uint32_t len;
+    struct qemu_plugin_mem_record records[QEMU_PLUGIN_MEM_TRACE_SIZE];
+};
+
+/*
+ * One element per vCPU. @data is resized in an exclusive section when a
+ * vCPU with a higher index shows up; translated code embeds the address
+ * of @data->data, so the code cache is flushed when that happens.
+ */
+struct qemu_plugin_scoreboard {
+    GArray *data;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
 /* Internal context for instrumenting an instruction */
 struct qemu_plugin_insn {
     GByteArray *data;
@@ -208,6 +267,11 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
 
 void qemu_plugin_flush_cb(void);
 
+void qemu_plugin_vcpu_sample_cb(CPUState *cpu, uint64_t pc);
+
+void qemu_plugin_vcpu_mem_trace_flush(CPUState *cpu);
+void qemu_plugin_vcpu_tlb_change(CPUState *cpu);
+
 void qemu_plugin_atexit_cb(void);
 
 void qemu_plugin_add_dyn_cb_arr(GArray *arr);
@@ -285,6 +349,15 @@ void qemu_plugin_add_dyn_cb_arr(GArray *arr)
 static inline void qemu_plugin_disable_mem_helpers(CPUState *cpu)
 { }
 
+static inline void qemu_plugin_vcpu_sample_cb(CPUState *cpu, uint64_t pc)
+{ }
+
+static inline void qemu_plugin_vcpu_mem_trace_flush(CPUState *cpu)
+{ }
+
+static inline void qemu_plugin_vcpu_tlb_change(CPUState *cpu)
+{ }
+
 static inline void qemu_plugin_user_exit(void)
 { }
 #endif /* !CONFIG_PLUGIN */
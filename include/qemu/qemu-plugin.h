@@ -51,7 +51,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 2
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -206,10 +206,65 @@ void qemu_plugin_register_vcpu_idle_cb(qemu_plugin_id_t id,
 void qemu_plugin_register_vcpu_resume_cb(qemu_plugin_id_t id,
                                          qemu_plugin_vcpu_simple_cb_t cb);
 
+/**
+ * typedef qemu_plugin_vcpu_sample_cb_t - sampling callback
+ * @id: the unique qemu_plugin_id_t
+ * @vcpu_index: the sampled vCPU
+ * @pc: guest virtual address of the block the vCPU was about to execute
+ * @userdata: a pointer to some user data supplied when the callback
+ * was registered.
+ */
+typedef void (*qemu_plugin_vcpu_sample_cb_t)(qemu_plugin_id_t id,
+                                             unsigned int vcpu_index,
+                                             uint64_t pc, void *userdata);
+
+/**
+ * qemu_plugin_register_vcpu_sample_cb() - register a sampling callback
+ * @id: plugin ID
+ * @cb: callback function, NULL to unregister
+ * @period_ns: sampling period in nanoseconds
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * Every @period_ns, each vCPU that is executing guest code is asked to
+ * stop at its next translation block boundary, where @cb is called from
+ * the vCPU's thread. Idle vCPUs are not sampled. Nothing is added to the
+ * translated code, so the overhead only depends on the sampling rate.
+ *
+ * The period is shared by all plugins: the shortest one requested
+ * applies. Its resolution is that of the host's sleep, usually tens of
+ * microseconds.
+ */
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         qemu_plugin_vcpu_sample_cb_t cb,
+                                         uint64_t period_ns,
+                                         void *userdata);
+
 /** struct qemu_plugin_tb - Opaque handle for a translation block */
 struct qemu_plugin_tb;
 /** struct qemu_plugin_insn - Opaque handle for a translated instruction */
 struct qemu_plugin_insn;
+/**
+ * struct qemu_plugin_scoreboard - Opaque handle for a scoreboard
+ *
+ * A scoreboard is an array of plugin defined elements with one element
+ * per vCPU, indexed by vcpu_index. It grows automatically as vCPUs are
+ * hot-plugged, so plugins never have to size it themselves.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - uint64_t member of a scoreboard element
+ * @score: the scoreboard holding the counter
+ * @offset: offset of the uint64_t member within each element
+ *
+ * This designates one counter per vCPU. Inline ops and conditional
+ * callbacks use it to operate on the counter of the vCPU that executes
+ * the instrumented code, so no atomics or locks are needed.
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
 
 /**
  * enum qemu_plugin_cb_flags - type of callback
@@ -218,8 +273,12 @@ struct qemu_plugin_insn;
  * @QEMU_PLUGIN_CB_R_REGS: callback reads the CPU's regs
  * @QEMU_PLUGIN_CB_RW_REGS: callback reads and writes the CPU's regs
  *
- * Note: currently unused, plugins cannot read or change system
- * register state.
+ * Instruction callbacks registered with QEMU_PLUGIN_CB_R_REGS can read
+ * any register with qemu_plugin_read_register(), at the cost of storing
+ * all of the vCPU's state before each call. See
+ * qemu_plugin_register_vcpu_insn_exec_cb_regs() for a cheaper way.
+ * Plugins cannot change register state yet, so QEMU_PLUGIN_CB_RW_REGS
+ * is the same as QEMU_PLUGIN_CB_R_REGS.
  */
 enum qemu_plugin_cb_flags {
     QEMU_PLUGIN_CB_NO_REGS,
@@ -282,6 +341,31 @@ enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
 };
 
+/**
+ * enum qemu_plugin_cond - condition to enable a conditional callback
+ *
+ * @QEMU_PLUGIN_COND_NEVER: false
+ * @QEMU_PLUGIN_COND_ALWAYS: true
+ * @QEMU_PLUGIN_COND_EQ: is equal?
+ * @QEMU_PLUGIN_COND_NE: is not equal?
+ * @QEMU_PLUGIN_COND_LT: is less than?
+ * @QEMU_PLUGIN_COND_LE: is less than or equal?
+ * @QEMU_PLUGIN_COND_GT: is greater than?
+ * @QEMU_PLUGIN_COND_GE: is greater than or equal?
+ *
+ * All comparisons are unsigned.
+ */
+enum qemu_plugin_cond {
+    QEMU_PLUGIN_COND_NEVER,
+    QEMU_PLUGIN_COND_ALWAYS,
+    QEMU_PLUGIN_COND_EQ,
+    QEMU_PLUGIN_COND_NE,
+    QEMU_PLUGIN_COND_LT,
+    QEMU_PLUGIN_COND_LE,
+    QEMU_PLUGIN_COND_GT,
+    QEMU_PLUGIN_COND_GE,
+};
+
 /**
  * qemu_plugin_register_vcpu_tb_exec_inline() - execution inline op
  * @tb: the opaque qemu_plugin_tb handle for the translation
@@ -300,6 +384,45 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard counter the op applies to
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_inline(), but the op applies
+ * to the counter of the vCPU executing the block. Results are exact
+ * even with several vCPUs running in parallel.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb() - conditional execution cb
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to enable the callback
+ * @entry: the scoreboard counter the condition is evaluated on
+ * @imm: the value @entry is compared against
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called when a translated unit executes and
+ * "@entry @cond @imm" holds for the executing vCPU. The condition is
+ * evaluated inline, so blocks that do not satisfy it pay no call.
+ */
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               qemu_plugin_u64 entry,
+                                               uint64_t imm,
+                                               void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -314,6 +437,33 @@ void qemu_plugin_register_vcpu_insn_exec_cb(struct qemu_plugin_insn *insn,
                                             enum qemu_plugin_cb_flags flags,
                                             void *userdata);
 
+/** struct qemu_plugin_register - Opaque handle for a guest register */
+struct qemu_plugin_register;
+
+/**
+ * qemu_plugin_register_vcpu_insn_exec_cb_regs() - register insn execution
+ * cb that reads registers
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @regs: the registers @cb reads with qemu_plugin_read_register()
+ * @n_regs: number of elements in @regs
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * Like qemu_plugin_register_vcpu_insn_exec_cb() with QEMU_PLUGIN_CB_R_REGS,
+ * except that only the state backing @regs is stored before each call.
+ * Registers that the translator does not keep in a TCG global of the same
+ * name still need all of the state to be stored, and some, like flags
+ * that are computed lazily, are stale even then (see
+ * qemu_plugin_read_register()). Reading any other register from @cb
+ * returns stale values.
+ */
+void qemu_plugin_register_vcpu_insn_exec_cb_regs(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    struct qemu_plugin_register **regs,
+    size_t n_regs,
+    void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_inline() - insn execution inline op
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -328,6 +478,44 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard counter the op applies to
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_insn_exec_inline(), but the op applies
+ * to the counter of the vCPU executing the instruction.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_insn_exec_cond_cb() - conditional insn cb
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to enable the callback
+ * @entry: the scoreboard counter the condition is evaluated on
+ * @imm: the value @entry is compared against
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called when the instruction executes and
+ * "@entry @cond @imm" holds for the executing vCPU.
+ */
+void qemu_plugin_register_vcpu_insn_exec_cond_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    enum qemu_plugin_cond cond,
+    qemu_plugin_u64 entry,
+    uint64_t imm,
+    void *userdata);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -444,7 +632,8 @@ bool qemu_plugin_mem_is_store(qemu_plugin_meminfo_t info);
  *
  * This handle is *only* valid for the duration of the callback. Any
  * information about the handle should be recovered before the
- * callback returns.
+ * callback returns. It can also be called on the records passed to a
+ * batch callback registered with QEMU_PLUGIN_MEM_TRACE_HWADDR.
  */
 struct qemu_plugin_hwaddr *qemu_plugin_get_hwaddr(qemu_plugin_meminfo_t info,
                                                   uint64_t vaddr);
@@ -497,7 +686,101 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @rw: monitor reads, writes or both
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard counter the op applies to
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_mem_inline(), but the op applies to
+ * the counter of the vCPU making the access. It is applied once for
+ * each access of @insn that matches @rw.
+ */
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * struct qemu_plugin_mem_record - a memory access from the trace buffer
+ * @vaddr: virtual address of the access
+ * @pc: virtual address of the instruction performing the access
+ * @info: opaque memory transaction handle, see the qemu_plugin_mem_* queries
+ */
+struct qemu_plugin_mem_record {
+    uint64_t vaddr;
+    uint64_t pc;
+    qemu_plugin_meminfo_t info;
+};
+
+/**
+ * enum qemu_plugin_mem_trace_flags - how the trace buffer is consumed
+ * @QEMU_PLUGIN_MEM_TRACE_VADDR: only virtual addresses are used
+ * @QEMU_PLUGIN_MEM_TRACE_HWADDR: the batch callback calls
+ * qemu_plugin_get_hwaddr() on the records
+ */
+enum qemu_plugin_mem_trace_flags {
+    QEMU_PLUGIN_MEM_TRACE_VADDR,
+    QEMU_PLUGIN_MEM_TRACE_HWADDR,
+};
+
+/**
+ * typedef qemu_plugin_vcpu_mem_batch_cb_t - memory trace batch callback
+ * @id: the unique qemu_plugin_id_t
+ * @vcpu_index: the vCPU that performed the accesses
+ * @records: the accesses, oldest first
+ * @n: number of elements in @records
+ * @userdata: a pointer to some user data supplied when the callback
+ * was registered.
+ *
+ * @records is only valid for the duration of the callback.
+ */
+typedef void
+(*qemu_plugin_vcpu_mem_batch_cb_t)(qemu_plugin_id_t id,
+                                   unsigned int vcpu_index,
+                                   const struct qemu_plugin_mem_record *records,
+                                   size_t n, void *userdata);
+
+/**
+ * qemu_plugin_register_vcpu_mem_trace() - trace an instruction's accesses
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @rw: trace reads, writes or both
+ *
+ * Instead of calling out for every access, the translated code appends a
+ * record to a buffer of the vCPU, which is handed over to the callbacks
+ * registered with qemu_plugin_register_vcpu_mem_batch_cb(). Accesses are
+ * recorded at most once, however many plugins trace the instruction.
+ *
+ * The request is ignored until a batch callback has been registered.
+ */
+void qemu_plugin_register_vcpu_mem_trace(struct qemu_plugin_insn *insn,
+                                         enum qemu_plugin_mem_rw rw);
 
+/**
+ * qemu_plugin_register_vcpu_mem_batch_cb() - consume the memory trace
+ * @id: plugin ID
+ * @cb: callback function, NULL to unregister
+ * @flags: QEMU_PLUGIN_MEM_TRACE_HWADDR if @cb looks up physical addresses
+ * @userdata: any plugin data to pass to the @cb
+ *
+ * @cb is called from the vCPU's thread with the accesses recorded since
+ * the previous call: when the buffer is about to fill up, when the vCPU
+ * stops executing translated code and before it exits. Every batch
+ * callback sees every record, whichever plugin traced the instruction.
+ *
+ * With QEMU_PLUGIN_MEM_TRACE_HWADDR the buffer is also handed over
+ * before the vCPU's TLB changes, so that qemu_plugin_get_hwaddr() can be
+ * called on the records from @cb. This makes batches smaller, so only
+ * ask for it when physical addresses are needed.
+ */
+void qemu_plugin_register_vcpu_mem_batch_cb(qemu_plugin_id_t id,
+                                            qemu_plugin_vcpu_mem_batch_cb_t cb,
+                                            enum qemu_plugin_mem_trace_flags flags,
+                                            void *userdata);
 
 typedef void
 (*qemu_plugin_vcpu_syscall_cb_t)(qemu_plugin_id_t id, unsigned int vcpu_index,
@@ -625,4 +908,132 @@ uint64_t qemu_plugin_end_code(void);
  */
 uint64_t qemu_plugin_entry_code(void);
 
+/**
+ * qemu_plugin_scoreboard_new() - alloc a new scoreboard
+ * @element_size: size (in bytes) of each element
+ *
+ * Returns a pointer to a new scoreboard. Every element is zeroed,
+ * including the ones added when more vCPUs are initialized.
+ */
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: scoreboard to free
+ *
+ * No inline op or conditional callback using @score may run anymore,
+ * so this is typically called from an atexit callback.
+ */
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get pointer to an element of a scoreboard
+ * @score: scoreboard to query
+ * @vcpu_index: index of the vCPU
+ *
+ * Returns the address of the element of @vcpu_index. The address is
+ * only stable until the next vCPU is initialized.
+ */
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_scoreboard_size() - number of elements of a scoreboard
+ * @score: scoreboard to query
+ *
+ * Returns one more than the highest vcpu_index that
+ * qemu_plugin_scoreboard_find() accepts. Every vCPU that has been
+ * initialized has an element; elements of vCPUs that never ran are zero.
+ * This may be less than the maximum number of vCPUs of the machine.
+ */
+unsigned int qemu_plugin_scoreboard_size(struct qemu_plugin_scoreboard *score);
+
+/* Macros to define a qemu_plugin_u64 */
+#define qemu_plugin_scoreboard_u64(score) \
+    (qemu_plugin_u64) {score, 0}
+#define qemu_plugin_scoreboard_u64_in_struct(score, type, member) \
+    (qemu_plugin_u64) {score, offsetof(type, member)}
+
+/**
+ * qemu_plugin_u64_add() - add a value to a qemu_plugin_u64 for a given vcpu
+ * @entry: entry to update
+ * @vcpu_index: index of the vCPU
+ * @added: value to add
+ */
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added);
+
+/**
+ * qemu_plugin_u64_get() - get the value of a qemu_plugin_u64 for a given vcpu
+ * @entry: entry to read
+ * @vcpu_index: index of the vCPU
+ */
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_set() - set the value of a qemu_plugin_u64 for a given vcpu
+ * @entry: entry to update
+ * @vcpu_index: index of the vCPU
+ * @val: new value
+ */
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+
+/**
+ * qemu_plugin_u64_sum() - return the sum of a qemu_plugin_u64 over all vCPUs
+ * @entry: entry to sum
+ */
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
+/**
+ * typedef qemu_plugin_reg_descriptor - register descriptions
+ *
+ * @handle: opaque handle for retrieving value with qemu_plugin_read_register
+ * @name: register name
+ * @feature: optional feature descriptor, can be NULL
+ */
+typedef struct {
+    struct qemu_plugin_register *handle;
+    const char *name;
+    const char *feature;
+} qemu_plugin_reg_descriptor;
+
+/**
+ * qemu_plugin_get_registers() - return register list for current vCPU
+ * @n: set to the number of registers returned
+ *
+ * Returns the registers the gdbstub describes in its XML, in gdb order,
+ * as an array the caller must free with g_free(). Names and features are
+ * owned by QEMU. This must be called from a vCPU callback, e.g. when
+ * translating. Handles are the same for all vCPUs of a given type.
+ */
+qemu_plugin_reg_descriptor *qemu_plugin_get_registers(size_t *n);
+
+/**
+ * qemu_plugin_read_register() - read register for current vCPU
+ * @handle: a handle from qemu_plugin_get_registers()
+ * @buf: where to store the value, in target byte order
+ * @size: size of @buf in bytes
+ *
+ * This is only valid from callbacks that declared the register with
+ * qemu_plugin_register_vcpu_insn_exec_cb_regs(), from callbacks
+ * registered with QEMU_PLUGIN_CB_R_REGS, and from sampling callbacks.
+ *
+ * Even then, instruction callbacks see stale values of the registers
+ * whose state the translator tracks itself and only writes back when it
+ * is needed:
+ *
+ * - the program counter, on all targets; it is only up to date at
+ *   translation block boundaries;
+ * - the flags computed lazily from the last flag setting operation:
+ *   EFLAGS on x86, the condition codes on m68k, the PSW condition code
+ *   on s390x and CCS on CRIS;
+ * - the IT block bits of the CPSR in Arm Thumb code.
+ *
+ * Returns the size of the register, which is only copied to @buf if it
+ * fits, or -1 if @handle is not valid.
+ */
+int qemu_plugin_read_register(struct qemu_plugin_register *handle,
+                              uint8_t *buf, size_t size);
+
 #endif /* QEMU_QEMU_PLUGIN_H */
@@ -833,6 +833,39 @@ void tcg_gen_goto_tb(unsigned idx);
  */
 void tcg_gen_lookup_and_goto_ptr(void);
 
+/**
+ * tcg_gen_lookup_and_goto_ptr_pred() - tcg_gen_lookup_and_goto_ptr with
+ * an inline prediction
+ * @tb: The TB being translated
+ * @pc: The pc of the target TB, as computed by cpu_get_tb_cpu_state
+ *
+ * Before looking up the target TB, compare @pc with the last target of
+ * this branch and jump there directly if it matches.  The caller must
+ * ensure that the branch does not change cs_base, flags or cflags of
+ * the target TB with respect to @tb.
+ */
+void tcg_gen_lookup_and_goto_ptr_pred(const TranslationBlock *tb, TCGv pc);
+
+/**
+ * tcg_gen_ret_push() - push a return address on the shadow return stack
+ * @tb: The TB being translated, which ends with a call
+ * @ret_pc: The pc of the return address, as computed by cpu_get_tb_cpu_state
+ */
+void tcg_gen_ret_push(const TranslationBlock *tb, target_ulong ret_pc);
+
+/**
+ * tcg_gen_lookup_and_goto_ptr_ret() - tcg_gen_lookup_and_goto_ptr for a
+ * function return
+ * @tb: The TB being translated, which ends with a return
+ * @pc: The pc of the target TB, as computed by cpu_get_tb_cpu_state
+ *
+ * Pop the shadow return stack and, if @pc is the return address of the
+ * call, jump directly to the TB following that call.  The caller must
+ * ensure that the return does not change cs_base, flags or cflags of
+ * the target TB with respect to @tb.
+ */
+void tcg_gen_lookup_and_goto_ptr_ret(const TranslationBlock *tb, TCGv pc);
+
 static inline void tcg_gen_plugin_cb_start(unsigned from, unsigned type,
                                            unsigned wr)
 {
@@ -281,6 +281,20 @@ DEF(last_generic, 0, 0, 0, TCG_OPF_NOT_PRESENT)
 /* These opcodes are only for use between the tci generator and interpreter. */
 DEF(tci_movi, 1, 0, 1, TCG_OPF_NOT_PRESENT)
 DEF(tci_movl, 1, 0, 1, TCG_OPF_NOT_PRESENT)
+/* Fused compare and branch, taking two insn words. */
+DEF(tci_brcond_i32, 0, 2, 2, TCG_OPF_NOT_PRESENT)
+DEF(tci_brcond_i64, 0, 2, 2, TCG_OPF_NOT_PRESENT)
+/* A load fused with the arithmetic insn word that follows it. */
+DEF(tci_ld32_add, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld32_sub, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld32_and, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld32_or, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld32_xor, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld64_add, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld64_sub, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld64_and, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld64_or, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld64_xor, 1, 1, 1, TCG_OPF_NOT_PRESENT)
 #endif
 
 #undef TLADDR_ARGS
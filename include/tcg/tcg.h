@@ -523,6 +523,11 @@ typedef struct TCGProfile {
     int temp_count_max;
     int64_t temp_count;
     int64_t del_op_count;
+    int64_t spill_count; /* temps stored to free a register */
+    int64_t sync_count;  /* temps stored, including spills */
+    int64_t fill_count;  /* temps loaded from memory */
+    int64_t gvn_count;   /* ops replaced by an earlier result */
+    int64_t ld_fwd_count; /* env loads replaced by a known value */
     int64_t code_in_len;
     int64_t code_out_len;
     int64_t search_out_len;
@@ -544,6 +549,10 @@ struct TCGContext {
     int nb_indirects;
     int nb_ops;
 
+    /* Redundant ops removed by tcg_optimize from the current TB. */
+    int opt_gvn_count;
+    int opt_ld_fwd_count;
+
     /* goto_tb support */
     tcg_insn_unit *code_buf;
     uint16_t *tb_jmp_reset_offset; /* tb->jmp_reset_offset */
@@ -806,9 +815,12 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+void tcg_region_mark_used(const void *tc_ptr);
+size_t tcg_region_evict(void (*evict_tb)(TranslationBlock *tb));
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
+void tcg_region_dump_info(GString *buf);
 
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
@@ -835,7 +847,16 @@ static inline void *tcg_malloc(int size)
     }
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus);
+/* Backing of the code buffer, see tcg_region_init.  */
+typedef enum TCGCodeHugePages {
+    TCG_CODE_HUGEPAGES_AUTO,
+    TCG_CODE_HUGEPAGES_OFF,
+    TCG_CODE_HUGEPAGES_TRANSPARENT,
+    TCG_CODE_HUGEPAGES_EXPLICIT,
+} TCGCodeHugePages;
+
+void tcg_init(size_t tb_size, int splitwx, TCGCodeHugePages hugepages,
+              bool numa, unsigned max_cpus);
 void tcg_register_thread(void);
 void tcg_prologue_init(TCGContext *s);
 void tcg_func_start(TCGContext *s);
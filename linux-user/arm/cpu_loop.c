@@ -74,9 +74,29 @@
         put_user_u16(__x, (gaddr));                     \
     })
 
+/*
+ * mprotect only locks the pages it changes, not the mmap_lock. The
+ * mmap_lock is still taken first, as page_unprotect() would take it if
+ * the access hits a page holding translated code.
+ */
+static void lock_atomic_page(PageRangeLock *range, uint32_t addr)
+{
+    target_ulong page = addr & qemu_host_page_mask;
+
+    mmap_lock();
+    page_range_lock(range, page, page + qemu_host_page_size - 1);
+}
+
+static void unlock_atomic_page(PageRangeLock *range)
+{
+    page_range_unlock(range);
+    mmap_unlock();
+}
+
 /*
  * Similar to code in accel/tcg/user-exec.c, but outside the execution loop.
- * Must be called with mmap_lock.
+ * Must be called with the host page of @addr locked by lock_atomic_page(),
+ * so that mprotect cannot change it between the check and the access.
  * We get the PC of the entry address - which is as good as anything,
  * on a real kernel what you get depends on which mode it uses.
  */
@@ -116,20 +136,21 @@ static void *atomic_mmu_lookup(CPUArchState *env, uint32_t addr, int size)
 static void arm_kernel_cmpxchg32_helper(CPUARMState *env)
 {
     uint32_t oldval, newval, val, addr, cpsr, *host_addr;
+    PageRangeLock range;
 
     oldval = env->regs[0];
     newval = env->regs[1];
     addr = env->regs[2];
 
-    mmap_lock();
+    lock_atomic_page(&range, addr);
     host_addr = atomic_mmu_lookup(env, addr, 4);
     if (!host_addr) {
-        mmap_unlock();
+        unlock_atomic_page(&range);
         return;
     }
 
     val = qatomic_cmpxchg__nocheck(host_addr, oldval, newval);
-    mmap_unlock();
+    unlock_atomic_page(&range);
 
     cpsr = (val == oldval) * CPSR_C;
     cpsr_write(env, cpsr, CPSR_C, CPSRWriteByInstr);
@@ -155,6 +176,7 @@ static void arm_kernel_cmpxchg64_helper(CPUARMState *env)
     uint64_t oldval, newval, val;
     uint32_t addr, cpsr;
     uint64_t *host_addr;
+    PageRangeLock range;
 
     addr = env->regs[0];
     if (get_user_u64(oldval, addr)) {
@@ -166,11 +188,11 @@ static void arm_kernel_cmpxchg64_helper(CPUARMState *env)
         goto segv;
     }
 
-    mmap_lock();
     addr = env->regs[2];
+    lock_atomic_page(&range, addr);
     host_addr = atomic_mmu_lookup(env, addr, 8);
     if (!host_addr) {
-        mmap_unlock();
+        unlock_atomic_page(&range);
         return;
     }
 
@@ -192,7 +214,7 @@ static void arm_kernel_cmpxchg64_helper(CPUARMState *env)
     }
     end_exclusive();
 #endif
-    mmap_unlock();
+    unlock_atomic_page(&range);
 
     cpsr_write(env, cpsr, CPSR_C, CPSRWriteByInstr);
     env->regs[0] = cpsr ? 0 : -1;
@@ -37,5 +37,6 @@ void preexit_cleanup(CPUArchState *env, int code)
         __gcov_dump();
 #endif
         gdb_exit(code);
+        tb_prefetch_user_exit();
         qemu_plugin_user_exit();
 }
@@ -45,20 +45,46 @@ bool have_mmap_lock(void)
     return mmap_lock_count > 0 ? true : false;
 }
 
+/*
+ * Operations that search for free space or replace mappings also lock
+ * the whole guest address space, so that they exclude target_mprotect(),
+ * which only locks the pages it changes and runs in parallel with other
+ * mprotect calls and with translation.
+ */
+void mmap_lock_all(PageRangeLock *range)
+{
+    mmap_lock();
+    page_range_lock(range, 0, -1);
+}
+
+void mmap_unlock_all(PageRangeLock *range)
+{
+    page_range_unlock(range);
+    mmap_unlock();
+}
+
+/* Held across fork() by the forking thread, under mmap_mutex */
+static PageRangeLock fork_range;
+
 /* Grab lock to make sure things are in a consistent state after fork().  */
 void mmap_fork_start(void)
 {
     if (mmap_lock_count)
         abort();
     pthread_mutex_lock(&mmap_mutex);
+    page_range_lock(&fork_range, 0, -1);
 }
 
 void mmap_fork_end(int child)
 {
-    if (child)
+    if (child) {
+        page_range_fork_child();
+        page_range_unlock(&fork_range);
         pthread_mutex_init(&mmap_mutex, NULL);
-    else
+    } else {
+        page_range_unlock(&fork_range);
         pthread_mutex_unlock(&mmap_mutex);
+    }
 }
 
 /*
@@ -115,6 +141,8 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
 {
     abi_ulong end, host_start, host_end, addr;
     int prot1, ret, page_flags, host_prot;
+    PageRangeLock range;
+    bool locked = false;
 
     trace_target_mprotect(start, len, target_prot);
 
@@ -134,9 +162,23 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
         return 0;
     }
 
-    mmap_lock();
     host_start = start & qemu_host_page_mask;
     host_end = HOST_PAGE_ALIGN(end);
+
+    /*
+     * Locking the host pages is enough, unless pages holding translated
+     * code become writable: the code must then be invalidated, which
+     * needs the mmap_lock.
+     */
+    page_range_lock(&range, host_start, host_end - 1);
+    if ((page_flags & PAGE_WRITE) && !have_mmap_lock() &&
+        page_range_has_code(host_start, host_end)) {
+        page_range_unlock(&range);
+        mmap_lock();
+        locked = true;
+        page_range_lock(&range, host_start, host_end - 1);
+    }
+
     if (start > host_start) {
         /* handle host page containing start */
         prot1 = host_prot;
@@ -178,10 +220,12 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
         }
     }
     page_set_flags(start, start + len, page_flags);
-    mmap_unlock();
-    return 0;
+    ret = 0;
 error:
-    mmap_unlock();
+    page_range_unlock(&range);
+    if (locked) {
+        mmap_unlock();
+    }
     return ret;
 }
 
@@ -426,8 +470,9 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
 {
     abi_ulong ret, end, real_start, real_end, retaddr, host_offset, host_len;
     int page_flags, host_prot;
+    PageRangeLock range;
 
-    mmap_lock();
+    mmap_lock_all(&range);
     trace_target_mmap(start, len, target_prot, flags, fd, offset);
 
     if (!len) {
@@ -638,10 +683,10 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
         }
     }
     tb_invalidate_phys_range(start, start + len);
-    mmap_unlock();
+    mmap_unlock_all(&range);
     return start;
 fail:
-    mmap_unlock();
+    mmap_unlock_all(&range);
     return -1;
 }
 
@@ -690,6 +735,7 @@ int target_munmap(abi_ulong start, abi_ulong len)
 {
     abi_ulong end, real_start, real_end, addr;
     int prot, ret;
+    PageRangeLock range;
 
     trace_target_munmap(start, len);
 
@@ -700,7 +746,7 @@ int target_munmap(abi_ulong start, abi_ulong len)
         return -TARGET_EINVAL;
     }
 
-    mmap_lock();
+    mmap_lock_all(&range);
     end = start + len;
     real_start = start & qemu_host_page_mask;
     real_end = HOST_PAGE_ALIGN(end);
@@ -743,7 +789,7 @@ int target_munmap(abi_ulong start, abi_ulong len)
         page_set_flags(start, start + len, 0);
         tb_invalidate_phys_range(start, start + len);
     }
-    mmap_unlock();
+    mmap_unlock_all(&range);
     return ret;
 }
 
@@ -753,6 +799,7 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
 {
     int prot;
     void *host_addr;
+    PageRangeLock range;
 
     if (!guest_range_valid_untagged(old_addr, old_size) ||
         ((flags & MREMAP_FIXED) &&
@@ -763,7 +810,7 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
         return -1;
     }
 
-    mmap_lock();
+    mmap_lock_all(&range);
 
     if (flags & MREMAP_FIXED) {
         host_addr = mremap(g2h_untagged(old_addr), old_size, new_size,
@@ -832,7 +879,7 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
                        prot | PAGE_VALID | PAGE_RESET);
     }
     tb_invalidate_phys_range(new_addr, new_addr + new_size);
-    mmap_unlock();
+    mmap_unlock_all(&range);
     return new_addr;
 }
 
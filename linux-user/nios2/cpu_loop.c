@@ -112,25 +112,34 @@ void cpu_loop(CPUNios2State *env)
             case 16: /* QEMU specific, for __kuser_cmpxchg */
                 {
                     abi_ptr g = env->regs[4];
+                    abi_ptr page = g & qemu_host_page_mask;
+                    PageRangeLock range;
                     uint32_t *h, n, o;
 
                     if (g & 0x3) {
                         force_sig_fault(TARGET_SIGBUS, TARGET_BUS_ADRALN, g);
                         break;
                     }
+                    /*
+                     * Keep mprotect away between the check and the access;
+                     * mmap_lock comes first as page_unprotect() takes it.
+                     */
+                    mmap_lock();
+                    page_range_lock(&range, page,
+                                    page + qemu_host_page_size - 1);
                     ret = page_get_flags(g);
                     if (!(ret & PAGE_VALID)) {
                         force_sig_fault(TARGET_SIGSEGV, TARGET_SEGV_MAPERR, g);
-                        break;
-                    }
-                    if (!(ret & PAGE_READ) || !(ret & PAGE_WRITE)) {
+                    } else if (!(ret & PAGE_READ) || !(ret & PAGE_WRITE)) {
                         force_sig_fault(TARGET_SIGSEGV, TARGET_SEGV_ACCERR, g);
-                        break;
+                    } else {
+                        h = g2h(cs, g);
+                        o = env->regs[5];
+                        n = env->regs[6];
+                        env->regs[2] = qatomic_cmpxchg(h, o, n) - o;
                     }
-                    h = g2h(cs, g);
-                    o = env->regs[5];
-                    n = env->regs[6];
-                    env->regs[2] = qatomic_cmpxchg(h, o, n) - o;
+                    page_range_unlock(&range);
+                    mmap_unlock();
                 }
                 break;
             }
@@ -4500,6 +4500,7 @@ static inline abi_ulong do_shmat(CPUArchState *cpu_env,
     struct shmid_ds shm_info;
     int i,ret;
     abi_ulong shmlba;
+    PageRangeLock range;
 
     /* shmat pointers are always untagged */
 
@@ -4523,7 +4524,7 @@ static inline abi_ulong do_shmat(CPUArchState *cpu_env,
         return -TARGET_EINVAL;
     }
 
-    mmap_lock();
+    mmap_lock_all(&range);
 
     /*
      * We're mapping shared memory, so ensure we generate code for parallel
@@ -4553,7 +4554,7 @@ static inline abi_ulong do_shmat(CPUArchState *cpu_env,
     }
 
     if (host_raddr == (void *)-1) {
-        mmap_unlock();
+        mmap_unlock_all(&range);
         return get_errno((long)host_raddr);
     }
     raddr=h2g((unsigned long)host_raddr);
@@ -4571,7 +4572,7 @@ static inline abi_ulong do_shmat(CPUArchState *cpu_env,
         }
     }
 
-    mmap_unlock();
+    mmap_unlock_all(&range);
     return raddr;
 
 }
@@ -4580,10 +4581,11 @@ static inline abi_long do_shmdt(abi_ulong shmaddr)
 {
     int i;
     abi_long rv;
+    PageRangeLock range;
 
     /* shmdt pointers are always untagged */
 
-    mmap_lock();
+    mmap_lock_all(&range);
 
     for (i = 0; i < N_SHM_REGIONS; ++i) {
         if (shm_regions[i].in_use && shm_regions[i].start == shmaddr) {
@@ -4594,7 +4596,7 @@ static inline abi_long do_shmdt(abi_ulong shmaddr)
     }
     rv = get_errno(shmdt(g2h_untagged(shmaddr)));
 
-    mmap_unlock();
+    mmap_unlock_all(&range);
 
     return rv;
 }
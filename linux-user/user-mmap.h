@@ -29,6 +29,8 @@ abi_long target_madvise(abi_ulong start, abi_ulong len_in, int advice);
 extern unsigned long last_brk;
 extern abi_ulong mmap_next_start;
 abi_ulong mmap_find_vma(abi_ulong, abi_ulong, abi_ulong);
+void mmap_lock_all(PageRangeLock *range);
+void mmap_unlock_all(PageRangeLock *range);
 void mmap_fork_start(void);
 void mmap_fork_end(int child);
 
@@ -20,6 +20,7 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "hw/core/cpu.h"
 #include "exec/cpu-common.h"
 
@@ -27,6 +28,7 @@
 #include "exec/helper-proto.h"
 #include "tcg/tcg.h"
 #include "tcg/tcg-op.h"
+#include "exec/gdbstub.h"
 #include "plugin.h"
 #include "qemu/compiler.h"
 
@@ -210,6 +212,43 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+/*
+ * Runs as safe work on the new vCPU, before it executes any guest code and
+ * while no other vCPU is running, so that no TB is using the old arrays.
+ */
+static void plugin_grow_scoreboards__async(CPUState *cpu, run_on_cpu_data data)
+{
+    struct qemu_plugin_scoreboard *score;
+    size_t size;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    size = plugin.scoreboard_alloc_size;
+    while (cpu->cpu_index >= size) {
+        size *= 2;
+    }
+    if (size > plugin.scoreboard_alloc_size) {
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            g_array_set_size(score->data, size);
+        }
+        plugin.scoreboard_alloc_size = size;
+        /* translated code embeds the address of the old arrays */
+        if (!QLIST_EMPTY(&plugin.scoreboards)) {
+            tb_flush(cpu);
+        }
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
+
+static void plugin_mem_trace_alloc__locked(gpointer k, gpointer v,
+                                           gpointer udata)
+{
+    CPUState *cpu = container_of(k, CPUState, cpu_index);
+
+    if (cpu->plugin_mem_trace == NULL) {
+        cpu->plugin_mem_trace = g_new0(struct qemu_plugin_mem_trace, 1);
+    }
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
@@ -219,6 +258,13 @@ void qemu_plugin_vcpu_init_hook(CPUState *cpu)
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
                                   &cpu->cpu_index);
     g_assert(success);
+    if (cpu->cpu_index >= plugin.scoreboard_alloc_size) {
+        async_safe_run_on_cpu(cpu, plugin_grow_scoreboards__async,
+                              RUN_ON_CPU_NULL);
+    }
+    if (plugin.mem_trace) {
+        plugin_mem_trace_alloc__locked(&cpu->cpu_index, NULL, NULL);
+    }
     qemu_rec_mutex_unlock(&plugin.lock);
 
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_INIT);
@@ -228,11 +274,14 @@ void qemu_plugin_vcpu_exit_hook(CPUState *cpu)
 {
     bool success;
 
+    qemu_plugin_vcpu_mem_trace_flush(cpu);
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_EXIT);
 
     qemu_rec_mutex_lock(&plugin.lock);
     success = g_hash_table_remove(plugin.cpu_ht, &cpu->cpu_index);
     g_assert(success);
+    g_free(cpu->plugin_mem_trace);
+    cpu->plugin_mem_trace = NULL;
     qemu_rec_mutex_unlock(&plugin.lock);
 }
 
@@ -290,10 +339,131 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->userp = ptr;
     dyn_cb->type = PLUGIN_CB_INLINE;
     dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry.score = NULL;
+    dyn_cb->inline_insn.entry.offset = 0;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
 }
 
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = NULL;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry = entry;
+    dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.imm = imm;
+}
+
+static struct qemu_plugin_reg_sync plugin_reg_sync_all = { .all = true };
+
+/*
+ * Does TCG global @ts back the register called @name? Some targets give
+ * globals several '/'-separated names, and 32-bit hosts split 64-bit
+ * globals into "name_0" and "name_1".
+ */
+static bool plugin_global_matches(const TCGTemp *ts, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = ts->name;
+
+    for (;;) {
+        size_t plen = strcspn(p, "/");
+
+        if (plen == len && strncmp(p, name, len) == 0) {
+            return true;
+        }
+        if (ts->base_type != ts->type && plen == len + 2 &&
+            strncmp(p, name, len) == 0 && p[len] == '_') {
+            return true;
+        }
+        if (!p[plen]) {
+            return false;
+        }
+        p += plen + 1;
+    }
+}
+
+/* Append the globals backing gdb register @gdb_reg, false if there are none */
+static bool plugin_reg_sync_add(GArray *globals, GArray *descs, int gdb_reg)
+{
+    const char *name = NULL;
+    bool found = false;
+    size_t i;
+
+    for (i = 0; i < descs->len; i++) {
+        GDBRegDesc *desc = &g_array_index(descs, GDBRegDesc, i);
+
+        if (desc->gdb_reg == gdb_reg) {
+            name = desc->name;
+            break;
+        }
+    }
+    if (!name) {
+        return false;
+    }
+    for (i = 0; i < tcg_ctx->nb_globals; i++) {
+        TCGTemp *ts = &tcg_ctx->temps[i];
+
+        if (ts->kind == TEMP_GLOBAL && plugin_global_matches(ts, name)) {
+            g_array_append_val(globals, i);
+            found = true;
+        }
+    }
+    return found;
+}
+
+/*
+ * Map @regs to the TCG globals of the translating vCPU. The result only
+ * depends on the CPU type and the registers, so it is interned.
+ */
+static const struct qemu_plugin_reg_sync *
+plugin_reg_sync_get(struct qemu_plugin_register **regs, size_t n_regs)
+{
+    CPUState *cpu = current_cpu;
+    g_autoptr(GString) key = g_string_new(object_get_typename(OBJECT(cpu)));
+    g_autoptr(GArray) descs = NULL;
+    g_autoptr(GArray) globals = NULL;
+    struct qemu_plugin_reg_sync *sync;
+    size_t i;
+
+    for (i = 0; i < n_regs; i++) {
+        g_string_append_printf(key, ",%d", GPOINTER_TO_INT(regs[i]));
+    }
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    sync = g_hash_table_lookup(plugin.reg_syncs, key->str);
+    if (sync) {
+        return sync;
+    }
+
+    descs = gdb_get_register_list(cpu);
+    globals = g_array_new(false, false, sizeof(size_t));
+    for (i = 0; i < n_regs; i++) {
+        if (!plugin_reg_sync_add(globals, descs,
+                                 GPOINTER_TO_INT(regs[i]) - 1)) {
+            sync = &plugin_reg_sync_all;
+            break;
+        }
+    }
+    if (!sync) {
+        sync = g_malloc(sizeof(*sync) + globals->len * sizeof(size_t));
+        sync->all = false;
+        sync->n = globals->len;
+        memcpy(sync->globals, globals->data, globals->len * sizeof(size_t));
+    }
+    g_hash_table_insert(plugin.reg_syncs, g_string_free(g_steal_pointer(&key),
+                                                        false), sync);
+    return sync;
+}
+
 void plugin_register_dyn_cb__udata(GArray **arr,
                                    qemu_plugin_vcpu_udata_cb_t cb,
                                    enum qemu_plugin_cb_flags flags,
@@ -302,11 +472,66 @@ void plugin_register_dyn_cb__udata(GArray **arr,
     struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
 
     dyn_cb->userp = udata;
-    /* Note flags are discarded as unused. */
+    /* registers cannot be written yet, so RW is the same as R */
+    dyn_cb->regs = flags != QEMU_PLUGIN_CB_NO_REGS ? &plugin_reg_sync_all
+                                                   : NULL;
     dyn_cb->f.vcpu_udata = cb;
     dyn_cb->type = PLUGIN_CB_REGULAR;
 }
 
+void plugin_register_dyn_cb__udata_regs(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        struct qemu_plugin_register **regs,
+                                        size_t n_regs, void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
+    dyn_cb->userp = udata;
+    dyn_cb->regs = n_regs ? plugin_reg_sync_get(regs, n_regs) : NULL;
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_REGULAR;
+}
+
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        enum qemu_plugin_cond cond,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm,
+                                        void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
+    dyn_cb->userp = udata;
+    /* Note flags are discarded as unused. */
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_COND;
+    dyn_cb->cond.entry = entry;
+    dyn_cb->cond.cond = cond;
+    dyn_cb->cond.imm = imm;
+}
+
+void plugin_register_vcpu_mem_trace(GArray **arr, uint64_t pc,
+                                    enum qemu_plugin_mem_rw rw)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    /* pairs with the release in qemu_plugin_register_vcpu_mem_batch_cb */
+    if (!qatomic_load_acquire(&plugin.mem_trace)) {
+        return;
+    }
+    /* the buffer is shared, so record each access once for all plugins */
+    if (*arr && (*arr)->len) {
+        dyn_cb = &g_array_index(*arr, struct qemu_plugin_dyn_cb, 0);
+        dyn_cb->rw |= rw;
+        return;
+    }
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->type = PLUGIN_CB_TRACE;
+    dyn_cb->rw = rw;
+    dyn_cb->trace.pc = pc;
+}
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
@@ -412,6 +637,161 @@ void qemu_plugin_register_vcpu_resume_cb(qemu_plugin_id_t id,
     plugin_register_cb(id, QEMU_PLUGIN_EV_VCPU_RESUME, cb);
 }
 
+/*
+ * Sampling. A single thread periodically asks every running vCPU to stop
+ * at its next TB boundary, reusing the exit check that all TBs perform
+ * anyway; cpu_exec then calls qemu_plugin_vcpu_sample_cb().
+ */
+static void plugin_sample_kick__locked(gpointer k, gpointer v, gpointer udata)
+{
+    CPUState *cpu = container_of(k, CPUState, cpu_index);
+
+    if (qatomic_read(&cpu->running)) {
+        qatomic_set(&cpu->plugin_sample_pending, true);
+        /* pairs with the barrier in cpu_handle_interrupt */
+        smp_wmb();
+        qatomic_set(&cpu->icount_decr_ptr->u16.high, -1);
+    }
+}
+
+static void *plugin_sampler_thread(void *arg)
+{
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_SAMPLE;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    while (!QLIST_EMPTY(&plugin.cb_lists[ev])) {
+        uint64_t period = plugin.sample_period_ns;
+
+        qemu_rec_mutex_unlock(&plugin.lock);
+        g_usleep(MAX(period / SCALE_US, 1));
+        qemu_rec_mutex_lock(&plugin.lock);
+
+        g_hash_table_foreach(plugin.cpu_ht, plugin_sample_kick__locked, NULL);
+    }
+    /* the last sampling callback is gone */
+    plugin.sample_period_ns = 0;
+    plugin.sampler_running = false;
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return NULL;
+}
+
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         qemu_plugin_vcpu_sample_cb_t cb,
+                                         uint64_t period_ns,
+                                         void *udata)
+{
+    QemuThread thread;
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    plugin_register_cb_udata(id, QEMU_PLUGIN_EV_VCPU_SAMPLE, cb, udata);
+    if (!cb) {
+        return;
+    }
+
+    period_ns = MAX(period_ns, 1);
+    if (!plugin.sample_period_ns || period_ns < plugin.sample_period_ns) {
+        plugin.sample_period_ns = period_ns;
+    }
+    if (!plugin.sampler_running) {
+        plugin.sampler_running = true;
+        qemu_thread_create(&thread, "plugin-sampler", plugin_sampler_thread,
+                           NULL, QEMU_THREAD_DETACHED);
+    }
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void qemu_plugin_vcpu_sample_cb(CPUState *cpu, uint64_t pc)
+{
+    struct qemu_plugin_cb *cb, *next;
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_SAMPLE;
+
+    QLIST_FOREACH_SAFE_RCU(cb, &plugin.cb_lists[ev], entry, next) {
+        qemu_plugin_vcpu_sample_cb_t func = cb->f.vcpu_sample;
+
+        func(cb->ctx->id, cpu->cpu_index, pc, cb->udata);
+    }
+}
+
+/*
+ * Memory trace. Buffers are only allocated once a batch callback has
+ * been registered, and they stay around for good: translated code loads
+ * the buffer from CPUState and appends to it unconditionally.
+ */
+void qemu_plugin_register_vcpu_mem_batch_cb(qemu_plugin_id_t id,
+                                            qemu_plugin_vcpu_mem_batch_cb_t cb,
+                                            enum qemu_plugin_mem_trace_flags flags,
+                                            void *udata)
+{
+    QEMU_LOCK_GUARD(&plugin.lock);
+    if (cb) {
+        g_hash_table_foreach(plugin.cpu_ht, plugin_mem_trace_alloc__locked,
+                             NULL);
+        qatomic_store_release(&plugin.mem_trace, true);
+        if (flags == QEMU_PLUGIN_MEM_TRACE_HWADDR) {
+            qatomic_set(&plugin.mem_trace_hwaddr, true);
+        }
+    }
+    plugin_register_cb_udata(id, QEMU_PLUGIN_EV_VCPU_MEM_BATCH, cb, udata);
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void qemu_plugin_vcpu_mem_trace_flush(CPUState *cpu)
+{
+    struct qemu_plugin_mem_trace *trace = cpu->plugin_mem_trace;
+    struct qemu_plugin_cb *cb, *next;
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_MEM_BATCH;
+
+    if (trace == NULL || trace->len == 0) {
+        return;
+    }
+    QLIST_FOREACH_SAFE_RCU(cb, &plugin.cb_lists[ev], entry, next) {
+        qemu_plugin_vcpu_mem_batch_cb_t func = cb->f.vcpu_mem_batch;
+
+        func(cb->ctx->id, cpu->cpu_index, trace->records, trace->len,
+             cb->udata);
+    }
+    trace->len = 0;
+}
+
+/*
+ * Called before entries of @cpu's TLB are replaced or flushed, so that
+ * batch callbacks can still look up the hwaddr of every record.
+ */
+void qemu_plugin_vcpu_tlb_change(CPUState *cpu)
+{
+    if (unlikely(qatomic_read(&plugin.mem_trace_hwaddr))) {
+        qemu_plugin_vcpu_mem_trace_flush(cpu);
+    }
+}
+
+/* accesses from helpers; translated code appends its records inline */
+static void plugin_mem_trace_append(CPUState *cpu, uint64_t pc,
+                                    uint64_t vaddr, qemu_plugin_meminfo_t info)
+{
+    struct qemu_plugin_mem_trace *trace = cpu->plugin_mem_trace;
+    struct qemu_plugin_mem_record *rec;
+
+    /* leave room for the accesses the rest of the TB appends */
+    if (trace->len >= QEMU_PLUGIN_MEM_TRACE_THRESHOLD) {
+        qemu_plugin_vcpu_mem_trace_flush(cpu);
+    }
+    rec = &trace->records[trace->len++];
+    rec->vaddr = vaddr;
+    rec->pc = pc;
+    rec->info = info;
+}
+
 void qemu_plugin_register_flush_cb(qemu_plugin_id_t id,
                                    qemu_plugin_simple_cb_t cb)
 {
@@ -432,10 +812,16 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index)
 {
+    qemu_plugin_u64 entry = cb->inline_insn.entry;
     uint64_t *val = cb->userp;
 
+    if (entry.score) {
+        val = qemu_plugin_scoreboard_find(entry.score, cpu_index) +
+              entry.offset;
+    }
+
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
         *val += cb->inline_insn.imm;
@@ -459,7 +845,7 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
             &g_array_index(arr, struct qemu_plugin_dyn_cb, i);
 
         if (!(rw & cb->rw)) {
-                break;
+            continue;
         }
         switch (cb->type) {
         case PLUGIN_CB_REGULAR:
@@ -467,7 +853,11 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
+            break;
+        case PLUGIN_CB_TRACE:
+            plugin_mem_trace_append(cpu, cb->trace.pc, vaddr,
+                                    make_plugin_meminfo(oi, rw));
             break;
         default:
             g_assert_not_reached();
@@ -487,6 +877,31 @@ void qemu_plugin_register_atexit_cb(qemu_plugin_id_t id,
     plugin_register_cb_udata(id, QEMU_PLUGIN_EV_ATEXIT, cb, udata);
 }
 
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score =
+        g_malloc0(sizeof(struct qemu_plugin_scoreboard));
+
+    score->data = g_array_new(false, true, element_size);
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    g_array_set_size(score->data, plugin.scoreboard_alloc_size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    g_array_free(score->data, true);
+    g_free(score);
+}
+
 /*
  * Handle exit from linux-user. Unlike the normal atexit() mechanism
  * we need to handle the clean-up manually as it's possible threads
@@ -504,6 +919,11 @@ void qemu_plugin_user_exit(void)
 
     start_exclusive();
 
+    /* hand over what the threads traced before their batch callbacks go */
+    CPU_FOREACH(cpu) {
+        qemu_plugin_vcpu_mem_trace_flush(cpu);
+    }
+
     /* un-register all callbacks except the final AT_EXIT one */
     for (ev = 0; ev < QEMU_PLUGIN_EV_MAX; ev++) {
         if (ev != QEMU_PLUGIN_EV_ATEXIT) {
@@ -551,8 +971,11 @@ static void __attribute__((__constructor__)) plugin_init(void)
     qemu_rec_mutex_init(&plugin.lock);
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
+    plugin.reg_syncs = g_hash_table_new(g_str_hash, g_str_equal);
     QTAILQ_INIT(&plugin.ctxs);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
+    QLIST_INIT(&plugin.scoreboards);
+    plugin.scoreboard_alloc_size = 16; /* avoid frequent reallocation */
     atexit(qemu_plugin_atexit_cb);
 }
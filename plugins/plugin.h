@@ -44,6 +44,18 @@ struct qemu_plugin_state {
      * the code cache is flushed.
      */
     struct qht dyn_cb_arr_ht;
+    /* scoreboards, resized together to hold @scoreboard_alloc_size vCPUs */
+    QLIST_HEAD(, qemu_plugin_scoreboard) scoreboards;
+    size_t scoreboard_alloc_size;
+    /* shortest period requested by QEMU_PLUGIN_EV_VCPU_SAMPLE callbacks */
+    uint64_t sample_period_ns;
+    bool sampler_running;
+    /* set for good once a QEMU_PLUGIN_EV_VCPU_MEM_BATCH cb is registered */
+    bool mem_trace;
+    /* ... and once one of them asks for QEMU_PLUGIN_MEM_TRACE_HWADDR */
+    bool mem_trace_hwaddr;
+    /* interned struct qemu_plugin_reg_sync, keyed by their register list */
+    GHashTable *reg_syncs;
 };
 
 
@@ -69,6 +81,12 @@ void plugin_register_inline_op(GArray **arr,
                                enum qemu_plugin_op op, void *ptr,
                                uint64_t imm);
 
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm);
+
 void plugin_reset_uninstall(qemu_plugin_id_t id,
                             qemu_plugin_simple_cb_t cb,
                             bool reset);
@@ -88,6 +106,20 @@ plugin_register_dyn_cb__udata(GArray **arr,
                               qemu_plugin_vcpu_udata_cb_t cb,
                               enum qemu_plugin_cb_flags flags, void *udata);
 
+void
+plugin_register_dyn_cb__udata_regs(GArray **arr,
+                                   qemu_plugin_vcpu_udata_cb_t cb,
+                                   struct qemu_plugin_register **regs,
+                                   size_t n_regs, void *udata);
+
+void
+plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                   qemu_plugin_vcpu_udata_cb_t cb,
+                                   enum qemu_plugin_cb_flags flags,
+                                   enum qemu_plugin_cond cond,
+                                   qemu_plugin_u64 entry,
+                                   uint64_t imm,
+                                   void *udata);
 
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
@@ -95,6 +127,13 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb);
+void plugin_register_vcpu_mem_trace(GArray **arr, uint64_t pc,
+                                    enum qemu_plugin_mem_rw rw);
+
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index);
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
 
 #endif /* PLUGIN_H */
@@ -182,8 +182,14 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
+    "                atomic-step=exclusive|locked (TCG serial atomics, default=exclusive)\n"
+    "                code-hugepages=auto|off|transparent|explicit (huge pages for TCG code)\n"
+    "                code-numa=on|off (place TCG code on the vCPU's NUMA node)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-prefetch=file (translate TBs of earlier runs ahead of use)\n"
+    "                tlb-ways=1|2 (associativity of the TCG softmmu TLB)\n"
+    "                tlb-victim-size=n (TCG softmmu victim TLB entries)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -209,6 +215,38 @@ SRST
     ``kvm-shadow-mem=size``
         Defines the size of the KVM shadow MMU.
 
+    ``atomic-step=exclusive|locked``
+        Selects how TCG runs guest instructions that cannot be translated
+        atomically for a multi-threaded context, such as 128-bit
+        compare-and-swap on hosts without a 128-bit atomic. The default,
+        ``exclusive``, stops every other vCPU while the instruction runs.
+        ``locked`` only serializes such instructions against each other,
+        which scales much better with many vCPUs. It breaks atomicity
+        with respect to everything else other vCPUs do to the same
+        memory: not just ordinary accesses, but also their atomic
+        instructions that TCG does translate for a multi-threaded
+        context, such as a 64-bit compare-and-swap on half of a location
+        that is also updated with a 128-bit one. Only use it when the
+        guest never mixes the two kinds of atomic on the same data.
+        ``info jit`` reports how often each is used.
+
+    ``code-hugepages=auto|off|transparent|explicit``
+        Controls the backing of the TCG code generation buffer with huge
+        pages, which reduces iTLB misses for large translated footprints.
+        The default, ``auto``, only hints the host to use transparent huge
+        pages and keeps a guard page after each buffer region, which splits
+        the huge pages. ``transparent`` aligns the buffer regions to the
+        transparent huge page size and drops the guard pages.
+        ``explicit`` allocates the buffer from the host's reserved hugetlbfs
+        pages, and fails if there are not enough of them; it has no guard
+        pages either. ``off`` asks the host not to use huge pages.
+
+    ``code-numa=on|off``
+        Moves the part of the TCG code generation buffer used by each vCPU
+        thread to the host NUMA node that the thread is running on, when it
+        starts translating into it. This is most useful with
+        ``thread=multi`` and vCPU threads pinned to host nodes (default=off).
+
     ``split-wx=on|off``
         Controls the use of split w^x mapping for the TCG code generation
         buffer. Some operating systems require this to be enabled, and in
@@ -218,6 +256,32 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-prefetch=file``
+        Records in ``file`` at exit which guest blocks TCG translated.
+        The next run translates the recorded blocks of a page when the
+        page is first used. Only the addresses, flags and checksums of
+        the blocks are kept, not translated code, so every block is
+        still translated in every run. Prefetching only saves the
+        lookup miss that each block of a page already visited would
+        otherwise take. A block is skipped if the current guest memory
+        no longer matches it, so the file may be shared between runs of
+        different guest images. Prefetching stops while the code buffer
+        is nearly full.
+
+    ``tlb-ways=1|2``
+        Sets the associativity of the softmmu TLB looked up by the code
+        generated by TCG. With 2 ways, a page whose TLB entry was recently
+        displaced by another page of the same set is still found without
+        leaving the generated code, which helps guests with scattered
+        memory accesses. Only the x86 TCG backend probes the second way
+        inline; on other hosts it is checked before the victim TLB
+        (default=1).
+
+    ``tlb-victim-size=n``
+        Sets the number of entries, between 1 and 256, of the fully
+        associative victim TLB that keeps recently evicted TLB entries
+        for each MMU mode of a vCPU (default=8).
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -5658,6 +5658,27 @@ void sve_cont_ldst_mte_check(SVEContLdSt *info, CPUARMState *env,
 /*
  * Common helper for all contiguous 1,2,3,4-register predicated stores.
  */
+/*
+ * Return true if every element of size 1 << @esz within the first
+ * @reg_max bytes of the vector is active in the predicate @vg.
+ */
+static bool sve_pred_all_active(uint64_t *vg, intptr_t reg_max, int esz)
+{
+    uint64_t mask = pred_esz_masks[esz];
+    intptr_t i;
+
+    for (i = 0; i < reg_max / 64; ++i) {
+        if ((vg[i] & mask) != mask) {
+            return false;
+        }
+    }
+    if (reg_max & 63) {
+        mask &= MAKE_64BIT_MASK(0, reg_max & 63);
+        return (vg[i] & mask) == mask;
+    }
+    return true;
+}
+
 static inline QEMU_ALWAYS_INLINE
 void sve_ldN_r(CPUARMState *env, uint64_t *vg, const target_ulong addr,
                uint32_t desc, const uintptr_t retaddr,
@@ -5743,6 +5764,24 @@ void sve_ldN_r(CPUARMState *env, uint64_t *vg, const target_ulong addr,
 
     /* The entire operation is in RAM, on valid pages. */
 
+    if (likely(info.page_split < 0 &&
+               sve_pred_all_active(vg, reg_max, esz))) {
+        /*
+         * All elements are active and within one page, as for the body
+         * of a vectorized loop.  Without the predicate tests the loop
+         * over host_fn is a straight copy that the compiler can widen.
+         */
+        host = info.page[0].host;
+        for (reg_off = mem_off = 0; reg_off < reg_max;
+             reg_off += 1 << esz, mem_off += N << msz) {
+            for (i = 0; i < N; ++i) {
+                host_fn(&env->vfp.zregs[(rd + i) & 31], reg_off,
+                        host + mem_off + (i << msz));
+            }
+        }
+        return;
+    }
+
     for (i = 0; i < N; ++i) {
         memset(&env->vfp.zregs[(rd + i) & 31], 0, reg_max);
     }
@@ -6357,6 +6396,20 @@ void sve_stN_r(CPUARMState *env, uint64_t *vg, target_ulong addr,
 #endif
     }
 
+    if (likely(info.page_split < 0 &&
+               sve_pred_all_active(vg, reg_max, esz))) {
+        /* As for sve_ldN_r, store a fully active vector without tests. */
+        host = info.page[0].host;
+        for (reg_off = mem_off = 0; reg_off < reg_max;
+             reg_off += 1 << esz, mem_off += N << msz) {
+            for (i = 0; i < N; ++i) {
+                host_fn(&env->vfp.zregs[(rd + i) & 31], reg_off,
+                        host + mem_off + (i << msz));
+            }
+        }
+        return;
+    }
+
     mem_off = info.mem_off_first[0];
     reg_off = info.reg_off_first[0];
     reg_last = info.reg_off_last[0];
@@ -6536,6 +6589,38 @@ static target_ulong off_zd_d(void *reg, intptr_t reg_ofs)
     return *(uint64_t *)(reg + reg_ofs);
 }
 
+/*
+ * The elements of a gather or scatter usually fall within a few pages.
+ * Remember the last page of plain RAM that was probed, so that further
+ * elements within it need no TLB lookup.
+ */
+typedef struct SVEGatherPage {
+    target_ulong addr;          /* page address, or -1 if none */
+    SVEHostPage info;           /* with info.host relative to @addr */
+} SVEGatherPage;
+
+static inline QEMU_ALWAYS_INLINE
+void sve_probe_page_gather(SVEHostPage *info, SVEGatherPage *last,
+                           CPUARMState *env, target_ulong addr,
+                           MMUAccessType access_type, int mmu_idx,
+                           uintptr_t retaddr)
+{
+    target_ulong page = addr & TARGET_PAGE_MASK;
+
+    if (page == last->addr) {
+        *info = last->info;
+        info->host += addr - page;
+        return;
+    }
+
+    sve_probe_page(info, false, env, addr, 0, access_type, mmu_idx, retaddr);
+    if (info->flags == 0) {
+        last->addr = page;
+        last->info = *info;
+        last->info.host -= addr - page;
+    }
+}
+
 static inline QEMU_ALWAYS_INLINE
 void sve_ld1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
                target_ulong base, uint32_t desc, uintptr_t retaddr,
@@ -6550,6 +6635,7 @@ void sve_ld1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
     ARMVectorReg scratch;
     intptr_t reg_off;
     SVEHostPage info, info2;
+    SVEGatherPage last = { .addr = -1 };
 
     memset(&scratch, 0, reg_max);
     reg_off = 0;
@@ -6560,8 +6646,8 @@ void sve_ld1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
                 target_ulong addr = base + (off_fn(vm, reg_off) << scale);
                 target_ulong in_page = -(addr | TARGET_PAGE_MASK);
 
-                sve_probe_page(&info, false, env, addr, 0, MMU_DATA_LOAD,
-                               mmu_idx, retaddr);
+                sve_probe_page_gather(&info, &last, env, addr, MMU_DATA_LOAD,
+                                      mmu_idx, retaddr);
 
                 if (likely(in_page >= msize)) {
                     if (unlikely(info.flags & TLB_WATCHPOINT)) {
@@ -6937,6 +7023,7 @@ void sve_st1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
     void *host[ARM_MAX_VQ * 4];
     intptr_t reg_off, i;
     SVEHostPage info, info2;
+    SVEGatherPage last = { .addr = -1 };
 
     /*
      * Probe all of the elements for host addresses and flags.
@@ -6951,8 +7038,8 @@ void sve_st1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
             host[i] = NULL;
             if (likely((pg >> (reg_off & 63)) & 1)) {
                 if (likely(in_page >= msize)) {
-                    sve_probe_page(&info, false, env, addr, 0, MMU_DATA_STORE,
-                                   mmu_idx, retaddr);
+                    sve_probe_page_gather(&info, &last, env, addr,
+                                          MMU_DATA_STORE, mmu_idx, retaddr);
                     if (!(info.flags & TLB_MMIO)) {
                         host[i] = info.host;
                     }
@@ -214,6 +214,7 @@ bool arm_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
     int prot, ret;
     MemTxAttrs attrs = {};
     ARMCacheAttrs cacheattrs = {};
+    ARMMMUIdx arm_mmu_idx = core_to_arm_mmu_idx(&cpu->env, mmu_idx);
 
     /*
      * Walk the page table and (if the mapping exists) add the page
@@ -221,8 +222,7 @@ bool arm_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
      * return false.  Otherwise populate fsr with ARM DFSR/IFSR fault
      * register format, and signal the fault.
      */
-    ret = get_phys_addr(&cpu->env, address, access_type,
-                        core_to_arm_mmu_idx(&cpu->env, mmu_idx),
+    ret = get_phys_addr(&cpu->env, address, access_type, arm_mmu_idx,
                         &phys_addr, &attrs, &prot, &page_size,
                         &fi, &cacheattrs);
     if (likely(!ret)) {
@@ -235,6 +235,16 @@ bool arm_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
             phys_addr &= TARGET_PAGE_MASK;
             address &= TARGET_PAGE_MASK;
         }
+        /*
+         * With a single stage of translation, a block maps linearly.
+         * After a stage 2, page_size is the stage 2 size, which may be
+         * larger than the stage 1 mapping.
+         */
+        if (page_size > TARGET_PAGE_SIZE &&
+            (arm_mmu_idx == stage_1_mmu_idx(arm_mmu_idx) ||
+             !arm_feature(&cpu->env, ARM_FEATURE_EL2))) {
+            prot |= PAGE_LINEAR;
+        }
         /* Notice and record tagged memory. */
         if (cpu_isar_feature(aa64_mte, cpu) && cacheattrs.attrs == 0xf0) {
             arm_tlb_mte_tagged(&attrs) = true;
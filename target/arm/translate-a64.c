@@ -309,9 +309,26 @@ typedef struct DisasCompare64 {
     TCGv_i64 value;
 } DisasCompare64;
 
-static void a64_test_cc(DisasCompare64 *c64, int cc)
+static void a64_test_cc(DisasContext *s, DisasCompare64 *c64, int cc)
 {
     DisasCompare c32;
+    TCGCond cond = arm_cmp_cond(s, cc);
+
+    if (cond != TCG_COND_NEVER) {
+        /* The previous insn was a compare: test its operands directly.  */
+        c64->cond = TCG_COND_NE;
+        c64->value = tcg_temp_new_i64();
+        if (s->cc_cmp_64) {
+            tcg_gen_setcond_i64(cond, c64->value,
+                                s->cc_cmp_a64, s->cc_cmp_b64);
+        } else {
+            TCGv_i32 t = tcg_temp_new_i32();
+            tcg_gen_setcond_i32(cond, t, s->cc_cmp_a, s->cc_cmp_b);
+            tcg_gen_extu_i32_i64(c64->value, t);
+            tcg_temp_free_i32(t);
+        }
+        return;
+    }
 
     arm_test_cc(&c32, cc);
 
@@ -329,6 +346,37 @@ static void a64_free_cc(DisasCompare64 *c64)
     tcg_temp_free_i64(c64->value);
 }
 
+/* As arm_gen_test_cc, but using the operands of a preceding compare.  */
+static void a64_gen_test_cc(DisasContext *s, int cc, TCGLabel *label)
+{
+    TCGCond cond = arm_cmp_cond(s, cc);
+
+    if (cond == TCG_COND_NEVER) {
+        arm_gen_test_cc(cc, label);
+    } else if (s->cc_cmp_64) {
+        tcg_gen_brcond_i64(cond, s->cc_cmp_a64, s->cc_cmp_b64, label);
+    } else {
+        tcg_gen_brcond_i32(cond, s->cc_cmp_a, s->cc_cmp_b, label);
+    }
+}
+
+/*
+ * Note that the flags are about to be set by a SUBS/CMP of @a and @b,
+ * for the benefit of a condition tested by the next insn.
+ */
+static void a64_record_cmp(DisasContext *s, int sf, TCGv_i64 a, TCGv_i64 b)
+{
+    if (sf) {
+        tcg_gen_mov_i64(s->cc_cmp_a64, a);
+        tcg_gen_mov_i64(s->cc_cmp_b64, b);
+    } else {
+        tcg_gen_extrl_i64_i32(s->cc_cmp_a, a);
+        tcg_gen_extrl_i64_i32(s->cc_cmp_b, b);
+    }
+    s->cc_cmp_64 = sf;
+    s->cc_cmp_insn = s->base.num_insns;
+}
+
 static void gen_rebuild_hflags(DisasContext *s)
 {
     gen_helper_rebuild_hflags_a64(cpu_env, tcg_constant_i32(s->current_el));
@@ -1367,6 +1415,7 @@ static void disas_uncond_b_imm(DisasContext *s, uint32_t insn)
     if (insn & (1U << 31)) {
         /* BL Branch with link */
         tcg_gen_movi_i64(cpu_reg(s, 30), s->base.pc_next);
+        tcg_gen_ret_push(s->base.tb, s->base.pc_next);
     }
 
     /* B Branch / BL Branch with link */
@@ -1457,7 +1506,7 @@ static void disas_cond_b_imm(DisasContext *s, uint32_t insn)
     if (cond < 0x0e) {
         /* genuinely conditional branches */
         TCGLabel *label_match = gen_new_label();
-        arm_gen_test_cc(cond, label_match);
+        a64_gen_test_cc(s, cond, label_match);
         gen_goto_tb(s, 0, s->base.pc_next);
         gen_set_label(label_match);
         gen_goto_tb(s, 1, addr);
@@ -2436,7 +2485,20 @@ static void disas_uncond_b_reg(DisasContext *s, uint32_t insn)
         break;
     }
 
-    s->base.is_jmp = DISAS_JUMP;
+    if (opc == 1 || opc == 9) {
+        /* BLR, BLRAA, BLRAB */
+        tcg_gen_ret_push(s->base.tb, s->base.pc_next);
+    }
+    /*
+     * The return prediction requires the flags after the insn to be those
+     * of this TB, which does not hold if the TB started with BTYPE != 0.
+     */
+    if (opc == 2 &&
+        EX_TBFLAG_A64(arm_tbflags_from_tb(s->base.tb), BTYPE) == 0) {
+        s->base.is_jmp = DISAS_RET;
+    } else {
+        s->base.is_jmp = DISAS_JUMP;
+    }
 }
 
 /* Branches, exception generating and system instructions */
@@ -4323,6 +4385,7 @@ static void disas_add_sub_imm(DisasContext *s, uint32_t insn)
     } else {
         TCGv_i64 tcg_imm = tcg_constant_i64(imm);
         if (sub_op) {
+            a64_record_cmp(s, is_64bit, tcg_rn, tcg_imm);
             gen_sub_CC(is_64bit, tcg_result, tcg_rn, tcg_imm);
         } else {
             gen_add_CC(is_64bit, tcg_result, tcg_rn, tcg_imm);
@@ -4974,6 +5037,7 @@ static void disas_add_sub_ext_reg(DisasContext *s, uint32_t insn)
         }
     } else {
         if (sub_op) {
+            a64_record_cmp(s, sf, tcg_rn, tcg_rm);
             gen_sub_CC(sf, tcg_result, tcg_rn, tcg_rm);
         } else {
             gen_add_CC(sf, tcg_result, tcg_rn, tcg_rm);
@@ -5038,6 +5102,7 @@ static void disas_add_sub_reg(DisasContext *s, uint32_t insn)
         }
     } else {
         if (sub_op) {
+            a64_record_cmp(s, sf, tcg_rn, tcg_rm);
             gen_sub_CC(sf, tcg_result, tcg_rn, tcg_rm);
         } else {
             gen_add_CC(sf, tcg_result, tcg_rn, tcg_rm);
@@ -5397,7 +5462,7 @@ static void disas_cond_select(DisasContext *s, uint32_t insn)
 
     tcg_rd = cpu_reg(s, rd);
 
-    a64_test_cc(&c, cond);
+    a64_test_cc(s, &c, cond);
     zero = tcg_constant_i64(0);
 
     if (rn == 31 && rm == 31 && (else_inc ^ else_inv)) {
@@ -6169,7 +6234,7 @@ static void disas_fp_ccomp(DisasContext *s, uint32_t insn)
     if (cond < 0x0e) { /* not always */
         TCGLabel *label_match = gen_new_label();
         label_continue = gen_new_label();
-        arm_gen_test_cc(cond, label_match);
+        a64_gen_test_cc(s, cond, label_match);
         /* nomatch: */
         gen_set_nzcv(tcg_constant_i64(nzcv << 28));
         tcg_gen_br(label_continue);
@@ -6236,7 +6301,7 @@ static void disas_fp_csel(DisasContext *s, uint32_t insn)
     read_vec_element(s, t_true, rn, 0, sz);
     read_vec_element(s, t_false, rm, 0, sz);
 
-    a64_test_cc(&c, cond);
+    a64_test_cc(s, &c, cond);
     tcg_gen_movcond_i64(c.cond, t_true, c.value, tcg_constant_i64(0),
                         t_true, t_false);
     tcg_temp_free_i64(t_false);
@@ -14773,6 +14838,12 @@ static void aarch64_tr_init_disas_context(DisasContextBase *dcbase,
     }
     dc->base.max_insns = MIN(dc->base.max_insns, bound);
 
+    dc->cc_cmp_insn = -1;
+    dc->cc_cmp_a = tcg_temp_new_i32();
+    dc->cc_cmp_b = tcg_temp_new_i32();
+    dc->cc_cmp_a64 = tcg_temp_new_i64();
+    dc->cc_cmp_b64 = tcg_temp_new_i64();
+
     init_tmp_a64_array(dc);
 }
 
@@ -14956,6 +15027,7 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             /* fall through */
         case DISAS_EXIT:
         case DISAS_JUMP:
+        case DISAS_RET:
             gen_step_complete_exception(dc);
             break;
         case DISAS_NORETURN:
@@ -14976,10 +15048,19 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             break;
         case DISAS_UPDATE_NOCHAIN:
             gen_a64_set_pc_im(dc->base.pc_next);
-            /* fall through */
-        case DISAS_JUMP:
             tcg_gen_lookup_and_goto_ptr();
             break;
+        case DISAS_JUMP:
+            /*
+             * Only set by the branch to register insns, which update
+             * BTYPE statically, so the flags of the next TB do not
+             * depend on the runtime state.
+             */
+            tcg_gen_lookup_and_goto_ptr_pred(dc->base.tb, cpu_pc);
+            break;
+        case DISAS_RET:
+            tcg_gen_lookup_and_goto_ptr_ret(dc->base.tb, cpu_pc);
+            break;
         case DISAS_NORETURN:
         case DISAS_SWI:
             break;
@@ -763,6 +763,53 @@ void arm_gen_test_cc(int cc, TCGLabel *label)
     arm_free_cc(&cmp);
 }
 
+/*
+ * Note that the flags were just set by a SUBS/CMP of @a and @b.
+ * Must be called before the flags are computed, since the operands
+ * may be overwritten by the result.
+ */
+void arm_gen_record_cmp(DisasContext *s, TCGv_i32 a, TCGv_i32 b)
+{
+    /*
+     * A conditionally executed compare leaves a label at the end of
+     * the insn, so the operands would not survive to the next one.
+     */
+    if (s->condjmp) {
+        s->cc_cmp_insn = -1;
+        return;
+    }
+    tcg_gen_mov_i32(s->cc_cmp_a, a);
+    tcg_gen_mov_i32(s->cc_cmp_b, b);
+    s->cc_cmp_64 = false;
+    s->cc_cmp_insn = s->base.num_insns;
+}
+
+/*
+ * Return the TCG comparison of the recorded compare operands which is
+ * equivalent to ARM condition @cc, or TCG_COND_NEVER if there is no
+ * compare for the current insn or @cc depends on N or V alone.
+ */
+TCGCond arm_cmp_cond(DisasContext *s, int cc)
+{
+    static const TCGCond cmp_cond[16] = {
+        [0] = TCG_COND_EQ,   /* eq */
+        [1] = TCG_COND_NE,   /* ne */
+        [2] = TCG_COND_GEU,  /* cs */
+        [3] = TCG_COND_LTU,  /* cc */
+        [8] = TCG_COND_GTU,  /* hi */
+        [9] = TCG_COND_LEU,  /* ls */
+        [10] = TCG_COND_GE,  /* ge */
+        [11] = TCG_COND_LT,  /* lt */
+        [12] = TCG_COND_GT,  /* gt */
+        [13] = TCG_COND_LE,  /* le */
+    };
+
+    if (s->cc_cmp_insn != s->base.num_insns - 1) {
+        return TCG_COND_NEVER;
+    }
+    return cmp_cond[cc & 15];
+}
+
 void gen_set_condexec(DisasContext *s)
 {
     if (s->condexec_mask) {
@@ -5215,8 +5262,14 @@ static void gen_srs(DisasContext *s,
 /* Skip this instruction if the ARM condition is false */
 static void arm_skip_unless(DisasContext *s, uint32_t cond)
 {
+    TCGCond c = arm_cmp_cond(s, cond ^ 1);
+
     arm_gen_condlabel(s);
-    arm_gen_test_cc(cond ^ 1, s->condlabel);
+    if (c != TCG_COND_NEVER) {
+        tcg_gen_brcond_i32(c, s->cc_cmp_a, s->cc_cmp_b, s->condlabel);
+    } else {
+        arm_gen_test_cc(cond ^ 1, s->condlabel);
+    }
 }
 
 
@@ -5368,6 +5421,18 @@ static void gen_rsb_CC(TCGv_i32 dst, TCGv_i32 a, TCGv_i32 b)
     gen_sub_CC(dst, b, a);
 }
 
+/* Record the operands if @gen is about to set the flags by subtraction */
+static void gen_record_sub_CC(DisasContext *s,
+                              void (*gen)(TCGv_i32, TCGv_i32, TCGv_i32),
+                              TCGv_i32 a, TCGv_i32 b)
+{
+    if (gen == gen_sub_CC) {
+        arm_gen_record_cmp(s, a, b);
+    } else if (gen == gen_rsb_CC) {
+        arm_gen_record_cmp(s, b, a);
+    }
+}
+
 static void gen_rsc(TCGv_i32 dest, TCGv_i32 a, TCGv_i32 b)
 {
     gen_sub_carry(dest, b, a);
@@ -5436,6 +5501,7 @@ static bool op_s_rrr_shi(DisasContext *s, arg_s_rrr_shi *a,
     gen_arm_shift_im(tmp2, a->shty, a->shim, logic_cc);
     tmp1 = load_reg(s, a->rn);
 
+    gen_record_sub_CC(s, gen, tmp1, tmp2);
     gen(tmp1, tmp1, tmp2);
     tcg_temp_free_i32(tmp2);
 
@@ -5478,6 +5544,7 @@ static bool op_s_rrr_shr(DisasContext *s, arg_s_rrr_shr *a,
     gen_arm_shift_reg(tmp2, a->shty, tmp1, logic_cc);
     tmp1 = load_reg(s, a->rn);
 
+    gen_record_sub_CC(s, gen, tmp1, tmp2);
     gen(tmp1, tmp1, tmp2);
     tcg_temp_free_i32(tmp2);
 
@@ -5527,6 +5594,7 @@ static bool op_s_rri_rot(DisasContext *s, arg_s_rri_rot *a,
     }
     tmp1 = load_reg(s, a->rn);
 
+    gen_record_sub_CC(s, gen, tmp1, tcg_constant_i32(imm));
     gen(tmp1, tmp1, tcg_constant_i32(imm));
 
     if (logic_cc) {
@@ -9003,6 +9071,10 @@ static bool trans_IT(DisasContext *s, arg_IT *a)
      */
     s->condexec_cond = (cond_mask >> 4) & 0xe;
     s->condexec_mask = cond_mask & 0x1f;
+    /* IT does not touch the flags: let the first insn use a prior CMP.  */
+    if (s->cc_cmp_insn == s->base.num_insns - 1) {
+        s->cc_cmp_insn = s->base.num_insns;
+    }
     return true;
 }
 
@@ -9420,6 +9492,10 @@ static void arm_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs)
     cpu_V0 = tcg_temp_new_i64();
     cpu_V1 = tcg_temp_new_i64();
     cpu_M0 = tcg_temp_new_i64();
+
+    dc->cc_cmp_insn = -1;
+    dc->cc_cmp_a = tcg_temp_new_i32();
+    dc->cc_cmp_b = tcg_temp_new_i32();
 }
 
 static void arm_tr_tb_start(DisasContextBase *dcbase, CPUState *cpu)
@@ -121,6 +121,18 @@ typedef struct DisasContext {
     int c15_cpar;
     /* TCG op of the current insn_start.  */
     TCGOp *insn_start;
+    /*
+     * Operands of the SUBS/CMP which last set NZCV, so that a condition
+     * tested by the very next insn can compare them directly instead of
+     * rebuilding the comparison from the flags.  cc_cmp_insn is the
+     * base.num_insns of the compare, or -1.  The flags are always
+     * written as well; these are plain temps, so liveness drops the
+     * copies when nothing uses them.
+     */
+    int cc_cmp_insn;
+    bool cc_cmp_64;
+    TCGv_i32 cc_cmp_a, cc_cmp_b;
+    TCGv_i64 cc_cmp_a64, cc_cmp_b64;
 #define TMP_A64_MAX 16
     int tmp_a64_count;
     TCGv_i64 tmp_a64[TMP_A64_MAX];
@@ -255,6 +267,8 @@ static inline void disas_set_insn_syndrome(DisasContext *s, uint32_t syn)
 #define DISAS_EXIT      DISAS_TARGET_9
 /* CPU state was modified dynamically; no need to exit, but do not chain. */
 #define DISAS_UPDATE_NOCHAIN  DISAS_TARGET_10
+/* Return from a subroutine: only pc was modified, see tcg_gen_ret_push. */
+#define DISAS_RET       DISAS_TARGET_11
 
 #ifdef TARGET_AARCH64
 void a64_translate_init(void);
@@ -274,6 +288,8 @@ void arm_test_cc(DisasCompare *cmp, int cc);
 void arm_free_cc(DisasCompare *cmp);
 void arm_jump_cc(DisasCompare *cmp, TCGLabel *label);
 void arm_gen_test_cc(int cc, TCGLabel *label);
+void arm_gen_record_cmp(DisasContext *s, TCGv_i32 a, TCGv_i32 b);
+TCGCond arm_cmp_cond(DisasContext *s, int cc);
 MemOp pow2_align(unsigned i);
 void unallocated_encoding(DisasContext *s);
 void gen_exception_insn_el(DisasContext *s, uint64_t pc, int excp,
@@ -405,6 +405,15 @@ static int handle_mmu_fault(CPUState *cs, vaddr addr, int size,
         paddr &= TARGET_PAGE_MASK;
 
         assert(prot & (1 << is_write1));
+        /*
+         * Without nested paging or A20 masking, a large page maps
+         * linearly, so let the TLB fill its other 4KB pages itself.
+         */
+        if (page_size > TARGET_PAGE_SIZE &&
+            !(env->hflags2 & HF2_NPT_MASK) &&
+            x86_get_a20_mask(env) == -1) {
+            prot |= PAGE_LINEAR;
+        }
         tlb_set_page_with_attrs(cs, vaddr, paddr, cpu_get_mem_attrs(env),
                                 prot, mmu_idx, page_size);
         return 0;
@@ -23,6 +23,7 @@
 #include "disas/disas.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg-op.h"
+#include "tcg/tcg-op-gvec.h"
 #include "exec/cpu_ldst.h"
 #include "exec/translator.h"
 
@@ -2700,6 +2701,33 @@ static void gen_jr(DisasContext *s, TCGv dest)
     do_gen_eob_worker(s, false, false, true);
 }
 
+/* Jump to register for near jumps, calls and returns (if RET), which
+   can use the inline prediction of their target.  */
+static void gen_jr_near(DisasContext *s, TCGv dest, bool ret)
+{
+    TCGv pc;
+
+    /* The prediction is only valid if the TB flags do not change: the
+       end of block resets the inhibit irq flag and RF, and the MPX helper
+       called by gen_bnd_jmp may clear HF_MPX_IU_MASK.  */
+    if ((s->flags | s->base.tb->flags) &
+        (HF_INHIBIT_IRQ_MASK | HF_RF_MASK | HF_TF_MASK | HF_MPX_IU_MASK)) {
+        gen_jr(s, dest);
+        return;
+    }
+
+    gen_update_cc_op(s);
+    pc = tcg_temp_new();
+    tcg_gen_addi_tl(pc, dest, s->cs_base);
+    if (ret) {
+        tcg_gen_lookup_and_goto_ptr_ret(s->base.tb, pc);
+    } else {
+        tcg_gen_lookup_and_goto_ptr_pred(s->base.tb, pc);
+    }
+    tcg_temp_free(pc);
+    s->base.is_jmp = DISAS_NORETURN;
+}
+
 /* generate a jump to eip. No segment change must happen before as a
    direct call to the next block may occur */
 static void gen_jmp_tb(DisasContext *s, target_ulong eip, int tb_num)
@@ -2777,6 +2805,17 @@ static inline void gen_op_movq_env_0(DisasContext *s, int d_offset)
     tcg_gen_st_i64(s->tmp1_i64, cpu_env, d_offset);
 }
 
+/*
+ * A ZMMReg holds the vector as a single 512-bit integer in host byte
+ * order, so on big-endian hosts its low bytes are at the end.  Return the
+ * offset of the low @size bytes within the register, as needed by the
+ * tcg_gen_gvec_* expanders.
+ */
+static inline int zmm_low_offset(int size)
+{
+    return HOST_BIG_ENDIAN ? sizeof(ZMMReg) - size : 0;
+}
+
 typedef void (*SSEFunc_i_ep)(TCGv_i32 val, TCGv_ptr env, TCGv_ptr reg);
 typedef void (*SSEFunc_l_ep)(TCGv_i64 val, TCGv_ptr env, TCGv_ptr reg);
 typedef void (*SSEFunc_0_epi)(TCGv_ptr env, TCGv_ptr reg, TCGv_i32 val);
@@ -2787,6 +2826,8 @@ typedef void (*SSEFunc_0_eppi)(TCGv_ptr env, TCGv_ptr reg_a, TCGv_ptr reg_b,
 typedef void (*SSEFunc_0_ppi)(TCGv_ptr reg_a, TCGv_ptr reg_b, TCGv_i32 val);
 typedef void (*SSEFunc_0_eppt)(TCGv_ptr env, TCGv_ptr reg_a, TCGv_ptr reg_b,
                                TCGv val);
+typedef void GVecGen3Fn(unsigned, uint32_t, uint32_t,
+                        uint32_t, uint32_t, uint32_t);
 
 #define SSE_SPECIAL ((void *)1)
 #define SSE_DUMMY ((void *)2)
@@ -3107,6 +3148,135 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
     [0xdf] = AESNI_OP(aeskeygenassist),
 };
 
+/*
+ * Expand the MMX and SSE integer and logical operations that are plain
+ * element-wise vector operations, d = a op b, or d = op b for pabs.
+ * @op is the opcode byte plus 0x100 for the 0f map or 0x200 for 0f 38, and
+ * the offsets point to the low @oprsz bytes of each operand.  Return false
+ * if the operation has to go through its helper.
+ */
+static bool gen_gvec_sse(int op, int dofs, int aofs, int bofs, int oprsz)
+{
+    GVecGen3Fn *fn;
+    MemOp vece;
+
+    switch (op) {
+    case 0x155: /* andnps, andnpd */
+    case 0x1df: /* pandn */
+        tcg_gen_gvec_andc(MO_64, dofs, bofs, aofs, oprsz, oprsz);
+        return true;
+    case 0x174 ... 0x176: /* pcmpeqb, pcmpeqw, pcmpeql */
+        tcg_gen_gvec_cmp(TCG_COND_EQ, op - 0x174, dofs, aofs, bofs,
+                         oprsz, oprsz);
+        return true;
+    case 0x229: /* pcmpeqq */
+        tcg_gen_gvec_cmp(TCG_COND_EQ, MO_64, dofs, aofs, bofs, oprsz, oprsz);
+        return true;
+    case 0x164 ... 0x166: /* pcmpgtb, pcmpgtw, pcmpgtl */
+        tcg_gen_gvec_cmp(TCG_COND_GT, op - 0x164, dofs, aofs, bofs,
+                         oprsz, oprsz);
+        return true;
+    case 0x237: /* pcmpgtq */
+        tcg_gen_gvec_cmp(TCG_COND_GT, MO_64, dofs, aofs, bofs, oprsz, oprsz);
+        return true;
+    case 0x21c ... 0x21e: /* pabsb, pabsw, pabsd */
+        tcg_gen_gvec_abs(op - 0x21c, dofs, bofs, oprsz, oprsz);
+        return true;
+
+    case 0x154: /* andps, andpd */
+    case 0x1db: /* pand */
+        fn = tcg_gen_gvec_and, vece = MO_64;
+        break;
+    case 0x156: /* orps, orpd */
+    case 0x1eb: /* por */
+        fn = tcg_gen_gvec_or, vece = MO_64;
+        break;
+    case 0x157: /* xorps, xorpd */
+    case 0x1ef: /* pxor */
+        fn = tcg_gen_gvec_xor, vece = MO_64;
+        break;
+    case 0x1fc ... 0x1fe: /* paddb, paddw, paddl */
+        fn = tcg_gen_gvec_add, vece = op - 0x1fc;
+        break;
+    case 0x1d4: /* paddq */
+        fn = tcg_gen_gvec_add, vece = MO_64;
+        break;
+    case 0x1f8 ... 0x1fb: /* psubb, psubw, psubl, psubq */
+        fn = tcg_gen_gvec_sub, vece = op - 0x1f8;
+        break;
+    case 0x1ec ... 0x1ed: /* paddsb, paddsw */
+        fn = tcg_gen_gvec_ssadd, vece = op - 0x1ec;
+        break;
+    case 0x1dc ... 0x1dd: /* paddusb, paddusw */
+        fn = tcg_gen_gvec_usadd, vece = op - 0x1dc;
+        break;
+    case 0x1e8 ... 0x1e9: /* psubsb, psubsw */
+        fn = tcg_gen_gvec_sssub, vece = op - 0x1e8;
+        break;
+    case 0x1d8 ... 0x1d9: /* psubusb, psubusw */
+        fn = tcg_gen_gvec_ussub, vece = op - 0x1d8;
+        break;
+    case 0x1da: /* pminub */
+        fn = tcg_gen_gvec_umin, vece = MO_8;
+        break;
+    case 0x1de: /* pmaxub */
+        fn = tcg_gen_gvec_umax, vece = MO_8;
+        break;
+    case 0x1ea: /* pminsw */
+        fn = tcg_gen_gvec_smin, vece = MO_16;
+        break;
+    case 0x1ee: /* pmaxsw */
+        fn = tcg_gen_gvec_smax, vece = MO_16;
+        break;
+    case 0x238: /* pminsb */
+        fn = tcg_gen_gvec_smin, vece = MO_8;
+        break;
+    case 0x239: /* pminsd */
+        fn = tcg_gen_gvec_smin, vece = MO_32;
+        break;
+    case 0x23a: /* pminuw */
+        fn = tcg_gen_gvec_umin, vece = MO_16;
+        break;
+    case 0x23b: /* pminud */
+        fn = tcg_gen_gvec_umin, vece = MO_32;
+        break;
+    case 0x23c: /* pmaxsb */
+        fn = tcg_gen_gvec_smax, vece = MO_8;
+        break;
+    case 0x23d: /* pmaxsd */
+        fn = tcg_gen_gvec_smax, vece = MO_32;
+        break;
+    case 0x23e: /* pmaxuw */
+        fn = tcg_gen_gvec_umax, vece = MO_16;
+        break;
+    case 0x23f: /* pmaxud */
+        fn = tcg_gen_gvec_umax, vece = MO_32;
+        break;
+    case 0x1d5: /* pmullw */
+        fn = tcg_gen_gvec_mul, vece = MO_16;
+        break;
+    case 0x240: /* pmulld */
+        fn = tcg_gen_gvec_mul, vece = MO_32;
+        break;
+    default:
+        return false;
+    }
+    fn(vece, dofs, aofs, bofs, oprsz, oprsz);
+    return true;
+}
+
+/* As gen_gvec_sse, for the two-operand MMX and SSE forms, d = d op b. */
+static bool gen_gvec_sse_legacy(int op, bool is_xmm,
+                                int op1_offset, int op2_offset)
+{
+    if (is_xmm) {
+        op1_offset += zmm_low_offset(16);
+        op2_offset += zmm_low_offset(16);
+    }
+    return gen_gvec_sse(op, op1_offset, op1_offset, op2_offset,
+                        is_xmm ? 16 : 8);
+}
+
 static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     target_ulong pc_start)
 {
@@ -3826,6 +3996,10 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             if (sse_fn_epp == SSE_SPECIAL) {
                 goto unknown_op;
             }
+            if (gen_gvec_sse_legacy(0x200 | b, is_xmm,
+                                    op1_offset, op2_offset)) {
+                break;
+            }
 
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op2_offset);
@@ -4534,6 +4708,10 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             sse_fn_eppt(cpu_env, s->ptr0, s->ptr1, s->A0);
             break;
         default:
+            if (gen_gvec_sse_legacy(0x100 | b, is_xmm,
+                                    op1_offset, op2_offset)) {
+                break;
+            }
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op2_offset);
             sse_fn_epp(cpu_env, s->ptr0, s->ptr1);
@@ -5123,7 +5301,8 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             gen_push_v(s, s->T1);
             gen_op_jmp_v(s->T0);
             gen_bnd_jmp(s);
-            gen_jr(s, s->T0);
+            tcg_gen_ret_push(s->base.tb, s->pc);
+            gen_jr_near(s, s->T0, false);
             break;
         case 3: /* lcall Ev */
             if (mod == 3) {
@@ -5153,7 +5332,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             }
             gen_op_jmp_v(s->T0);
             gen_bnd_jmp(s);
-            gen_jr(s, s->T0);
+            gen_jr_near(s, s->T0, false);
             break;
         case 5: /* ljmp Ev */
             if (mod == 3) {
@@ -6640,7 +6819,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
         /* Note that gen_pop_T0 uses a zero-extending load.  */
         gen_op_jmp_v(s->T0);
         gen_bnd_jmp(s);
-        gen_jr(s, s->T0);
+        gen_jr_near(s, s->T0, true);
         break;
     case 0xc3: /* ret */
         ot = gen_pop_T0(s);
@@ -6648,7 +6827,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
         /* Note that gen_pop_T0 uses a zero-extending load.  */
         gen_op_jmp_v(s->T0);
         gen_bnd_jmp(s);
-        gen_jr(s, s->T0);
+        gen_jr_near(s, s->T0, true);
         break;
     case 0xca: /* lret im */
         val = x86_ldsw_code(env, s);
@@ -6709,6 +6888,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             tcg_gen_movi_tl(s->T0, next_eip);
             gen_push_v(s, s->T0);
             gen_bnd_jmp(s);
+            tcg_gen_ret_push(s->base.tb, s->pc);
             gen_jmp(s, tval);
         }
         break;
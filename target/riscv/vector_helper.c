@@ -1558,6 +1558,35 @@ GEN_VEXT_VX(vmax_vx_h, 2)
 GEN_VEXT_VX(vmax_vx_w, 4)
 GEN_VEXT_VX(vmax_vx_d, 8)
 
+/* Out-of-line fallbacks for the GVEC expansion of the unmasked forms. */
+#define GEN_VEC_MINMAXS(NAME, ETYPE, OP)                            \
+void HELPER(NAME)(void *d, void *a, uint64_t b, uint32_t desc)      \
+{                                                                   \
+    intptr_t oprsz = simd_oprsz(desc);                              \
+    intptr_t i;                                                     \
+                                                                    \
+    for (i = 0; i < oprsz; i += sizeof(ETYPE)) {                    \
+        *(ETYPE *)(d + i) = OP(*(ETYPE *)(a + i), (ETYPE)b);        \
+    }                                                               \
+}
+
+GEN_VEC_MINMAXS(vec_umins8, uint8_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_umins16, uint16_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_umins32, uint32_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_umins64, uint64_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_smins8, int8_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_smins16, int16_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_smins32, int32_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_smins64, int64_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_umaxs8, uint8_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_umaxs16, uint16_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_umaxs32, uint32_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_umaxs64, uint64_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_smaxs8, int8_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_smaxs16, int16_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_smaxs32, int32_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_smaxs64, int64_t, DO_MAX)
+
 /* Vector Single-Width Integer Multiply Instructions */
 #define DO_MUL(N, M) (N * M)
 RVVCALL(OPIVV2, vmul_vv_b, OP_SSS_B, H1, H1, H1, DO_MUL)
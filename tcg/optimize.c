@@ -44,13 +44,51 @@ typedef struct TempOptInfo {
     uint64_t val;
     uint64_t z_mask;  /* mask bit is 0 if and only if value bit is 0 */
     uint64_t s_mask;  /* a left-aligned mask of clrsb(value) bits. */
+    uint32_t gen;     /* incremented each time the temp is redefined */
 } TempOptInfo;
 
+/*
+ * A pure operation computed earlier in the basic block.  It may be
+ * reused while none of the temps in ARGS has been redefined, i.e.
+ * while their TempOptInfo.gen still matches GEN.
+ */
+#define OPT_GVN_ARGS  6
+#define OPT_GVN_SIZE  64
+
+typedef struct OptGVNEntry {
+    uint32_t bb;
+    TCGOpcode opc;
+    TCGArg args[OPT_GVN_ARGS];
+    uint32_t gen[OPT_GVN_ARGS];
+} OptGVNEntry;
+
+/*
+ * A value known to be in env memory: either loaded by OPC from OFS,
+ * or stored there with the width of OPC.  Valid while VAL has not
+ * been redefined and nothing may have written to the memory.
+ */
+#define OPT_MEM_SIZE  32
+
+typedef struct OptMemEntry {
+    TCGOpcode opc;
+    int size;
+    intptr_t ofs;
+    TCGTemp *val;
+    uint32_t gen;
+} OptMemEntry;
+
 typedef struct OptContext {
     TCGContext *tcg;
     TCGOp *prev_mb;
     TCGTempSet temps_used;
 
+    /* Values available for reuse within the basic block. */
+    uint32_t bb;
+    OptGVNEntry gvn[OPT_GVN_SIZE];
+    int nb_mem;
+    int next_mem;
+    OptMemEntry mem[OPT_MEM_SIZE];
+
     /* In flight values from optimization. */
     uint64_t a_mask;  /* mask bit is 0 iff value identical to first input */
     uint64_t z_mask;  /* mask bit is 0 iff value bit is 0 */
@@ -136,6 +174,7 @@ static void reset_ts(TCGTemp *ts)
     ti->is_const = false;
     ti->z_mask = -1;
     ti->s_mask = 0;
+    ti->gen++;
 }
 
 static void reset_temp(TCGArg arg)
@@ -158,6 +197,7 @@ static void init_ts_info(OptContext *ctx, TCGTemp *ts)
     if (ti == NULL) {
         ti = tcg_malloc(sizeof(TempOptInfo));
         ts->state_ptr = ti;
+        ti->gen = 0;
     }
 
     ti->next_copy = ts;
@@ -698,6 +738,8 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
     if (def->flags & TCG_OPF_BB_END) {
         memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
         ctx->prev_mb = NULL;
+        ctx->bb++;
+        ctx->nb_mem = 0;
         return;
     }
 
@@ -1227,6 +1269,11 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
         reset_temp(op->args[i]);
     }
 
+    /* Unless the function is pure, it may write to env. */
+    if (!(flags & TCG_CALL_NO_SIDE_EFFECTS)) {
+        ctx->nb_mem = 0;
+    }
+
     /* Stop optimizing MB across calls. */
     ctx->prev_mb = NULL;
     return true;
@@ -1478,6 +1525,9 @@ static bool fold_extu(OptContext *ctx, TCGOp *op)
 
 static bool fold_mb(OptContext *ctx, TCGOp *op)
 {
+    /* Values loaded from env before the barrier may have changed since. */
+    ctx->nb_mem = 0;
+
     /* Eliminate duplicate and redundant fence instructions.  */
     if (ctx->prev_mb) {
         /*
@@ -2022,6 +2072,246 @@ static bool fold_xor(OptContext *ctx, TCGOp *op)
     return fold_masks(ctx, op);
 }
 
+/*
+ * Redundancy elimination within a basic block.  A pure operation whose
+ * inputs have not changed since it was last computed, and a load from
+ * env of a value already loaded or stored, are replaced by a copy.
+ */
+
+static bool gvn_op_ok(TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+
+    if (def->nb_oargs != 1 ||
+        def->nb_oargs + def->nb_iargs + def->nb_cargs > OPT_GVN_ARGS ||
+        (def->flags & (TCG_OPF_BB_END | TCG_OPF_SIDE_EFFECTS |
+                       TCG_OPF_NOT_PRESENT | TCG_OPF_VECTOR))) {
+        return false;
+    }
+    switch (op->opc) {
+    CASE_OP_32_64(mov):
+    CASE_OP_32_64(ld8s):
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(ld16s):
+    CASE_OP_32_64(ld16u):
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_ld32u_i64:
+    CASE_OP_32_64(ld):
+        return false;
+    default:
+        return true;
+    }
+}
+
+static OptGVNEntry *gvn_lookup(OptContext *ctx, TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    int nb_args = def->nb_oargs + def->nb_iargs + def->nb_cargs;
+    uint32_t h = op->opc;
+    int i;
+
+    for (i = 1; i < nb_args; i++) {
+        uint64_t a = op->args[i];
+        h = h * 31 + (uint32_t)(a ^ (a >> 32));
+    }
+    return &ctx->gvn[(h ^ (h >> 16)) % OPT_GVN_SIZE];
+}
+
+static bool fold_gvn(OptContext *ctx, TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    int nb_targs = def->nb_oargs + def->nb_iargs;
+    int nb_args = nb_targs + def->nb_cargs;
+    OptGVNEntry *e;
+    int i;
+
+    if (!gvn_op_ok(op)) {
+        return false;
+    }
+    e = gvn_lookup(ctx, op);
+    if (e->bb != ctx->bb || e->opc != op->opc) {
+        return false;
+    }
+    for (i = 1; i < nb_args; i++) {
+        if (e->args[i] != op->args[i]) {
+            return false;
+        }
+    }
+    for (i = 0; i < nb_targs; i++) {
+        if (arg_info(e->args[i])->gen != e->gen[i]) {
+            return false;
+        }
+    }
+
+    ctx->tcg->opt_gvn_count++;
+    return tcg_opt_gen_mov(ctx, op, op->args[0], e->args[0]);
+}
+
+static void gvn_record(OptContext *ctx, TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    int nb_targs = def->nb_oargs + def->nb_iargs;
+    int nb_args = nb_targs + def->nb_cargs;
+    OptGVNEntry *e;
+    int i;
+
+    if (!gvn_op_ok(op)) {
+        return;
+    }
+    /* If the output overwrote an input, the value cannot be reused. */
+    for (i = 1; i < nb_targs; i++) {
+        if (op->args[i] == op->args[0]) {
+            return;
+        }
+    }
+
+    e = gvn_lookup(ctx, op);
+    e->bb = ctx->bb;
+    e->opc = op->opc;
+    for (i = 0; i < nb_args; i++) {
+        e->args[i] = op->args[i];
+    }
+    for (i = 0; i < nb_targs; i++) {
+        e->gen[i] = arg_info(op->args[i])->gen;
+    }
+}
+
+/* Return the number of bytes read from memory by a host load op, or 0. */
+static int tcg_ld_size(TCGOpcode opc)
+{
+    switch (opc) {
+    CASE_OP_32_64(ld8s):
+    CASE_OP_32_64(ld8u):
+        return 1;
+    CASE_OP_32_64(ld16s):
+    CASE_OP_32_64(ld16u):
+        return 2;
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld_i32:
+        return 4;
+    case INDEX_op_ld_i64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/* Return the number of bytes written to memory by a host store op, or 0. */
+static int tcg_st_size(TCGOp *op)
+{
+    switch (op->opc) {
+    CASE_OP_32_64(st8):
+        return 1;
+    CASE_OP_32_64(st16):
+        return 2;
+    case INDEX_op_st32_i64:
+    case INDEX_op_st_i32:
+        return 4;
+    case INDEX_op_st_i64:
+        return 8;
+    case INDEX_op_st_vec:
+        return 8 << TCGOP_VECL(op);
+    default:
+        return 0;
+    }
+}
+
+static bool arg_is_env(TCGArg arg)
+{
+    return arg_temp(arg) == tcgv_ptr_temp(cpu_env);
+}
+
+static void mem_record(OptContext *ctx, TCGOpcode opc, int size,
+                       intptr_t ofs, TCGTemp *val)
+{
+    OptMemEntry *e;
+
+    if (ctx->nb_mem < OPT_MEM_SIZE) {
+        e = &ctx->mem[ctx->nb_mem++];
+    } else {
+        e = &ctx->mem[ctx->next_mem];
+        ctx->next_mem = (ctx->next_mem + 1) % OPT_MEM_SIZE;
+    }
+    e->opc = opc;
+    e->size = size;
+    e->ofs = ofs;
+    e->val = val;
+    e->gen = ts_info(val)->gen;
+}
+
+/* Forget all values in env memory that overlap [OFS, OFS + SIZE). */
+static void mem_clobber(OptContext *ctx, intptr_t ofs, int size)
+{
+    int i, j;
+
+    for (i = j = 0; i < ctx->nb_mem; i++) {
+        OptMemEntry *e = &ctx->mem[i];
+        if (e->ofs + e->size <= ofs || ofs + size <= e->ofs) {
+            ctx->mem[j++] = *e;
+        }
+    }
+    ctx->nb_mem = j;
+    ctx->next_mem = 0;
+}
+
+static bool fold_env_ld(OptContext *ctx, TCGOp *op)
+{
+    intptr_t ofs = op->args[2];
+    int i;
+
+    if (!tcg_ld_size(op->opc) || !arg_is_env(op->args[1])) {
+        return false;
+    }
+    for (i = 0; i < ctx->nb_mem; i++) {
+        OptMemEntry *e = &ctx->mem[i];
+        if (e->opc == op->opc && e->ofs == ofs &&
+            ts_info(e->val)->gen == e->gen) {
+            ctx->tcg->opt_ld_fwd_count++;
+            return tcg_opt_gen_mov(ctx, op, op->args[0], temp_arg(e->val));
+        }
+    }
+    return false;
+}
+
+/* Update the known contents of env after a load or store. */
+static void mem_update(OptContext *ctx, TCGOp *op)
+{
+    int size = tcg_ld_size(op->opc);
+
+    if (size) {
+        /*
+         * Negative offsets are CPUNegativeOffsetState, such as icount_decr,
+         * which other threads write; always load those again.
+         */
+        if (arg_is_env(op->args[1]) && (intptr_t)op->args[2] >= 0) {
+            mem_record(ctx, op->opc, size, op->args[2],
+                       arg_temp(op->args[0]));
+        }
+        return;
+    }
+
+    size = tcg_st_size(op);
+    if (size) {
+        intptr_t ofs = op->args[2];
+
+        if (!arg_is_env(op->args[1])) {
+            /* This may point anywhere within env. */
+            ctx->nb_mem = 0;
+            return;
+        }
+        mem_clobber(ctx, ofs, size);
+        if (ofs < 0) {
+            return;
+        }
+        if (op->opc == INDEX_op_st_i32) {
+            mem_record(ctx, INDEX_op_ld_i32, size, ofs, arg_temp(op->args[0]));
+        } else if (op->opc == INDEX_op_st_i64) {
+            mem_record(ctx, INDEX_op_ld_i64, size, ofs, arg_temp(op->args[0]));
+        }
+    }
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
@@ -2038,6 +2328,7 @@ void tcg_optimize(TCGContext *s)
     for (i = 0; i < nb_temps; ++i) {
         s->temps[i].state_ptr = NULL;
     }
+    ctx.bb = 1;
 
     QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
         TCGOpcode opc = op->opc;
@@ -2233,8 +2524,19 @@ void tcg_optimize(TCGContext *s)
             break;
         }
 
+        if (!done) {
+            done = fold_gvn(&ctx, op) || fold_env_ld(&ctx, op);
+        }
         if (!done) {
             finish_folding(&ctx, op);
+            gvn_record(&ctx, op);
+            mem_update(&ctx, op);
         }
     }
+
+#ifdef CONFIG_PROFILER
+    qatomic_set(&s->prof.gvn_count, s->prof.gvn_count + s->opt_gvn_count);
+    qatomic_set(&s->prof.ld_fwd_count,
+                s->prof.ld_fwd_count + s->opt_ld_fwd_count);
+#endif
 }
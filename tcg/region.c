@@ -24,14 +24,21 @@
 
 #include "qemu/osdep.h"
 #include "qemu/units.h"
+#include "qemu/bitmap.h"
 #include "qemu/madvise.h"
 #include "qemu/mprotect.h"
 #include "qemu/memalign.h"
 #include "qemu/cacheinfo.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg.h"
 #include "tcg-internal.h"
+#ifdef CONFIG_NUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
 
 
 struct tcg_region_tree {
@@ -56,10 +63,22 @@ struct tcg_region_state {
     size_t size; /* size of one region */
     size_t stride; /* .size + guard size */
     size_t total_size; /* size of entire buffer, >= n * stride */
+    size_t page_size; /* alignment of the regions; the huge page size if any */
+    TCGCodeHugePages hugepages;
+    bool numa;
+    int *node; /* NUMA node each region was last bound to, or -1 */
 
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    unsigned long *evicted; /* regions below .current free for reuse */
+
+    /*
+     * Eviction epoch in which each region was last filled or executed;
+     * see tcg_region_mark_used.  Written without the lock.
+     */
+    unsigned epoch;
+    unsigned *stamp;
 };
 
 static struct tcg_region_state region;
@@ -167,10 +186,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region containing rw pointer @p.  */
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
 
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -181,19 +213,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
             return NULL;
         }
     }
-
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -335,11 +355,19 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t i;
+
+    if (region.current < region.n) {
+        tcg_region_assign(s, region.current);
+        region.current++;
+        return false;
+    }
+    i = find_first_bit(region.evicted, region.n);
+    if (i == region.n) {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    clear_bit(i, region.evicted);
+    tcg_region_assign(s, i);
     return false;
 }
 
@@ -347,18 +375,63 @@ static bool tcg_region_alloc__locked(TCGContext *s)
  * Request a new region once the one in use has filled up.
  * Returns true on error.
  */
+/*
+ * Move the region now assigned to @s to the NUMA node of the calling
+ * thread, which is the one translating into it.  Regions reassigned by
+ * tcg_region_reset_all are not moved, but they normally go back to the
+ * context that used them before.
+ */
+static void tcg_region_bind_local(TCGContext *s)
+{
+#ifdef CONFIG_NUMA
+    size_t i = tcg_region_index(s->code_gen_buffer);
+    g_autofree unsigned long *nodes = NULL;
+    void *start, *end;
+    int cpu, node;
+
+    if (!region.numa) {
+        return;
+    }
+    cpu = sched_getcpu();
+    node = cpu < 0 ? -1 : numa_node_of_cpu(cpu);
+    if (node < 0 || node == region.node[i]) {
+        return;
+    }
+
+    start = QEMU_ALIGN_PTR_DOWN(s->code_gen_buffer, region.page_size);
+    end = QEMU_ALIGN_PTR_UP(s->code_gen_buffer + s->code_gen_buffer_size,
+                            region.page_size);
+    nodes = bitmap_new(node + 1);
+    set_bit(node, nodes);
+    /* As in host_memory_backend_memory_complete, pass maxnode + 1.  */
+    if (mbind(start, end - start, MPOL_PREFERRED, nodes, node + 2,
+              MPOL_MF_MOVE)) {
+        warn_report_once("cannot bind jit buffer to host NUMA node: %s",
+                         strerror(errno));
+        return;
+    }
+    qatomic_set(&region.node[i], node);
+#endif
+}
+
 bool tcg_region_alloc(TCGContext *s)
 {
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t full = tcg_region_index(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        /* A region that has just been filled is not a good victim.  */
+        qatomic_set(&region.stamp[full], region.epoch);
     }
     qemu_mutex_unlock(&region.lock);
+    if (!err) {
+        tcg_region_bind_local(s);
+    }
     return err;
 }
 
@@ -377,6 +450,7 @@ void tcg_region_initial_alloc(TCGContext *s)
     qemu_mutex_lock(&region.lock);
     tcg_region_initial_alloc__locked(s);
     qemu_mutex_unlock(&region.lock);
+    tcg_region_bind_local(s);
 }
 
 /* Call from a safe-work context */
@@ -388,6 +462,7 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    bitmap_zero(region.evicted, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -398,10 +473,171 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Record that the TB with host code at @tc_ptr is being executed, so that
+ * its region is kept by the next tcg_region_evict.  Called when a TB is
+ * entered from cpu_exec or through lookup_tb_ptr, and when a jump to it
+ * is linked; code that is only reached through linked jumps is found by
+ * tcg_region_stamp_linked.  The stamp is only written once per epoch, to
+ * limit the traffic on the shared cache line.
+ */
+void tcg_region_mark_used(const void *tc_ptr)
+{
+    size_t i = tcg_region_index(tcg_splitwx_to_rw(tc_ptr));
+    unsigned epoch = qatomic_read(&region.epoch);
+
+    if (qatomic_read(&region.stamp[i]) != epoch) {
+        qatomic_set(&region.stamp[i], epoch);
+    }
+}
+
+static gboolean tcg_region_collect_tb(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+typedef struct {
+    size_t *queue;
+    size_t n_queue;
+} TCGRegionLinkWalk;
+
+static gboolean tcg_region_stamp_jumps(gpointer key, gpointer value,
+                                       gpointer data)
+{
+    const TranslationBlock *tb = value;
+    TCGRegionLinkWalk *walk = data;
+    int n;
+
+    for (n = 0; n < ARRAY_SIZE(tb->jmp_dest); n++) {
+        TranslationBlock *dest =
+            (TranslationBlock *)(qatomic_read(&tb->jmp_dest[n]) & ~1);
+        size_t i;
+
+        if (dest == NULL) {
+            continue;
+        }
+        i = tcg_region_index(tcg_splitwx_to_rw(dest->tc.ptr));
+        if (region.stamp[i] != region.epoch) {
+            region.stamp[i] = region.epoch;
+            walk->queue[walk->n_queue++] = i;
+        }
+    }
+    return false;
+}
+
+/*
+ * Chained TBs run without returning to cpu_exec, so their regions are not
+ * stamped by execution.  Extend the stamp of the current epoch to every
+ * region reachable through linked jumps from a region that was executed.
+ *
+ * Call with region.lock held, from a safe-work context.
+ */
+static void tcg_region_stamp_linked(void)
+{
+    g_autofree size_t *queue = g_new(size_t, region.n);
+    TCGRegionLinkWalk walk = { .queue = queue };
+    size_t i;
+
+    for (i = 0; i < region.current; i++) {
+        if (region.stamp[i] == region.epoch && !test_bit(i, region.evicted)) {
+            queue[walk.n_queue++] = i;
+        }
+    }
+    while (walk.n_queue) {
+        struct tcg_region_tree *rt;
+
+        i = queue[--walk.n_queue];
+        rt = region_trees + i * tree_size;
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, tcg_region_stamp_jumps, &walk);
+        qemu_mutex_unlock(&rt->lock);
+    }
+}
+
+static int tcg_region_stamp_cmp(const void *ap, const void *bp)
+{
+    unsigned a = region.stamp[*(const size_t *)ap];
+    unsigned b = region.stamp[*(const size_t *)bp];
+
+    return a < b ? -1 : a > b;
+}
+
+/*
+ * Free about a quarter of the code buffer for reuse, choosing the full
+ * regions that were least recently executed; the regions in use by a
+ * TCG context are never evicted.  @evict_tb is called on each TB of the
+ * evicted regions, and must remove all references to it.
+ * Returns the number of regions evicted, which is zero if none could be.
+ *
+ * Call from a safe-work context.
+ */
+size_t tcg_region_evict(void (*evict_tb)(TranslationBlock *tb))
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    g_autofree size_t *cand = g_new(size_t, region.n);
+    g_autofree unsigned long *busy = bitmap_new(region.n);
+    size_t n_cand = 0, n_evict, i, j;
+
+    qemu_mutex_lock(&region.lock);
+    tcg_region_stamp_linked();
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        set_bit(tcg_region_index(s->code_gen_buffer), busy);
+    }
+    for (i = 0; i < region.current; i++) {
+        if (!test_bit(i, busy) && !test_bit(i, region.evicted)) {
+            cand[n_cand++] = i;
+        }
+    }
+    qsort(cand, n_cand, sizeof(size_t), tcg_region_stamp_cmp);
+    n_evict = MIN(n_cand, MAX(region.n / 4, 1));
+
+    for (i = 0; i < n_evict; i++) {
+        struct tcg_region_tree *rt = region_trees + cand[i] * tree_size;
+        g_autoptr(GPtrArray) tbs = g_ptr_array_new();
+        void *start, *end;
+
+        /* @evict_tb may take page locks, which nest outside rt->lock.  */
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, tcg_region_collect_tb, tbs);
+        qemu_mutex_unlock(&rt->lock);
+
+        for (j = 0; j < tbs->len; j++) {
+            evict_tb(g_ptr_array_index(tbs, j));
+        }
+
+        qemu_mutex_lock(&rt->lock);
+        g_tree_ref(rt->tree);
+        g_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+
+        tcg_region_bounds(cand[i], &start, &end);
+        region.agg_size_full -= end - start - TCG_HIGHWATER;
+        set_bit(cand[i], region.evicted);
+    }
+    if (n_evict) {
+        qatomic_set(&region.epoch, region.epoch + 1);
+    }
+    qemu_mutex_unlock(&region.lock);
+    return n_evict;
+}
+
+/*
+ * With a single TCG context, use a few regions anyway so that a full
+ * buffer can be reclaimed incrementally by tcg_region_evict.
+ */
+static size_t tcg_n_regions_single(size_t tb_size)
+{
+    return MAX(MIN(tb_size / (16 * MiB), 8), 1);
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
-    return 1;
+    return tcg_n_regions_single(tb_size);
 #else
     size_t n_regions;
 
@@ -411,9 +647,9 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
      * being of reasonable size. If that's not possible we make do by evenly
      * dividing the code_gen_buffer among the vCPUs.
      */
-    /* Use a single region if all we have is one vCPU thread */
+    /* Use a single context if all we have is one vCPU thread */
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+        return tcg_n_regions_single(tb_size);
     }
 
     /*
@@ -484,6 +720,10 @@ static int alloc_code_gen_buffer(size_t tb_size, int splitwx, Error **errp)
         error_setg(errp, "jit split-wx not supported");
         return -1;
     }
+    if (region.hugepages == TCG_CODE_HUGEPAGES_EXPLICIT) {
+        error_setg(errp, "jit huge pages not supported");
+        return -1;
+    }
 
     /* page-align the beginning and end of the buffer */
     buf = static_code_gen_buffer;
@@ -512,6 +752,10 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
         error_setg(errp, "jit split-wx not supported");
         return -1;
     }
+    if (region.hugepages == TCG_CODE_HUGEPAGES_EXPLICIT) {
+        error_setg(errp, "jit huge pages not supported");
+        return -1;
+    }
 
     buf = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT,
                              PAGE_EXECUTE_READWRITE);
@@ -527,12 +771,47 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
     return PAGE_READ | PAGE_WRITE | PAGE_EXEC;
 }
 #else
+/*
+ * Map @size bytes of @fd, or anonymous memory if @fd is -1, at an address
+ * aligned to region.page_size so that the regions can use huge pages.
+ */
+static void *alloc_code_gen_mmap_aligned(size_t size, int prot, int flags,
+                                         int fd)
+{
+    /* Over-allocate so that the start can be aligned for huge pages.  */
+    size_t extra = region.page_size - qemu_real_host_page_size();
+    void *buf, *start;
+    int err;
+
+    if (extra == 0) {
+        return mmap(NULL, size, prot, flags, fd, 0);
+    }
+    buf = mmap(NULL, size + extra, PROT_NONE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (buf == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    start = QEMU_ALIGN_PTR_UP(buf, region.page_size);
+    if (mmap(start, size, prot, flags | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        err = errno;
+        munmap(buf, size + extra);
+        errno = err;
+        return MAP_FAILED;
+    }
+    if (start != buf) {
+        munmap(buf, start - buf);
+    }
+    if (start + size != buf + size + extra) {
+        munmap(start + size, buf + extra - start);
+    }
+    return start;
+}
+
 static int alloc_code_gen_buffer_anon(size_t size, int prot,
                                       int flags, Error **errp)
 {
-    void *buf;
+    void *buf = alloc_code_gen_mmap_aligned(size, prot, flags, -1);
 
-    buf = mmap(NULL, size, prot, flags, -1, 0);
     if (buf == MAP_FAILED) {
         error_setg_errno(errp, errno,
                          "allocate %zu bytes for jit buffer", size);
@@ -544,9 +823,79 @@ static int alloc_code_gen_buffer_anon(size_t size, int prot,
     return prot;
 }
 
-#ifndef CONFIG_TCG_INTERPRETER
 #ifdef CONFIG_POSIX
 #include "qemu/memfd.h"
+#include "qemu/mmap-alloc.h"
+
+/* Back the buffer with hugetlbfs pages, which must have been reserved.  */
+static int alloc_code_gen_buffer_hugetlb(size_t size, int splitwx,
+                                         Error **errp)
+{
+    void *buf_rw, *buf_rx;
+    int prot = PROT_READ | PROT_WRITE;
+    size_t hpage;
+    int fd;
+
+#ifdef CONFIG_TCG_INTERPRETER
+    if (splitwx > 0) {
+        error_setg(errp, "jit split-wx not supported");
+        return -1;
+    }
+    splitwx = 0;
+#else
+    if (!splitwx) {
+        prot |= PROT_EXEC;
+    }
+#endif
+
+    fd = qemu_memfd_create("tcg-jit", 0, true, 0, 0, errp);
+    if (fd < 0) {
+        return -1;
+    }
+    hpage = qemu_fd_getpagesize(fd);
+    size = QEMU_ALIGN_DOWN(size, hpage);
+    if (size == 0) {
+        error_setg(errp, "jit buffer is smaller than a huge page (%zu bytes)",
+                   hpage);
+        goto fail;
+    }
+    if (ftruncate(fd, size)) {
+        error_setg_errno(errp, errno, "failed to size jit buffer");
+        goto fail;
+    }
+
+    buf_rw = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if (buf_rw == MAP_FAILED) {
+        error_setg_errno(errp, errno,
+                         "allocate %zu bytes of huge pages for jit buffer",
+                         size);
+        goto fail;
+    }
+    if (splitwx) {
+        buf_rx = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        if (buf_rx == MAP_FAILED) {
+            error_setg_errno(errp, errno,
+                             "failed to map shared memory for execute");
+            munmap(buf_rw, size);
+            goto fail;
+        }
+        tcg_splitwx_diff = buf_rx - buf_rw;
+    }
+
+    close(fd);
+    region.start_aligned = buf_rw;
+    region.total_size = size;
+    region.page_size = hpage;
+    return prot;
+
+ fail:
+    close(fd);
+    return -1;
+}
+#endif /* CONFIG_POSIX */
+
+#ifndef CONFIG_TCG_INTERPRETER
+#ifdef CONFIG_POSIX
 
 static int alloc_code_gen_buffer_splitwx_memfd(size_t size, Error **errp)
 {
@@ -557,8 +906,20 @@ static int alloc_code_gen_buffer_splitwx_memfd(size_t size, Error **errp)
     if (buf_rw == NULL) {
         goto fail;
     }
+    if (!QEMU_PTR_IS_ALIGNED(buf_rw, region.page_size)) {
+        void *buf = alloc_code_gen_mmap_aligned(size, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED, fd);
+
+        if (buf == MAP_FAILED) {
+            goto fail_rw;
+        }
+        munmap(buf_rw, size);
+        buf_rw = buf;
+    }
 
-    buf_rx = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+    /* Aligned like the rw view, so that both can use huge pages.  */
+    buf_rx = alloc_code_gen_mmap_aligned(size, PROT_READ | PROT_EXEC,
+                                         MAP_SHARED, fd);
     if (buf_rx == MAP_FAILED) {
         goto fail_rx;
     }
@@ -570,6 +931,9 @@ static int alloc_code_gen_buffer_splitwx_memfd(size_t size, Error **errp)
 
     return PROT_READ | PROT_WRITE;
 
+ fail_rw:
+    error_setg_errno(errp, errno, "failed to align shared memory for write");
+    goto fail;
  fail_rx:
     error_setg_errno(errp, errno, "failed to map shared memory for execute");
  fail:
@@ -615,10 +979,11 @@ static int alloc_code_gen_buffer_splitwx_vmremap(size_t size, Error **errp)
 
     buf_rw = (mach_vm_address_t)region.start_aligned;
     buf_rx = 0;
+    /* Aligned like the rw view, so that both can use huge pages.  */
     ret = mach_vm_remap(mach_task_self(),
                         &buf_rx,
                         size,
-                        0,
+                        region.page_size - 1,
                         VM_FLAGS_ANYWHERE,
                         mach_task_self(),
                         buf_rw,
@@ -665,6 +1030,15 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
     ERRP_GUARD();
     int prot, flags;
 
+    if (region.hugepages == TCG_CODE_HUGEPAGES_EXPLICIT) {
+#ifdef CONFIG_POSIX
+        return alloc_code_gen_buffer_hugetlb(size, splitwx, errp);
+#else
+        error_setg(errp, "jit huge pages not supported");
+        return -1;
+#endif
+    }
+
     if (splitwx) {
         prot = alloc_code_gen_buffer_splitwx(size, errp);
         if (prot >= 0) {
@@ -699,6 +1073,30 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
 }
 #endif /* USE_STATIC_CODE_GEN_BUFFER, WIN32, POSIX */
 
+#define HPAGE_PMD_SIZE_PATH "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size"
+
+/* Return the size of transparent huge pages, as in virtio_mem_thp_size.  */
+static size_t tcg_thp_size(void)
+{
+    static size_t thp_size;
+    g_autofree char *content = NULL;
+    const char *endptr;
+    uint64_t tmp;
+
+    if (thp_size) {
+        return thp_size;
+    }
+    if (g_file_get_contents(HPAGE_PMD_SIZE_PATH, &content, NULL, NULL) &&
+        !qemu_strtou64(content, &endptr, 0, &tmp) &&
+        (!endptr || *endptr == '\n') &&
+        is_power_of_2(tmp) && tmp > qemu_real_host_page_size()) {
+        thp_size = tmp;
+    } else {
+        thp_size = 2 * MiB;
+    }
+    return thp_size;
+}
+
 /*
  * Initializes region partitioning.
  *
@@ -710,27 +1108,37 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG we use a single context, which
+ * moves on to the next region as each fills up.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
  *
- * In user-mode we use a single region.  Having multiple regions in user-mode
- * is not supported, because the number of vCPU threads (recall that each thread
- * spawned by the guest corresponds to a vCPU thread) is only bounded by the
- * OS, and usually this number is huge (tens of thousands is not uncommon).
- * Thus, given this large bound on the number of vCPU threads and the fact
- * that code_gen_buffer is allocated at compile-time, we cannot guarantee
- * that the availability of at least one region per vCPU thread.
+ * In user-mode we use a single context.  Having one context per vCPU thread
+ * in user-mode is not supported, because the number of vCPU threads (recall
+ * that each thread spawned by the guest corresponds to a vCPU thread) is only
+ * bounded by the OS, and usually this number is huge (tens of thousands is
+ * not uncommon).  Thus, given this large bound on the number of vCPU threads
+ * and the fact that code_gen_buffer is allocated at compile-time, we cannot
+ * guarantee that the availability of at least one region per vCPU thread.
  *
  * However, this user-mode limitation is unlikely to be a significant problem
  * in practice. Multi-threaded guests share most if not all of their translated
  * code, which makes parallel code generation less appealing than in softmmu.
+ *
+ * By default the buffer is only hinted to use transparent huge pages, and
+ * each region keeps its guard page.  When huge pages are requested, the
+ * buffer is backed with transparent or explicit (hugetlbfs) huge pages to
+ * reduce iTLB misses; the regions, and both views with split-wx, are then
+ * aligned to the huge page size and have no guard pages.  With @numa, each
+ * region is moved to the host NUMA node of the vCPU thread that is
+ * assigned it.
  */
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_region_init(size_t tb_size, int splitwx, TCGCodeHugePages hugepages,
+                     bool numa, unsigned max_cpus)
 {
     const size_t page_size = qemu_real_host_page_size();
-    size_t region_size;
+    size_t region_size, guard_size;
     int have_prot, need_prot;
 
     /* Size the buffer.  */
@@ -749,15 +1157,36 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
     if (tb_size > MAX_CODE_GEN_BUFFER_SIZE) {
         tb_size = MAX_CODE_GEN_BUFFER_SIZE;
     }
+    region.n = tcg_n_regions(tb_size, max_cpus);
+
+    /*
+     * With transparent huge pages, align the buffer and the regions to
+     * the huge page size, unless the regions would be smaller than that.
+     * Explicit huge pages set page_size when the buffer is allocated.
+     */
+    region.hugepages = hugepages;
+    region.numa = numa;
+    region.page_size = page_size;
+    if (hugepages == TCG_CODE_HUGEPAGES_TRANSPARENT &&
+        QEMU_MADV_HUGEPAGE != QEMU_MADV_INVALID &&
+        tb_size / region.n >= tcg_thp_size()) {
+        region.page_size = tcg_thp_size();
+        tb_size = QEMU_ALIGN_DOWN(tb_size, region.page_size);
+    }
 
     have_prot = alloc_code_gen_buffer(tb_size, splitwx, &error_fatal);
     assert(have_prot >= 0);
 
-    /* Request large pages for the buffer and the splitwx.  */
-    qemu_madvise(region.start_aligned, region.total_size, QEMU_MADV_HUGEPAGE);
-    if (tcg_splitwx_diff) {
-        qemu_madvise(region.start_aligned + tcg_splitwx_diff,
-                     region.total_size, QEMU_MADV_HUGEPAGE);
+    /* Request large pages for the buffer and the splitwx, or avoid them.  */
+    if (hugepages != TCG_CODE_HUGEPAGES_EXPLICIT) {
+        int advice = hugepages == TCG_CODE_HUGEPAGES_OFF
+                     ? QEMU_MADV_NOHUGEPAGE : QEMU_MADV_HUGEPAGE;
+
+        qemu_madvise(region.start_aligned, region.total_size, advice);
+        if (tcg_splitwx_diff) {
+            qemu_madvise(region.start_aligned + tcg_splitwx_diff,
+                         region.total_size, advice);
+        }
     }
 
     /*
@@ -765,17 +1194,25 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
      * As a result of this we might end up with a few extra pages at the end of
      * the buffer; we will assign those to the last region.
      */
-    region.n = tcg_n_regions(tb_size, max_cpus);
-    region_size = tb_size / region.n;
-    region_size = QEMU_ALIGN_DOWN(region_size, page_size);
-
-    /* A region must have at least 2 pages; one code, one guard */
-    g_assert(region_size >= 2 * page_size);
+    region_size = region.total_size / region.n;
+    region_size = QEMU_ALIGN_DOWN(region_size, region.page_size);
+    if (region_size < region.page_size) {
+        error_report("jit buffer of %zu bytes is too small for %zu regions "
+                     "of %zu byte huge pages", region.total_size, region.n,
+                     region.page_size);
+        exit(1);
+    }
     region.stride = region_size;
 
-    /* Reserve space for guard pages. */
-    region.size = region_size - page_size;
-    region.total_size -= page_size;
+    /*
+     * Reserve space for guard pages, except with huge pages, which a
+     * guard page would split.
+     */
+    guard_size = region.page_size == page_size ? page_size : 0;
+    /* A region must have at least 2 pages; one code, one guard */
+    g_assert(region_size >= guard_size + page_size);
+    region.size = region_size - guard_size;
+    region.total_size -= guard_size;
 
     /*
      * The first region will be smaller than the others, via the prologue,
@@ -786,6 +1223,12 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.evicted = bitmap_new(region.n);
+    region.stamp = g_new0(unsigned, region.n);
+    region.node = g_new(int, region.n);
+    for (size_t i = 0; i < region.n; i++) {
+        region.node[i] = -1;
+    }
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
@@ -818,9 +1261,9 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
                                  "mprotect of jit buffer");
             }
         }
-        if (have_prot != 0) {
+        if (have_prot != 0 && guard_size) {
             /* Guard pages are nice for bug detection but are not essential. */
-            (void)qemu_mprotect_none(end, page_size);
+            (void)qemu_mprotect_none(end, guard_size);
         }
     }
 
@@ -893,3 +1336,30 @@ size_t tcg_code_capacity(void)
 
     return capacity;
 }
+
+void tcg_region_dump_info(GString *buf)
+{
+    size_t i;
+
+    g_string_append_printf(buf, "code regions        %zu x %zu KiB\n",
+                           region.n, region.size / KiB);
+    g_string_append_printf(buf, "code page size      %zu KiB%s\n",
+                           region.page_size / KiB,
+                           region.page_size == qemu_real_host_page_size()
+                           ? ""
+                           : region.hugepages == TCG_CODE_HUGEPAGES_EXPLICIT
+                           ? " (hugetlbfs)" : " (transparent huge pages)");
+    if (region.numa) {
+        g_string_append_printf(buf, "code region nodes  ");
+        for (i = 0; i < region.n; i++) {
+            int node = qatomic_read(&region.node[i]);
+
+            if (node < 0) {
+                g_string_append_printf(buf, " -");
+            } else {
+                g_string_append_printf(buf, " %d", node);
+            }
+        }
+        g_string_append_printf(buf, "\n");
+    }
+}
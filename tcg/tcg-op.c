@@ -23,6 +23,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/cacheinfo.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg.h"
 #include "tcg/tcg-op.h"
@@ -2791,6 +2792,146 @@ void tcg_gen_lookup_and_goto_ptr(void)
     tcg_temp_free_ptr(ptr);
 }
 
+void tcg_gen_lookup_and_goto_ptr_pred(const TranslationBlock *tb, TCGv pc)
+{
+    /* The code of a TB follows it in the code buffer, see tcg_tb_alloc. */
+    intptr_t code_ofs = ROUND_UP(sizeof(TranslationBlock),
+                                 qemu_icache_linesize) + tcg_splitwx_diff;
+    TCGLabel *miss;
+    TCGv_ptr ptr;
+    TCGv next_pc, pred_pc;
+
+    if (tcg_ctx->tb_cflags & (CF_NO_GOTO_TB | CF_NO_GOTO_PTR)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    plugin_gen_disable_mem_helpers();
+    miss = gen_new_label();
+    ptr = tcg_temp_local_new_ptr();
+    next_pc = tcg_temp_local_new();
+    pred_pc = tcg_temp_new();
+
+    tcg_gen_mov_tl(next_pc, pc);
+    tcg_gen_ld_ptr(ptr, tcg_constant_ptr(&tb->jmp_pred), 0);
+    tcg_gen_brcondi_ptr(TCG_COND_EQ, ptr, 0, miss);
+    tcg_gen_ld_tl(pred_pc, ptr, offsetof(TranslationBlock, pc));
+    tcg_gen_brcond_tl(TCG_COND_NE, pred_pc, next_pc, miss);
+    tcg_gen_addi_ptr(ptr, ptr, code_ofs);
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+
+    gen_set_label(miss);
+    gen_helper_lookup_tb_ptr_pred(ptr, cpu_env, tcg_constant_ptr(tb));
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+
+    tcg_temp_free(pred_pc);
+    tcg_temp_free(next_pc);
+    tcg_temp_free_ptr(ptr);
+}
+
+/* Offset of the return stack from cpu_env, see CPURetStack. */
+#define RET_STACK_OFS \
+    ((int)offsetof(ArchCPU, neg.ret_stack) - (int)offsetof(ArchCPU, env))
+#define RET_STACK_MASK  (sizeof(((CPURetStack *)0)->e) - 1)
+
+QEMU_BUILD_BUG_ON(!is_power_of_2(sizeof(CPURetStackEntry)));
+
+/* Load the address of the top entry of the return stack into @ptr. */
+static void gen_ret_stack_top(TCGv_ptr ptr, TCGv_i32 top)
+{
+    tcg_gen_ld_i32(top, cpu_env, RET_STACK_OFS + offsetof(CPURetStack, top));
+    tcg_gen_ext_i32_ptr(ptr, top);
+    tcg_gen_add_ptr(ptr, ptr, cpu_env);
+}
+
+void tcg_gen_ret_push(const TranslationBlock *tb, target_ulong ret_pc)
+{
+    TCGv_i32 top;
+    TCGv_ptr ptr;
+
+    if (tcg_ctx->tb_cflags & (CF_NO_GOTO_TB | CF_NO_GOTO_PTR)) {
+        return;
+    }
+
+    top = tcg_temp_new_i32();
+    ptr = tcg_temp_new_ptr();
+
+    tcg_gen_ld_i32(top, cpu_env, RET_STACK_OFS + offsetof(CPURetStack, top));
+    tcg_gen_addi_i32(top, top, sizeof(CPURetStackEntry));
+    tcg_gen_andi_i32(top, top, RET_STACK_MASK);
+    tcg_gen_st_i32(top, cpu_env, RET_STACK_OFS + offsetof(CPURetStack, top));
+    tcg_gen_ext_i32_ptr(ptr, top);
+    tcg_gen_add_ptr(ptr, ptr, cpu_env);
+    tcg_gen_st_tl(tcg_constant_tl(ret_pc), ptr,
+                  RET_STACK_OFS + offsetof(CPURetStackEntry, pc));
+    tcg_gen_st_ptr(tcg_constant_ptr(tb), ptr,
+                   RET_STACK_OFS + offsetof(CPURetStackEntry, tb));
+
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(top);
+}
+
+void tcg_gen_lookup_and_goto_ptr_ret(const TranslationBlock *tb, TCGv pc)
+{
+    /* The code of a TB follows it in the code buffer, see tcg_tb_alloc. */
+    intptr_t code_ofs = ROUND_UP(sizeof(TranslationBlock),
+                                 qemu_icache_linesize) + tcg_splitwx_diff;
+    TCGLabel *miss;
+    TCGv_i32 top, flags;
+    TCGv_ptr ptr, call_tb;
+    TCGv ret_pc, cs_base;
+
+    if (tcg_ctx->tb_cflags & (CF_NO_GOTO_TB | CF_NO_GOTO_PTR)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    plugin_gen_disable_mem_helpers();
+    miss = gen_new_label();
+    top = tcg_temp_new_i32();
+    flags = tcg_temp_new_i32();
+    ptr = tcg_temp_local_new_ptr();
+    call_tb = tcg_temp_local_new_ptr();
+    ret_pc = tcg_temp_local_new();
+    cs_base = tcg_temp_new();
+
+    /* Pop the top entry, which is only a prediction of the return. */
+    gen_ret_stack_top(ptr, top);
+    tcg_gen_ld_tl(ret_pc, ptr, RET_STACK_OFS + offsetof(CPURetStackEntry, pc));
+    tcg_gen_ld_ptr(call_tb, ptr,
+                   RET_STACK_OFS + offsetof(CPURetStackEntry, tb));
+    tcg_gen_subi_i32(top, top, sizeof(CPURetStackEntry));
+    tcg_gen_andi_i32(top, top, RET_STACK_MASK);
+    tcg_gen_st_i32(top, cpu_env, RET_STACK_OFS + offsetof(CPURetStack, top));
+
+    /*
+     * The pc of the TB following the call is the return address, and its
+     * cflags are those of the calling TB; see helper_lookup_tb_ptr_ret.
+     * Its cs_base and flags must still be checked against this TB.
+     */
+    tcg_gen_brcond_tl(TCG_COND_NE, ret_pc, pc, miss);
+    tcg_gen_brcondi_ptr(TCG_COND_EQ, call_tb, 0, miss);
+    tcg_gen_ld_ptr(ptr, call_tb, offsetof(TranslationBlock, jmp_ret));
+    tcg_gen_brcondi_ptr(TCG_COND_EQ, ptr, 0, miss);
+    tcg_gen_ld_i32(flags, ptr, offsetof(TranslationBlock, flags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, flags, tb->flags, miss);
+    tcg_gen_ld_tl(cs_base, ptr, offsetof(TranslationBlock, cs_base));
+    tcg_gen_brcondi_tl(TCG_COND_NE, cs_base, tb->cs_base, miss);
+    tcg_gen_addi_ptr(ptr, ptr, code_ofs);
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+
+    gen_set_label(miss);
+    gen_helper_lookup_tb_ptr_ret(ptr, cpu_env, call_tb, ret_pc);
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+
+    tcg_temp_free(cs_base);
+    tcg_temp_free(ret_pc);
+    tcg_temp_free_ptr(call_tb);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(flags);
+    tcg_temp_free_i32(top);
+}
+
 static inline MemOp tcg_canonicalize_memop(MemOp op, bool is64, bool st)
 {
     /* Trigger the asserts within as early as possible.  */
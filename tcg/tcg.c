@@ -152,6 +152,7 @@ static bool tcg_out_sti(TCGContext *s, TCGType type, TCGArg val,
 #ifdef CONFIG_TCG_INTERPRETER
 static void tcg_out_call(TCGContext *s, const tcg_insn_unit *target,
                          ffi_cif *cif);
+static void tcg_out_fuse_reset(TCGContext *s);
 #else
 static void tcg_out_call(TCGContext *s, const tcg_insn_unit *target);
 #endif
@@ -277,6 +278,10 @@ static void tcg_out_label(TCGContext *s, TCGLabel *l)
     tcg_debug_assert(!l->has_value);
     l->has_value = 1;
     l->u.value_ptr = tcg_splitwx_to_rx(s->code_ptr);
+#ifdef CONFIG_TCG_INTERPRETER
+    /* Nothing before a branch target may be fused with what follows it. */
+    tcg_out_fuse_reset(s);
+#endif
 }
 
 TCGLabel *gen_new_label(void)
@@ -689,10 +694,11 @@ static void tcg_context_init(unsigned max_cpus)
     cpu_env = temp_tcgv_ptr(ts);
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_init(size_t tb_size, int splitwx, TCGCodeHugePages hugepages,
+              bool numa, unsigned max_cpus)
 {
     tcg_context_init(max_cpus);
-    tcg_region_init(tb_size, splitwx, max_cpus);
+    tcg_region_init(tb_size, splitwx, hugepages, numa, max_cpus);
 }
 
 /*
@@ -3162,6 +3168,9 @@ static void temp_sync(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs,
             if (free_or_dead
                 && tcg_out_sti(s, ts->type, ts->val,
                                ts->mem_base->reg, ts->mem_offset)) {
+#ifdef CONFIG_PROFILER
+                qatomic_set(&s->prof.sync_count, s->prof.sync_count + 1);
+#endif
                 break;
             }
             temp_load(s, ts, tcg_target_available_regs[ts->type],
@@ -3171,6 +3180,9 @@ static void temp_sync(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs,
         case TEMP_VAL_REG:
             tcg_out_st(s, ts->type, ts->reg,
                        ts->mem_base->reg, ts->mem_offset);
+#ifdef CONFIG_PROFILER
+            qatomic_set(&s->prof.sync_count, s->prof.sync_count + 1);
+#endif
             break;
 
         case TEMP_VAL_MEM:
@@ -3192,10 +3204,31 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
 {
     TCGTemp *ts = s->reg_to_temp[reg];
     if (ts != NULL) {
+#ifdef CONFIG_PROFILER
+        if (!temp_readonly(ts) && !ts->mem_coherent) {
+            qatomic_set(&s->prof.spill_count, s->prof.spill_count + 1);
+        }
+#endif
         temp_sync(s, ts, allocated_regs, 0, -1);
     }
 }
 
+/*
+ * The cost of evicting the temp held in @reg.  A constant is simply
+ * rematerialized at its next use, and a temp that is coherent with
+ * memory only needs to be reloaded; anything else needs a store now
+ * as well as a load later.
+ */
+static int tcg_reg_spill_cost(TCGContext *s, TCGReg reg)
+{
+    TCGTemp *ts = s->reg_to_temp[reg];
+
+    if (ts == NULL || temp_readonly(ts)) {
+        return 0;
+    }
+    return ts->mem_coherent ? 1 : 2;
+}
+
 /**
  * tcg_reg_alloc:
  * @required_regs: Set of registers in which we must allocate.
@@ -3245,7 +3278,7 @@ static TCGReg tcg_reg_alloc(TCGContext *s, TCGRegSet required_regs,
         }
     }
 
-    /* We must spill something.  */
+    /* We must spill something: choose the cheapest temp to evict.  */
     for (j = f; j < 2; j++) {
         TCGRegSet set = reg_ct[j];
 
@@ -3255,13 +3288,26 @@ static TCGReg tcg_reg_alloc(TCGContext *s, TCGRegSet required_regs,
             tcg_reg_free(s, reg, allocated_regs);
             return reg;
         } else {
+            int best_cost = INT_MAX;
+            TCGReg best = 0;
+
             for (i = 0; i < n; i++) {
                 TCGReg reg = order[i];
                 if (tcg_regset_test_reg(set, reg)) {
-                    tcg_reg_free(s, reg, allocated_regs);
-                    return reg;
+                    int cost = tcg_reg_spill_cost(s, reg);
+                    if (cost < best_cost) {
+                        best = reg;
+                        best_cost = cost;
+                        if (cost == 0) {
+                            break;
+                        }
+                    }
                 }
             }
+            if (best_cost != INT_MAX) {
+                tcg_reg_free(s, best, allocated_regs);
+                return best;
+            }
         }
     }
 
@@ -3309,6 +3355,9 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
                             preferred_regs, ts->indirect_base);
         tcg_out_ld(s, ts->type, reg, ts->mem_base->reg, ts->mem_offset);
         ts->mem_coherent = 1;
+#ifdef CONFIG_PROFILER
+        qatomic_set(&s->prof.fill_count, s->prof.fill_count + 1);
+#endif
         break;
     case TEMP_VAL_DEAD:
     default:
@@ -4115,6 +4164,11 @@ void tcg_profile_snapshot(TCGProfile *prof, bool counters, bool table)
             PROF_ADD(prof, orig, temp_count);
             PROF_MAX(prof, orig, temp_count_max);
             PROF_ADD(prof, orig, del_op_count);
+            PROF_ADD(prof, orig, spill_count);
+            PROF_ADD(prof, orig, sync_count);
+            PROF_ADD(prof, orig, fill_count);
+            PROF_ADD(prof, orig, gvn_count);
+            PROF_ADD(prof, orig, ld_fwd_count);
             PROF_ADD(prof, orig, code_in_len);
             PROF_ADD(prof, orig, code_out_len);
             PROF_ADD(prof, orig, search_out_len);
@@ -4250,6 +4304,9 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     qatomic_set(&prof->opt_time, prof->opt_time - profile_getclock());
 #endif
 
+    s->opt_gvn_count = 0;
+    s->opt_ld_fwd_count = 0;
+
 #ifdef USE_TCG_OPTIMIZATIONS
     tcg_optimize(s);
 #endif
@@ -4292,6 +4349,8 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
         FILE *logfile = qemu_log_trylock();
         if (logfile) {
             fprintf(logfile, "OP after optimization and liveness analysis:\n");
+            fprintf(logfile, " -- redundant ops %d, forwarded loads %d\n",
+                    s->opt_gvn_count, s->opt_ld_fwd_count);
             tcg_dump_ops(s, logfile, true);
             fprintf(logfile, "\n");
             qemu_log_unlock(logfile);
@@ -4315,6 +4374,9 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 #ifdef TCG_TARGET_NEED_POOL_LABELS
     s->pool_labels = NULL;
 #endif
+#ifdef CONFIG_TCG_INTERPRETER
+    tcg_out_fuse_reset(s);
+#endif
 
     num_insns = -1;
     QTAILQ_FOREACH(op, &s->ops, link) {
@@ -4450,6 +4512,17 @@ void tcg_dump_info(GString *buf)
     g_string_append_printf(buf, "avg temps/TB        %0.2f max=%d\n",
                            (double)s->temp_count / tb_div_count,
                            s->temp_count_max);
+    g_string_append_printf(buf, "redundant ops/TB    %0.2f\n",
+                           (double)s->gvn_count / tb_div_count);
+    g_string_append_printf(buf, "forwarded loads/TB  %0.2f\n",
+                           (double)s->ld_fwd_count / tb_div_count);
+    g_string_append_printf(buf, "avg spills/TB       %0.2f\n",
+                           (double)s->spill_count / tb_div_count);
+    g_string_append_printf(buf, "avg syncs/TB        %0.2f\n",
+                           (double)(s->sync_count - s->spill_count)
+                           / tb_div_count);
+    g_string_append_printf(buf, "avg fills/TB        %0.2f\n",
+                           (double)s->fill_count / tb_div_count);
     g_string_append_printf(buf, "avg host code/TB    %0.1f\n",
                            (double)s->code_out_len / tb_div_count);
     g_string_append_printf(buf, "avg search data/TB  %0.1f\n",
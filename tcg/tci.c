@@ -104,6 +104,21 @@ static void tci_args_ri(uint32_t insn, TCGReg *r0, tcg_target_ulong *i1)
     *i1 = sextract32(insn, 12, 20);
 }
 
+/*
+ * As above, but with the label in the following insn word, relative to
+ * the end of that word.  Consumes the extra word from *tb_ptr.
+ */
+static void tci_args_rrcl(uint32_t insn, const uint32_t **tb_ptr,
+                          TCGReg *r0, TCGReg *r1, TCGCond *c2, void **l3)
+{
+    uint32_t ext = *(*tb_ptr)++;
+
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *c2 = extract32(insn, 16, 4);
+    *l3 = sextract32(ext, 12, 20) + (void *)*tb_ptr;
+}
+
 static void tci_args_rrm(uint32_t insn, TCGReg *r0,
                          TCGReg *r1, MemOpIdx *m2)
 {
@@ -458,6 +473,35 @@ static void tci_qemu_st(CPUArchState *env, target_ulong taddr, uint64_t val,
 # define CASE_64(x)
 #endif
 
+/*
+ * Threaded dispatch: the frequent instructions end by jumping straight
+ * to the handler of the next one, so that each of them has an indirect
+ * branch of its own for the host to predict, instead of all sharing the
+ * one at the top of the switch.  Every other opcode goes back through
+ * the switch.
+ */
+#define TCI_NEXT()                              \
+    do {                                        \
+        insn = *tb_ptr++;                       \
+        opc = extract32(insn, 0, 8);            \
+        goto *tci_dispatch[opc];                \
+    } while (0)
+
+/*
+ * A load from env followed by an arithmetic operation.  The first insn
+ * word is the load with its opcode replaced, the second one is the
+ * unchanged arithmetic insn (see tcg_out_fuse_ld).
+ */
+#define CASE_TCI_LD_ARITH(NAME, TYPE, OP)               \
+        case glue(INDEX_op_tci_, NAME):                 \
+        glue(tci_op_, NAME):                            \
+            tci_args_rrs(insn, &r0, &r1, &ofs);         \
+            ptr = (void *)(regs[r1] + ofs);             \
+            regs[r0] = *(TYPE *)ptr;                    \
+            tci_args_rrr(*tb_ptr++, &r0, &r1, &r2);     \
+            regs[r0] = regs[r1] OP regs[r2];            \
+            TCI_NEXT();
+
 /* Interpret pseudo code in tb. */
 /*
  * Disable CFI checks.
@@ -472,6 +516,50 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
     uint64_t stack[(TCG_STATIC_CALL_ARGS_SIZE + TCG_STATIC_FRAME_SIZE)
                    / sizeof(uint64_t)];
     void *call_slots[TCG_STATIC_CALL_ARGS_SIZE / sizeof(uint64_t)];
+    static const void * const tci_dispatch[NB_OPS] = {
+        [0 ... NB_OPS - 1] = &&tci_switch,
+        [INDEX_op_br] = &&tci_op_br,
+        [INDEX_op_setcond_i32] = &&tci_op_setcond_i32,
+        [INDEX_op_mov_i32] = &&tci_op_mov,
+        [INDEX_op_tci_movi] = &&tci_op_tci_movi,
+        [INDEX_op_tci_movl] = &&tci_op_tci_movl,
+        [INDEX_op_ld_i32] = &&tci_op_ld_i32,
+        [INDEX_op_st_i32] = &&tci_op_st_i32,
+        [INDEX_op_add_i32] = &&tci_op_add,
+        [INDEX_op_sub_i32] = &&tci_op_sub,
+        [INDEX_op_and_i32] = &&tci_op_and,
+        [INDEX_op_or_i32] = &&tci_op_or,
+        [INDEX_op_xor_i32] = &&tci_op_xor,
+        [INDEX_op_tci_brcond_i32] = &&tci_op_tci_brcond_i32,
+        [INDEX_op_tci_ld32_add] = &&tci_op_ld32_add,
+        [INDEX_op_tci_ld32_sub] = &&tci_op_ld32_sub,
+        [INDEX_op_tci_ld32_and] = &&tci_op_ld32_and,
+        [INDEX_op_tci_ld32_or] = &&tci_op_ld32_or,
+        [INDEX_op_tci_ld32_xor] = &&tci_op_ld32_xor,
+#if TCG_TARGET_REG_BITS == 64
+        [INDEX_op_mov_i64] = &&tci_op_mov,
+        [INDEX_op_ld32u_i64] = &&tci_op_ld_i32,
+        [INDEX_op_st32_i64] = &&tci_op_st_i32,
+        [INDEX_op_ld_i64] = &&tci_op_ld_i64,
+        [INDEX_op_st_i64] = &&tci_op_st_i64,
+        [INDEX_op_add_i64] = &&tci_op_add,
+        [INDEX_op_sub_i64] = &&tci_op_sub,
+        [INDEX_op_and_i64] = &&tci_op_and,
+        [INDEX_op_or_i64] = &&tci_op_or,
+        [INDEX_op_xor_i64] = &&tci_op_xor,
+        [INDEX_op_tci_brcond_i64] = &&tci_op_tci_brcond_i64,
+        [INDEX_op_tci_ld64_add] = &&tci_op_ld64_add,
+        [INDEX_op_tci_ld64_sub] = &&tci_op_ld64_sub,
+        [INDEX_op_tci_ld64_and] = &&tci_op_ld64_and,
+        [INDEX_op_tci_ld64_or] = &&tci_op_ld64_or,
+        [INDEX_op_tci_ld64_xor] = &&tci_op_ld64_xor,
+#endif
+        [INDEX_op_goto_tb] = &&tci_op_goto_tb,
+        [INDEX_op_qemu_ld_i32] = &&tci_op_qemu_ld_i32,
+        [INDEX_op_qemu_ld_i64] = &&tci_op_qemu_ld_i64,
+        [INDEX_op_qemu_st_i32] = &&tci_op_qemu_st_i32,
+        [INDEX_op_qemu_st_i64] = &&tci_op_qemu_st_i64,
+    };
 
     regs[TCG_AREG0] = (tcg_target_ulong)env;
     regs[TCG_REG_CALL_STACK] = (uintptr_t)stack;
@@ -497,6 +585,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
         insn = *tb_ptr++;
         opc = extract32(insn, 0, 8);
 
+    tci_switch:
         switch (opc) {
         case INDEX_op_call:
             /*
@@ -548,13 +637,15 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 
         case INDEX_op_br:
+        tci_op_br:
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = ptr;
-            continue;
+            TCI_NEXT();
         case INDEX_op_setcond_i32:
+        tci_op_setcond_i32:
             tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
             regs[r0] = tci_compare32(regs[r1], regs[r2], condition);
-            break;
+            TCI_NEXT();
         case INDEX_op_movcond_i32:
             tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
             tmp32 = tci_compare32(regs[r1], regs[r2], condition);
@@ -579,17 +670,20 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         CASE_32_64(mov)
+        tci_op_mov:
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = regs[r1];
-            break;
+            TCI_NEXT();
         case INDEX_op_tci_movi:
+        tci_op_tci_movi:
             tci_args_ri(insn, &r0, &t1);
             regs[r0] = t1;
-            break;
+            TCI_NEXT();
         case INDEX_op_tci_movl:
+        tci_op_tci_movl:
             tci_args_rl(insn, tb_ptr, &r0, &ptr);
             regs[r0] = *(tcg_target_ulong *)ptr;
-            break;
+            TCI_NEXT();
 
             /* Load/store operations (32 bit). */
 
@@ -615,10 +709,11 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
         case INDEX_op_ld_i32:
         CASE_64(ld32u)
+        tci_op_ld_i32:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint32_t *)ptr;
-            break;
+            TCI_NEXT();
         CASE_32_64(st8)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
@@ -631,37 +726,55 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
         case INDEX_op_st_i32:
         CASE_64(st32)
+        tci_op_st_i32:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint32_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (mixed 32/64 bit). */
 
         CASE_32_64(add)
+        tci_op_add:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] + regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(sub)
+        tci_op_sub:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] - regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(mul)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] * regs[r2];
             break;
         CASE_32_64(and)
+        tci_op_and:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] & regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(or)
+        tci_op_or:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] | regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(xor)
+        tci_op_xor:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] ^ regs[r2];
-            break;
+            TCI_NEXT();
+        CASE_TCI_LD_ARITH(ld32_add, uint32_t, +)
+        CASE_TCI_LD_ARITH(ld32_sub, uint32_t, -)
+        CASE_TCI_LD_ARITH(ld32_and, uint32_t, &)
+        CASE_TCI_LD_ARITH(ld32_or, uint32_t, |)
+        CASE_TCI_LD_ARITH(ld32_xor, uint32_t, ^)
+#if TCG_TARGET_REG_BITS == 64
+        CASE_TCI_LD_ARITH(ld64_add, uint64_t, +)
+        CASE_TCI_LD_ARITH(ld64_sub, uint64_t, -)
+        CASE_TCI_LD_ARITH(ld64_and, uint64_t, &)
+        CASE_TCI_LD_ARITH(ld64_or, uint64_t, |)
+        CASE_TCI_LD_ARITH(ld64_xor, uint64_t, ^)
+#endif
 #if TCG_TARGET_HAS_andc_i32 || TCG_TARGET_HAS_andc_i64
         CASE_32_64(andc)
             tci_args_rrr(insn, &r0, &r1, &r2);
@@ -780,6 +893,13 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                 tb_ptr = ptr;
             }
             break;
+        case INDEX_op_tci_brcond_i32:
+        tci_op_tci_brcond_i32:
+            tci_args_rrcl(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare32(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            TCI_NEXT();
 #if TCG_TARGET_REG_BITS == 32 || TCG_TARGET_HAS_add2_i32
         case INDEX_op_add2_i32:
             tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
@@ -868,15 +988,17 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             regs[r0] = *(int32_t *)ptr;
             break;
         case INDEX_op_ld_i64:
+        tci_op_ld_i64:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint64_t *)ptr;
-            break;
+            TCI_NEXT();
         case INDEX_op_st_i64:
+        tci_op_st_i64:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint64_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (64 bit). */
 
@@ -993,6 +1115,13 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                 tb_ptr = ptr;
             }
             break;
+        case INDEX_op_tci_brcond_i64:
+        tci_op_tci_brcond_i64:
+            tci_args_rrcl(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare64(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            TCI_NEXT();
         case INDEX_op_ext32s_i64:
         case INDEX_op_ext_i32_i64:
             tci_args_rr(insn, &r0, &r1);
@@ -1018,9 +1147,10 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             return (uintptr_t)ptr;
 
         case INDEX_op_goto_tb:
+        tci_op_goto_tb:
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = *(void **)ptr;
-            break;
+            TCI_NEXT();
 
         case INDEX_op_goto_ptr:
             tci_args_r(insn, &r0);
@@ -1032,6 +1162,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 
         case INDEX_op_qemu_ld_i32:
+        tci_op_qemu_ld_i32:
             if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1041,9 +1172,10 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             }
             tmp32 = tci_qemu_ld(env, taddr, oi, tb_ptr);
             regs[r0] = tmp32;
-            break;
+            TCI_NEXT();
 
         case INDEX_op_qemu_ld_i64:
+        tci_op_qemu_ld_i64:
             if (TCG_TARGET_REG_BITS == 64) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1061,9 +1193,10 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             } else {
                 regs[r0] = tmp64;
             }
-            break;
+            TCI_NEXT();
 
         case INDEX_op_qemu_st_i32:
+        tci_op_qemu_st_i32:
             if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1073,9 +1206,10 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             }
             tmp32 = regs[r0];
             tci_qemu_st(env, taddr, tmp32, oi, tb_ptr);
-            break;
+            TCI_NEXT();
 
         case INDEX_op_qemu_st_i64:
+        tci_op_qemu_st_i64:
             if (TCG_TARGET_REG_BITS == 64) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1092,7 +1226,7 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                 tmp64 = tci_uint64(regs[r1], regs[r0]);
             }
             tci_qemu_st(env, taddr, tmp64, oi, tb_ptr);
-            break;
+            TCI_NEXT();
 
         case INDEX_op_mb:
             /* Ensure ordering for all kinds */
@@ -1194,6 +1328,13 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
                            op_name, str_r(r0), ptr);
         break;
 
+    case INDEX_op_tci_brcond_i32:
+    case INDEX_op_tci_brcond_i64:
+        tci_args_rrcl(insn, &tb_ptr, &r0, &r1, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_c(c), ptr);
+        return 2 * sizeof(insn);
+
     case INDEX_op_setcond_i32:
     case INDEX_op_setcond_i64:
         tci_args_rrrc(insn, &r0, &r1, &r2, &c);
@@ -1225,6 +1366,16 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
     case INDEX_op_ld32s_i64:
     case INDEX_op_ld_i32:
     case INDEX_op_ld_i64:
+    case INDEX_op_tci_ld32_add:
+    case INDEX_op_tci_ld32_sub:
+    case INDEX_op_tci_ld32_and:
+    case INDEX_op_tci_ld32_or:
+    case INDEX_op_tci_ld32_xor:
+    case INDEX_op_tci_ld64_add:
+    case INDEX_op_tci_ld64_sub:
+    case INDEX_op_tci_ld64_and:
+    case INDEX_op_tci_ld64_or:
+    case INDEX_op_tci_ld64_xor:
     case INDEX_op_st8_i32:
     case INDEX_op_st8_i64:
     case INDEX_op_st16_i32:
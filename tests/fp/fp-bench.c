@@ -34,6 +34,9 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_TO_INT,
+    OP_FROM_INT,
+    OP_CVT,
     OP_MAX_NR,
 };
 
@@ -45,6 +48,9 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_TO_INT] = "toInt",
+    [OP_FROM_INT] = "fromInt",
+    [OP_CVT] = "cvt",
     [OP_MAX_NR] = NULL,
 };
 
@@ -52,9 +58,13 @@ enum precision {
     PREC_SINGLE,
     PREC_DOUBLE,
     PREC_QUAD,
+    PREC_HALF,
+    PREC_BF16,
     PREC_FLOAT32,
     PREC_FLOAT64,
     PREC_FLOAT128,
+    PREC_FLOAT16,
+    PREC_BFLOAT16,
     PREC_MAX_NR,
 };
 
@@ -90,6 +100,8 @@ static const char * const tester_names[] = {
 union fp {
     float f;
     double d;
+    float16 f16;
+    bfloat16 bf16;
     float32 f32;
     float64 f64;
     float128 f128;
@@ -127,6 +139,8 @@ static enum op operation;
 static enum tester tester;
 static uint64_t n_completed_ops;
 static unsigned int duration = DEFAULT_DURATION_SECS;
+/* clear the exception flags before each soft-fp operation */
+static bool clear_flags;
 static int64_t ns_elapsed;
 /* disable optimizations with volatile */
 static volatile union fp res;
@@ -151,6 +165,26 @@ static void update_random_ops(int n_ops, enum precision prec)
     for (i = 0; i < n_ops; i++) {
 
         switch (prec) {
+        case PREC_HALF:
+        case PREC_FLOAT16:
+        {
+            uint64_t r = random_ops[i];
+            do {
+                r = xorshift64star(r);
+            } while (!float16_is_normal(r));
+            random_ops[i] = r;
+            break;
+        }
+        case PREC_BF16:
+        case PREC_BFLOAT16:
+        {
+            uint64_t r = random_ops[i];
+            do {
+                r = xorshift64star(r);
+            } while (!bfloat16_is_normal(r));
+            random_ops[i] = r;
+            break;
+        }
         case PREC_SINGLE:
         case PREC_FLOAT32:
         {
@@ -191,13 +225,63 @@ static void update_random_ops(int n_ops, enum precision prec)
     }
 }
 
+/*
+ * Keep the unbiased exponent of @op in [0, 30], so that converting it to
+ * an int64 does not raise invalid.
+ */
+static void fit_int_range(union fp *op, enum precision prec)
+{
+    uint64_t e;
+
+    switch (prec) {
+    case PREC_FLOAT16:
+        e = (op->f16 >> 10) & 0x1f;
+        op->f16 = (op->f16 & 0x83ff) | ((15 + e % 16) << 10);
+        break;
+    case PREC_BFLOAT16:
+        e = (op->bf16 >> 7) & 0xff;
+        op->bf16 = (op->bf16 & 0x807f) | ((127 + e % 31) << 7);
+        break;
+    case PREC_SINGLE:
+    case PREC_FLOAT32:
+        e = (op->f32 >> 23) & 0xff;
+        op->f32 = (op->f32 & 0x807fffff) | ((127 + e % 31) << 23);
+        break;
+    case PREC_DOUBLE:
+    case PREC_FLOAT64:
+        e = (op->f64 >> 52) & 0x7ff;
+        op->f64 = (op->f64 & 0x800fffffffffffffULL) | ((1023 + e % 31) << 52);
+        break;
+    case PREC_QUAD:
+    case PREC_FLOAT128:
+        e = (op->f128.high >> 48) & 0x7fff;
+        op->f128.high = (op->f128.high & 0x8000ffffffffffffULL) |
+                        ((16383 + e % 31) << 48);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 static void fill_random(union fp *ops, int n_ops, enum precision prec,
-                        bool no_neg)
+                        enum op op, bool no_neg)
 {
     int i;
 
     for (i = 0; i < n_ops; i++) {
         switch (prec) {
+        case PREC_FLOAT16:
+            ops[i].f16 = make_float16(random_ops[i]);
+            if (no_neg && float16_is_neg(ops[i].f16)) {
+                ops[i].f16 = float16_chs(ops[i].f16);
+            }
+            break;
+        case PREC_BFLOAT16:
+            ops[i].bf16 = random_ops[i];
+            if (no_neg && bfloat16_is_neg(ops[i].bf16)) {
+                ops[i].bf16 = bfloat16_chs(ops[i].bf16);
+            }
+            break;
         case PREC_SINGLE:
         case PREC_FLOAT32:
             ops[i].f32 = make_float32(random_ops[i]);
@@ -222,6 +306,9 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
         default:
             g_assert_not_reached();
         }
+        if (op == OP_TO_INT) {
+            fit_int_range(&ops[i], prec);
+        }
     }
 }
 
@@ -235,13 +322,19 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
 
     while (get_clock() < tf) {
         union fp ops[MAX_OPERANDS];
+        /* for OP_CVT, a wider input with low bits to be rounded away */
+        union fp wide;
         int64_t t0;
         int i;
 
         update_random_ops(n_ops, prec);
+        fill_random(ops, n_ops, prec, op, no_neg);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            if (op == OP_CVT) {
+                wide.d = ops[0].f;
+                wide.u64 |= ops[1].u64 & 0x1fffffff;
+            }
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -270,13 +363,21 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_TO_INT:
+                    res.u64 = llrintf(a);
+                    break;
+                case OP_FROM_INT:
+                    res.f = (int32_t)ops[0].u64;
+                    break;
+                case OP_CVT:
+                    res.f = wide.d;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -305,19 +406,31 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_TO_INT:
+                    res.u64 = llrint(a);
+                    break;
+                case OP_FROM_INT:
+                    res.d = (int32_t)ops[0].u64;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            if (op == OP_CVT) {
+                wide.f64 = float32_to_float64(ops[0].f32, &soft_status) |
+                           (ops[1].f32 & 0x1fffffff);
+            }
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
                 float32 b = ops[1].f32;
                 float32 c = ops[2].f32;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f32 = float32_add(a, b, &soft_status);
@@ -340,19 +453,30 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_TO_INT:
+                    res.u64 = float32_to_int64(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f32 = int32_to_float32(ops[0].u64, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f32 = float64_to_float32(wide.f64, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
                 float64 b = ops[1].f64;
                 float64 c = ops[2].f64;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f64 = float64_add(a, b, &soft_status);
@@ -375,19 +499,27 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_TO_INT:
+                    res.u64 = float64_to_int64(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f64 = int32_to_float64(ops[0].u64, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT128:
-            fill_random(ops, n_ops, prec, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float128 a = ops[0].f128;
                 float128 b = ops[1].f128;
                 float128 c = ops[2].f128;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f128 = float128_add(a, b, &soft_status);
@@ -410,6 +542,112 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float128_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_TO_INT:
+                    res.u64 = float128_to_int64(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f128 = int32_to_float128(ops[0].u64, &soft_status);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
+        case PREC_FLOAT16:
+            if (op == OP_CVT) {
+                wide.f32 = float16_to_float32(ops[0].f16, true, &soft_status) |
+                           (ops[1].f16 & 0x1fff);
+            }
+            t0 = get_clock();
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                float16 a = ops[0].f16;
+                float16 b = ops[1].f16;
+                float16 c = ops[2].f16;
+
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
+                switch (op) {
+                case OP_ADD:
+                    res.f16 = float16_add(a, b, &soft_status);
+                    break;
+                case OP_SUB:
+                    res.f16 = float16_sub(a, b, &soft_status);
+                    break;
+                case OP_MUL:
+                    res.f16 = float16_mul(a, b, &soft_status);
+                    break;
+                case OP_DIV:
+                    res.f16 = float16_div(a, b, &soft_status);
+                    break;
+                case OP_FMA:
+                    res.f16 = float16_muladd(a, b, c, 0, &soft_status);
+                    break;
+                case OP_SQRT:
+                    res.f16 = float16_sqrt(a, &soft_status);
+                    break;
+                case OP_CMP:
+                    res.u64 = float16_compare_quiet(a, b, &soft_status);
+                    break;
+                case OP_TO_INT:
+                    res.u64 = float16_to_int64(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f16 = int32_to_float16(ops[0].u64, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f16 = float32_to_float16(wide.f32, true, &soft_status);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
+        case PREC_BFLOAT16:
+            if (op == OP_CVT) {
+                wide.f32 = bfloat16_to_float32(ops[0].bf16, &soft_status) |
+                           ops[1].bf16;
+            }
+            t0 = get_clock();
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                bfloat16 a = ops[0].bf16;
+                bfloat16 b = ops[1].bf16;
+                bfloat16 c = ops[2].bf16;
+
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
+                switch (op) {
+                case OP_ADD:
+                    res.bf16 = bfloat16_add(a, b, &soft_status);
+                    break;
+                case OP_SUB:
+                    res.bf16 = bfloat16_sub(a, b, &soft_status);
+                    break;
+                case OP_MUL:
+                    res.bf16 = bfloat16_mul(a, b, &soft_status);
+                    break;
+                case OP_DIV:
+                    res.bf16 = bfloat16_div(a, b, &soft_status);
+                    break;
+                case OP_FMA:
+                    res.bf16 = bfloat16_muladd(a, b, c, 0, &soft_status);
+                    break;
+                case OP_SQRT:
+                    res.bf16 = bfloat16_sqrt(a, &soft_status);
+                    break;
+                case OP_CMP:
+                    res.u64 = bfloat16_compare_quiet(a, b, &soft_status);
+                    break;
+                case OP_TO_INT:
+                    res.u64 = bfloat16_to_int64(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.bf16 = int32_to_bfloat16(ops[0].u64, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.bf16 = float32_to_bfloat16(wide.f32, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -440,7 +678,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
     GEN_BENCH(bench_ ## opname ## _double, double, PREC_DOUBLE, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _float32, float32, PREC_FLOAT32, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _float64, float64, PREC_FLOAT64, op, n_ops) \
-    GEN_BENCH(bench_ ## opname ## _float128, float128, PREC_FLOAT128, op, n_ops)
+    GEN_BENCH(bench_ ## opname ## _float128, float128, PREC_FLOAT128, op, n_ops) \
+    GEN_BENCH(bench_ ## opname ## _float16, float16, PREC_FLOAT16, op, n_ops) \
+    GEN_BENCH(bench_ ## opname ## _bfloat16, bfloat16, PREC_BFLOAT16, op, n_ops)
 
 GEN_BENCH_ALL_TYPES(add, OP_ADD, 2)
 GEN_BENCH_ALL_TYPES(sub, OP_SUB, 2)
@@ -448,14 +688,24 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(to_int, OP_TO_INT, 1)
+GEN_BENCH_ALL_TYPES(from_int, OP_FROM_INT, 1)
 #undef GEN_BENCH_ALL_TYPES
 
+/* conversions into each precision from the next wider one */
+GEN_BENCH(bench_cvt_float, float, PREC_SINGLE, OP_CVT, 2)
+GEN_BENCH(bench_cvt_float32, float32, PREC_FLOAT32, OP_CVT, 2)
+GEN_BENCH(bench_cvt_float16, float16, PREC_FLOAT16, OP_CVT, 2)
+GEN_BENCH(bench_cvt_bfloat16, bfloat16, PREC_BFLOAT16, OP_CVT, 2)
+
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float, float, PREC_SINGLE, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _double, double, PREC_DOUBLE, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float32, float32, PREC_FLOAT32, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float64, float64, PREC_FLOAT64, op, n) \
-    GEN_BENCH_NO_NEG(bench_ ## name ## _float128, float128, PREC_FLOAT128, op, n)
+    GEN_BENCH_NO_NEG(bench_ ## name ## _float128, float128, PREC_FLOAT128, op, n) \
+    GEN_BENCH_NO_NEG(bench_ ## name ## _float16, float16, PREC_FLOAT16, op, n) \
+    GEN_BENCH_NO_NEG(bench_ ## name ## _bfloat16, bfloat16, PREC_BFLOAT16, op, n)
 
 GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
 #undef GEN_BENCH_ALL_TYPES_NO_NEG
@@ -470,6 +720,8 @@ GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
         [PREC_FLOAT32]   = bench_ ## opname ## _float32,        \
         [PREC_FLOAT64]   = bench_ ## opname ## _float64,        \
         [PREC_FLOAT128]   = bench_ ## opname ## _float128,      \
+        [PREC_FLOAT16]   = bench_ ## opname ## _float16,        \
+        [PREC_BFLOAT16]  = bench_ ## opname ## _bfloat16,       \
     }
 
 static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
@@ -480,6 +732,14 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(to_int, OP_TO_INT),
+    GEN_BENCH_FUNCS(from_int, OP_FROM_INT),
+    [OP_CVT] = {
+        [PREC_SINGLE]    = bench_cvt_float,
+        [PREC_FLOAT32]   = bench_cvt_float32,
+        [PREC_FLOAT16]   = bench_cvt_float16,
+        [PREC_BFLOAT16]  = bench_cvt_bfloat16,
+    },
 };
 
 #undef GEN_BENCH_FUNCS
@@ -489,7 +749,11 @@ static void run_bench(void)
     bench_func_t f;
 
     f = bench_funcs[operation][precision];
-    g_assert(f);
+    if (!f) {
+        fprintf(stderr, "fatal: op '%s' not supported with this precision "
+                "and tester\n", op_names[operation]);
+        exit(EXIT_FAILURE);
+    }
     f();
 }
 
@@ -518,7 +782,10 @@ static void usage_complete(int argc, char *argv[])
     fprintf(stderr, " -h = show this help message.\n");
     fprintf(stderr, " -o = floating point operation (%s). Default: %s\n",
             op_list, op_names[0]);
-    fprintf(stderr, " -p = floating point precision (single, double, quad[soft only]). "
+    fprintf(stderr, " -f = clear exception flags before each operation "
+            "(soft tester only). Default: disabled\n");
+    fprintf(stderr, " -p = floating point precision (single, double, "
+            "quad[soft only], half[soft only], bfloat16[soft only]). "
             "Default: single\n");
     fprintf(stderr, " -r = rounding mode (even, zero, down, up, tieaway). "
             "Default: even\n");
@@ -615,7 +882,7 @@ static void parse_args(int argc, char *argv[])
     int rounding = ROUND_EVEN;
 
     for (;;) {
-        c = getopt(argc, argv, "d:ho:p:r:t:zZ");
+        c = getopt(argc, argv, "d:fho:p:r:t:zZ");
         if (c < 0) {
             break;
         }
@@ -623,6 +890,9 @@ static void parse_args(int argc, char *argv[])
         case 'd':
             duration = atoi(optarg);
             break;
+        case 'f':
+            clear_flags = true;
+            break;
         case 'h':
             usage_complete(argc, argv);
             exit(EXIT_SUCCESS);
@@ -641,6 +911,10 @@ static void parse_args(int argc, char *argv[])
                 precision = PREC_DOUBLE;
             } else if (!strcmp(optarg, "quad")) {
                 precision = PREC_QUAD;
+            } else if (!strcmp(optarg, "half")) {
+                precision = PREC_HALF;
+            } else if (!strcmp(optarg, "bfloat16")) {
+                precision = PREC_BF16;
             } else {
                 fprintf(stderr, "Unsupported precision '%s'\n", optarg);
                 exit(EXIT_FAILURE);
@@ -687,6 +961,12 @@ static void parse_args(int argc, char *argv[])
         case PREC_QUAD:
             precision = PREC_FLOAT128;
             break;
+        case PREC_HALF:
+            precision = PREC_FLOAT16;
+            break;
+        case PREC_BF16:
+            precision = PREC_BFLOAT16;
+            break;
         default:
             g_assert_not_reached();
         }
@@ -0,0 +1,130 @@
+/*
+ * Check that inline ops and conditional callbacks agree with callbacks.
+ *
+ * Every block and instruction is counted by a callback, by an inline op
+ * on a per-vCPU scoreboard and by a legacy inline op on a counter shared
+ * by all vCPUs. Each instruction also gets a conditional callback whose
+ * condition always holds. The shared counters are only exact when a
+ * single vCPU ran.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+typedef struct {
+    uint64_t tb;
+    uint64_t tb_inline;
+    uint64_t insn;
+    uint64_t insn_inline;
+    uint64_t insn_cond;
+} CPUCount;
+
+static struct qemu_plugin_scoreboard *counts;
+static qemu_plugin_u64 count_tb;
+static qemu_plugin_u64 count_tb_inline;
+static qemu_plugin_u64 count_insn;
+static qemu_plugin_u64 count_insn_inline;
+static qemu_plugin_u64 count_insn_cond;
+
+/* Updated by the legacy inline ops, racy with several vCPUs */
+static uint64_t shared_tb;
+static uint64_t shared_insn;
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new("");
+    uint64_t tb = qemu_plugin_u64_sum(count_tb);
+    uint64_t insn = qemu_plugin_u64_sum(count_insn);
+    unsigned int i, vcpus = 0;
+
+    for (i = 0; i < qemu_plugin_scoreboard_size(counts); i++) {
+        if (qemu_plugin_u64_get(count_tb, i)) {
+            vcpus++;
+        }
+    }
+    g_string_printf(report, "vcpus: %u, tb's: %" PRIu64 ", insns: %" PRIu64
+                    ", shared tb's: %" PRIu64 ", shared insns: %" PRIu64 "\n",
+                    vcpus, tb, insn, shared_tb, shared_insn);
+    qemu_plugin_outs(report->str);
+
+    g_assert(qemu_plugin_u64_sum(count_tb_inline) == tb);
+    g_assert(qemu_plugin_u64_sum(count_insn_inline) == insn);
+    g_assert(qemu_plugin_u64_sum(count_insn_cond) == insn);
+    if (vcpus <= 1) {
+        g_assert(shared_tb == tb);
+        g_assert(shared_insn == insn);
+    }
+    qemu_plugin_scoreboard_free(counts);
+}
+
+static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(count_tb, cpu_index, 1);
+}
+
+static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(count_insn, cpu_index, 1);
+}
+
+static void vcpu_insn_cond(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(count_insn_cond, cpu_index, 1);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n_insns = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
+                                         QEMU_PLUGIN_CB_NO_REGS, NULL);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, count_tb_inline, 1);
+    qemu_plugin_register_vcpu_tb_exec_inline(tb, QEMU_PLUGIN_INLINE_ADD_U64,
+                                             &shared_tb, 1);
+
+    for (i = 0; i < n_insns; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
+                                               QEMU_PLUGIN_CB_NO_REGS, NULL);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, count_insn_inline, 1);
+        qemu_plugin_register_vcpu_insn_exec_inline(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, &shared_insn, 1);
+        /* branches around the call between every two instructions */
+        qemu_plugin_register_vcpu_insn_exec_cond_cb(
+            insn, vcpu_insn_cond, QEMU_PLUGIN_CB_NO_REGS,
+            QEMU_PLUGIN_COND_NE, count_insn_inline, UINT64_MAX, NULL);
+    }
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    counts = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+    count_tb = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, tb);
+    count_tb_inline = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                           tb_inline);
+    count_insn = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, insn);
+    count_insn_inline = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                             insn_inline);
+    count_insn_cond = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                           insn_cond);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
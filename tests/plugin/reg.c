@@ -0,0 +1,112 @@
+/*
+ * Exercise the register read API.
+ *
+ * The register list is fetched at the first translation. The first
+ * instruction of every block reads all registers from a callback
+ * registered with QEMU_PLUGIN_CB_R_REGS, and every instruction reads
+ * the first register from a callback that declares it.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+static GMutex lock;
+static qemu_plugin_reg_descriptor *regs;
+static size_t n_regs;
+/* the register the per-insn callback declares */
+static struct qemu_plugin_register *first_reg;
+
+/* register reads, per vCPU */
+static struct qemu_plugin_scoreboard *reads;
+
+static int read_one(struct qemu_plugin_register *handle,
+                    unsigned int cpu_index)
+{
+    uint8_t buf[64];
+    /* wide vector registers are reported but not copied */
+    int len = qemu_plugin_read_register(handle, buf, sizeof(buf));
+
+    if (len > 0) {
+        qemu_plugin_u64_add(qemu_plugin_scoreboard_u64(reads), cpu_index, 1);
+    }
+    return len;
+}
+
+static void vcpu_tb_regs(unsigned int cpu_index, void *udata)
+{
+    size_t i;
+
+    for (i = 0; i < n_regs; i++) {
+        read_one(regs[i].handle, cpu_index);
+    }
+}
+
+static void vcpu_insn_reg(unsigned int cpu_index, void *udata)
+{
+    /* the first register is a general purpose one on every target */
+    int len = read_one(first_reg, cpu_index);
+
+    g_assert(len > 0);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n_insns = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    g_mutex_lock(&lock);
+    if (!regs) {
+        regs = qemu_plugin_get_registers(&n_regs);
+        g_assert(regs && n_regs > 0);
+        for (i = 0; i < n_regs; i++) {
+            g_assert(regs[i].name);
+        }
+        first_reg = regs[0].handle;
+    }
+    g_mutex_unlock(&lock);
+
+    for (i = 0; i < n_insns; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        if (i == 0) {
+            qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_tb_regs,
+                                                   QEMU_PLUGIN_CB_R_REGS,
+                                                   NULL);
+        }
+        qemu_plugin_register_vcpu_insn_exec_cb_regs(insn, vcpu_insn_reg,
+                                                    &first_reg, 1, NULL);
+    }
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new("");
+
+    g_string_printf(report, "registers: %zu, first: %s, reads: %" PRIu64 "\n",
+                    n_regs, n_regs ? regs[0].name : "none",
+                    qemu_plugin_u64_sum(qemu_plugin_scoreboard_u64(reads)));
+    qemu_plugin_outs(report->str);
+    qemu_plugin_scoreboard_free(reads);
+    g_free(regs);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    reads = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Exercise the vCPU sampling callback.
+ *
+ * Samples are counted per vCPU from the sampled vCPU's own thread, and
+ * the sampled addresses are collected to report how many distinct ones
+ * were seen. Short tests may legitimately end before the first sample.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+static struct qemu_plugin_scoreboard *samples;
+static GMutex lock;
+static GHashTable *pcs;
+/* sampling period in microseconds */
+static uint64_t period = 100;
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new("");
+
+    g_mutex_lock(&lock);
+    g_string_printf(report, "samples: %" PRIu64 ", distinct pcs: %u\n",
+                    qemu_plugin_u64_sum(qemu_plugin_scoreboard_u64(samples)),
+                    g_hash_table_size(pcs));
+    g_mutex_unlock(&lock);
+    qemu_plugin_outs(report->str);
+    qemu_plugin_scoreboard_free(samples);
+}
+
+static void vcpu_sample(qemu_plugin_id_t id, unsigned int vcpu_index,
+                        uint64_t pc, void *udata)
+{
+    /* called on the sampled vCPU, so its element is ours alone */
+    g_assert(vcpu_index < qemu_plugin_scoreboard_size(samples));
+    qemu_plugin_u64_add(qemu_plugin_scoreboard_u64(samples), vcpu_index, 1);
+
+    g_mutex_lock(&lock);
+    g_hash_table_add(pcs, (gpointer)(uintptr_t)pc);
+    g_mutex_unlock(&lock);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        char *opt = argv[i];
+        g_autofree char **tokens = g_strsplit(opt, "=", 2);
+        if (g_strcmp0(tokens[0], "period") == 0) {
+            period = g_ascii_strtoull(tokens[1], NULL, 10);
+            if (!period) {
+                fprintf(stderr, "invalid sampling period: %s\n", opt);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+
+    samples = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+    pcs = g_hash_table_new(NULL, NULL);
+
+    qemu_plugin_register_vcpu_sample_cb(id, vcpu_sample, period * 1000, NULL);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Test each condition immediately after the compare that sets the flags
+ *
+ * The translator tests a condition on the operands of a CMP or SUBS
+ * directly when the next insn uses it, so check every condition after
+ * CMP, CMN, SUBS and CMP #imm, in 32 and 64 bits, by B.cond and by
+ * CSET, against flags computed here.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum { EQ, NE, CS, CC, MI, PL, VS, VC, HI, LS, GE, LT, GT, LE, NCOND };
+
+static const char * const cond_names[NCOND] = {
+    "eq", "ne", "cs", "cc", "mi", "pl", "vs", "vc",
+    "hi", "ls", "ge", "lt", "gt", "le",
+};
+
+/*
+ * The compare and the insn testing its condition must be adjacent, so
+ * each case is a single asm statement.  %1 is scratch for SUBS.
+ */
+#define CSET(INSN, C)                                                 \
+    asm(INSN "\n\tcset %w0, " C                                       \
+        : "=r"(r), "=&r"(t) : "r"(a), "r"(b) : "cc")
+#define BCOND(INSN, C)                                                \
+    asm(INSN "\n\tb." C " 1f\n\t"                                     \
+        "mov %w0, #0\n\tb 2f\n"                                       \
+        "1:\tmov %w0, #1\n2:"                                         \
+        : "=r"(r), "=&r"(t) : "r"(a), "r"(b) : "cc")
+
+#define CASE(INSN, N, C)                                              \
+    case N:                                                           \
+        if (branch) {                                                 \
+            BCOND(INSN, C);                                           \
+        } else {                                                      \
+            CSET(INSN, C);                                            \
+        }                                                             \
+        break;
+
+#define DEF_OP(NAME, INSN)                                            \
+static int NAME(int cond, bool branch, uint64_t a, uint64_t b)        \
+{                                                                     \
+    uint64_t t;                                                       \
+    int r = -1;                                                       \
+                                                                      \
+    switch (cond) {                                                   \
+    CASE(INSN, EQ, "eq")                                              \
+    CASE(INSN, NE, "ne")                                              \
+    CASE(INSN, CS, "cs")                                              \
+    CASE(INSN, CC, "cc")                                              \
+    CASE(INSN, MI, "mi")                                              \
+    CASE(INSN, PL, "pl")                                              \
+    CASE(INSN, VS, "vs")                                              \
+    CASE(INSN, VC, "vc")                                              \
+    CASE(INSN, HI, "hi")                                              \
+    CASE(INSN, LS, "ls")                                              \
+    CASE(INSN, GE, "ge")                                              \
+    CASE(INSN, LT, "lt")                                              \
+    CASE(INSN, GT, "gt")                                              \
+    CASE(INSN, LE, "le")                                              \
+    }                                                                 \
+    (void)t;                                                          \
+    return r;                                                         \
+}
+
+DEF_OP(cmp_x, "cmp %x2, %x3")
+DEF_OP(cmn_x, "cmn %x2, %x3")
+DEF_OP(subs_x, "subs %x1, %x2, %x3")
+DEF_OP(cmpi_x, "cmp %x2, #1")
+DEF_OP(cmp_w, "cmp %w2, %w3")
+DEF_OP(cmn_w, "cmn %w2, %w3")
+DEF_OP(subs_w, "subs %w1, %w2, %w3")
+DEF_OP(cmpi_w, "cmp %w2, #1")
+
+static const struct {
+    const char *name;
+    int (*fn)(int, bool, uint64_t, uint64_t);
+    bool add;       /* Flags of a + b, rather than a - b */
+    bool imm;       /* Compares with #1, ignoring b */
+    int bits;
+} ops[] = {
+    { "cmp", cmp_x, false, false, 64 },
+    { "cmn", cmn_x, true, false, 64 },
+    { "subs", subs_x, false, false, 64 },
+    { "cmp #1", cmpi_x, false, true, 64 },
+    { "cmp", cmp_w, false, false, 32 },
+    { "cmn", cmn_w, true, false, 32 },
+    { "subs", subs_w, false, false, 32 },
+    { "cmp #1", cmpi_w, false, true, 32 },
+};
+
+/* Signed overflow, unsigned wrap and equality at both widths */
+static const uint64_t values[] = {
+    0, 1, 2, -1ull, -2ull,
+    0x7fffffff, 0x80000000, 0x80000001, 0xffffffff, 0x100000000ull,
+    0x7fffffffffffffffull, 0x8000000000000000ull, 0x8000000000000001ull,
+};
+
+static bool test_cond(int cond, bool n, bool z, bool c, bool v)
+{
+    switch (cond) {
+    case EQ: return z;
+    case NE: return !z;
+    case CS: return c;
+    case CC: return !c;
+    case MI: return n;
+    case PL: return !n;
+    case VS: return v;
+    case VC: return !v;
+    case HI: return c && !z;
+    case LS: return !c || z;
+    case GE: return n == v;
+    case LT: return n != v;
+    case GT: return !z && n == v;
+    case LE: return z || n != v;
+    }
+    return false;
+}
+
+static bool expect(int cond, bool add, int bits, uint64_t a, uint64_t b)
+{
+    uint64_t sign = 1ull << (bits - 1);
+    uint64_t mask = sign | (sign - 1);
+    uint64_t r;
+    bool c, v;
+
+    a &= mask;
+    b &= mask;
+    if (add) {
+        r = (a + b) & mask;
+        c = r < a;
+        v = ~(a ^ b) & (a ^ r) & sign;
+    } else {
+        r = (a - b) & mask;
+        c = a >= b;
+        v = (a ^ b) & (a ^ r) & sign;
+    }
+    return test_cond(cond, r & sign, r == 0, c, v);
+}
+
+int main(void)
+{
+    int nvalues = sizeof(values) / sizeof(values[0]);
+    int err = 0;
+
+    for (int o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+        for (int i = 0; i < nvalues; i++) {
+            for (int j = 0; j < nvalues; j++) {
+                uint64_t a = values[i];
+                uint64_t b = ops[o].imm ? 1 : values[j];
+
+                if (ops[o].imm && j) {
+                    break;
+                }
+                for (int cond = 0; cond < NCOND; cond++) {
+                    bool e = expect(cond, ops[o].add, ops[o].bits, a, b);
+
+                    for (int branch = 0; branch < 2; branch++) {
+                        int r = ops[o].fn(cond, branch, a, b);
+
+                        if (r != e) {
+                            printf("%s (%d bits) %#llx, %#llx; %s%s: "
+                                   "got %d, expected %d\n",
+                                   ops[o].name, ops[o].bits,
+                                   (unsigned long long)a,
+                                   (unsigned long long)b,
+                                   branch ? "b." : "cset ", cond_names[cond],
+                                   r, e);
+                            err = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return err;
+}
@@ -0,0 +1,256 @@
+/*
+ * SVE load/store throughput
+ *
+ * Time each form of SVE contiguous and gather/scatter memory access
+ * over a buffer and report the bytes moved per second.  The data moved
+ * by every form is checked, so this also serves as a functional test of
+ * the fast paths.
+ *
+ * Usage: sve-ldst [iterations]
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BUF_SIZE (256 * 1024)
+
+static uint8_t src[BUF_SIZE] __attribute__((aligned(64)));
+static uint8_t dst[BUF_SIZE] __attribute__((aligned(64)));
+
+/*
+ * Contiguous forms: MN is the mnemonic suffix, T the element type
+ * and LSL the index scaling for the element size.
+ */
+#define SVE_CONT(MN, T, LSL)                                            \
+static void load_##MN(const void *s, void *d, uint64_t n)               \
+{                                                                       \
+    uint64_t i = 0;                                                     \
+    asm volatile("mov z1.d, #0\n\t"                                     \
+                 "whilelo p0." #T ", %[i], %[n]\n\t"                    \
+                 "b.none 2f\n"                                          \
+                 "1:\tld1" #MN " {z0." #T "}, p0/z, "                   \
+                 "[%[s], %[i]" LSL "]\n\t"                              \
+                 "eor z1.d, z1.d, z0.d\n\t"                             \
+                 "inc" #MN " %[i]\n\t"                                  \
+                 "whilelo p0." #T ", %[i], %[n]\n\t"                    \
+                 "b.first 1b\n"                                         \
+                 "2:\tptrue p0.b\n\t"                                   \
+                 "st1b {z1.b}, p0, [%[d]]"                              \
+                 : [i] "+r"(i)                                          \
+                 : [s] "r"(s), [d] "r"(d), [n] "r"(n)                   \
+                 : "z0", "z1", "p0", "memory", "cc");                   \
+}                                                                       \
+static void store_##MN(const void *s, void *d, uint64_t n)              \
+{                                                                       \
+    uint64_t i = 0;                                                     \
+    asm volatile("mov z0." #T ", #1\n\t"                                \
+                 "whilelo p0." #T ", %[i], %[n]\n\t"                    \
+                 "b.none 2f\n"                                          \
+                 "1:\tst1" #MN " {z0." #T "}, p0, "                     \
+                 "[%[d], %[i]" LSL "]\n\t"                              \
+                 "inc" #MN " %[i]\n\t"                                  \
+                 "whilelo p0." #T ", %[i], %[n]\n\t"                    \
+                 "b.first 1b\n"                                         \
+                 "2:"                                                   \
+                 : [i] "+r"(i)                                          \
+                 : [d] "r"(d), [n] "r"(n)                               \
+                 : "z0", "p0", "memory", "cc");                         \
+}                                                                       \
+static void copy_##MN(const void *s, void *d, uint64_t n)               \
+{                                                                       \
+    uint64_t i = 0;                                                     \
+    asm volatile("whilelo p0." #T ", %[i], %[n]\n\t"                    \
+                 "b.none 2f\n"                                          \
+                 "1:\tld1" #MN " {z0." #T "}, p0/z, "                   \
+                 "[%[s], %[i]" LSL "]\n\t"                              \
+                 "st1" #MN " {z0." #T "}, p0, "                         \
+                 "[%[d], %[i]" LSL "]\n\t"                              \
+                 "inc" #MN " %[i]\n\t"                                  \
+                 "whilelo p0." #T ", %[i], %[n]\n\t"                    \
+                 "b.first 1b\n"                                         \
+                 "2:"                                                   \
+                 : [i] "+r"(i)                                          \
+                 : [s] "r"(s), [d] "r"(d), [n] "r"(n)                   \
+                 : "z0", "p0", "memory", "cc");                         \
+}
+
+SVE_CONT(b, b, "")
+SVE_CONT(h, h, ", lsl #1")
+SVE_CONT(w, s, ", lsl #2")
+SVE_CONT(d, d, ", lsl #3")
+
+/*
+ * Gather/scatter forms, with 64-bit elements at a vector of indexes
+ * from the loop counter.  Consecutive indexes keep each vector within
+ * a page or two, as for a typical indexed loop.
+ */
+static void gather_d(const void *s, void *d, uint64_t n)
+{
+    uint64_t i = 0;
+    asm volatile("mov z1.d, #0\n\t"
+                 "whilelo p0.d, %[i], %[n]\n\t"
+                 "b.none 2f\n"
+                 "1:\tindex z2.d, %[i], #1\n\t"
+                 "ld1d {z0.d}, p0/z, [%[s], z2.d, lsl #3]\n\t"
+                 "eor z1.d, z1.d, z0.d\n\t"
+                 "incd %[i]\n\t"
+                 "whilelo p0.d, %[i], %[n]\n\t"
+                 "b.first 1b\n"
+                 "2:\tptrue p0.b\n\t"
+                 "st1b {z1.b}, p0, [%[d]]"
+                 : [i] "+r"(i)
+                 : [s] "r"(s), [d] "r"(d), [n] "r"(n)
+                 : "z0", "z1", "z2", "p0", "memory", "cc");
+}
+
+static void scatter_d(const void *s, void *d, uint64_t n)
+{
+    uint64_t i = 0;
+    asm volatile("mov z0.d, #1\n\t"
+                 "whilelo p0.d, %[i], %[n]\n\t"
+                 "b.none 2f\n"
+                 "1:\tindex z2.d, %[i], #1\n\t"
+                 "st1d {z0.d}, p0, [%[d], z2.d, lsl #3]\n\t"
+                 "incd %[i]\n\t"
+                 "whilelo p0.d, %[i], %[n]\n\t"
+                 "b.first 1b\n"
+                 "2:"
+                 : [i] "+r"(i)
+                 : [d] "r"(d), [n] "r"(n)
+                 : "z0", "z2", "p0", "memory", "cc");
+}
+
+static void copy_gather_d(const void *s, void *d, uint64_t n)
+{
+    uint64_t i = 0;
+    asm volatile("whilelo p0.d, %[i], %[n]\n\t"
+                 "b.none 2f\n"
+                 "1:\tindex z2.d, %[i], #1\n\t"
+                 "ld1d {z0.d}, p0/z, [%[s], z2.d, lsl #3]\n\t"
+                 "st1d {z0.d}, p0, [%[d], z2.d, lsl #3]\n\t"
+                 "incd %[i]\n\t"
+                 "whilelo p0.d, %[i], %[n]\n\t"
+                 "b.first 1b\n"
+                 "2:"
+                 : [i] "+r"(i)
+                 : [s] "r"(s), [d] "r"(d), [n] "r"(n)
+                 : "z0", "z2", "p0", "memory", "cc");
+}
+
+typedef void ldst_fn(const void *s, void *d, uint64_t n);
+
+/*
+ * LOAD forms leave the XOR of all the vectors they loaded in the first
+ * vector length of dst, STORE forms fill each element with 1, and COPY
+ * forms copy src to dst.
+ */
+enum { LOAD, STORE, COPY };
+
+typedef struct {
+    const char *name;
+    ldst_fn *fn;
+    int esize;
+    int kind;
+} LdSt;
+
+static const LdSt tests[] = {
+    { "ld1b", load_b, 1, LOAD },
+    { "ld1h", load_h, 2, LOAD },
+    { "ld1w", load_w, 4, LOAD },
+    { "ld1d", load_d, 8, LOAD },
+    { "st1b", store_b, 1, STORE },
+    { "st1h", store_h, 2, STORE },
+    { "st1w", store_w, 4, STORE },
+    { "st1d", store_d, 8, STORE },
+    { "ld1b+st1b", copy_b, 1, COPY },
+    { "ld1h+st1h", copy_h, 2, COPY },
+    { "ld1w+st1w", copy_w, 4, COPY },
+    { "ld1d+st1d", copy_d, 8, COPY },
+    { "ld1d (gather)", gather_d, 8, LOAD },
+    { "st1d (scatter)", scatter_d, 8, STORE },
+    { "ld1d+st1d (gather/scatter)", copy_gather_d, 8, COPY },
+};
+
+static uint8_t expect[BUF_SIZE];
+
+static uint64_t vector_bytes(void)
+{
+    uint64_t vl;
+
+    asm("cntb %0" : "=r"(vl));
+    return vl;
+}
+
+/* Fill expect[] with what l->fn leaves in dst for @n elements. */
+static void expected_result(const LdSt *l, uint64_t n)
+{
+    uint64_t vl = vector_bytes();
+    uint64_t bytes = n * l->esize;
+    uint64_t j;
+
+    memset(expect, 0, BUF_SIZE);
+    switch (l->kind) {
+    case LOAD:
+        for (j = 0; j < bytes; j++) {
+            expect[j % vl] ^= src[j];
+        }
+        break;
+    case STORE:
+        for (j = 0; j < bytes; j += l->esize) {
+            expect[j] = 1;  /* little-endian element of value 1 */
+        }
+        break;
+    case COPY:
+        memcpy(expect, src, bytes);
+        break;
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    int iters = argc > 1 ? atoi(argv[1]) : 16;
+    int err = 0;
+    size_t t;
+    int i;
+
+    for (i = 0; i < BUF_SIZE; i++) {
+        src[i] = i * 7 + (i >> 8);
+    }
+
+    for (t = 0; t < sizeof(tests) / sizeof(tests[0]); t++) {
+        const LdSt *l = &tests[t];
+        /* Leave room for the 2048-bit result of the load forms. */
+        uint64_t n = (BUF_SIZE - 256) / l->esize;
+        double start, secs;
+
+        memset(dst, 0, BUF_SIZE);
+        start = now();
+        for (i = 0; i < iters; i++) {
+            l->fn(src, dst, n);
+        }
+        secs = now() - start;
+
+        expected_result(l, n);
+        if (memcmp(expect, dst, BUF_SIZE) != 0) {
+            printf("%-28s FAIL: data mismatch\n", l->name);
+            err = 1;
+            continue;
+        }
+        printf("%-28s %10.1f MB/s\n", l->name,
+               secs > 0 ? (double)n * l->esize * iters / secs / 1e6 : 0.0);
+    }
+
+    return err;
+}
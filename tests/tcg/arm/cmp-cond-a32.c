@@ -0,0 +1,185 @@
+/*
+ * Test each condition immediately after the compare that sets the flags
+ *
+ * The translator tests a condition on the operands of a CMP, SUBS or
+ * RSBS directly when the next insn uses it, so check every condition
+ * after CMP, CMN, SUBS, RSBS and CMP #imm, against flags computed here.
+ * Each is tested in A32 by a conditional MOV and a conditional branch,
+ * and in T32 by an IT block and a conditional branch.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifdef __thumb__
+#error "This test must be compiled for ARM"
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum { EQ, NE, CS, CC, MI, PL, VS, VC, HI, LS, GE, LT, GT, LE, NCOND };
+
+static const char * const cond_names[NCOND] = {
+    "eq", "ne", "cs", "cc", "mi", "pl", "vs", "vc",
+    "hi", "ls", "ge", "lt", "gt", "le",
+};
+
+/*
+ * The compare and the insn testing its condition must be adjacent, so
+ * each case is a single asm statement.  %1 is scratch for SUBS and RSBS.
+ */
+#define SETC_A32(INSN, C)                                             \
+    asm("mov %0, #0\n\t" INSN "\n\t"                                  \
+        "mov" C " %0, #1"                                             \
+        : "=&r"(r), "=&r"(t) : "r"(a), "r"(b) : "cc")
+#define SETC_T32(INSN, C)                                             \
+    asm("mov %0, #0\n\t" INSN "\n\t"                                  \
+        "it " C "\n\tmov" C " %0, #1"                                 \
+        : "=&r"(r), "=&r"(t) : "r"(a), "r"(b) : "cc")
+#define BCOND(INSN, C)                                                \
+    asm(INSN "\n\tb" C " 1f\n\t"                                      \
+        "mov %0, #0\n\tb 2f\n"                                        \
+        "1:\tmov %0, #1\n2:"                                          \
+        : "=r"(r), "=&r"(t) : "r"(a), "r"(b) : "cc")
+
+#define CASE(SETC, INSN, N, C)                                        \
+    case N:                                                           \
+        if (branch) {                                                 \
+            BCOND(INSN, C);                                           \
+        } else {                                                      \
+            SETC(INSN, C);                                            \
+        }                                                             \
+        break;
+
+#define DEF_FN(NAME, ATTR, SETC, INSN)                                \
+static int ATTR NAME(int cond, bool branch, uint32_t a, uint32_t b)   \
+{                                                                     \
+    uint32_t t;                                                       \
+    int r = -1;                                                       \
+                                                                      \
+    switch (cond) {                                                   \
+    CASE(SETC, INSN, EQ, "eq")                                        \
+    CASE(SETC, INSN, NE, "ne")                                        \
+    CASE(SETC, INSN, CS, "cs")                                        \
+    CASE(SETC, INSN, CC, "cc")                                        \
+    CASE(SETC, INSN, MI, "mi")                                        \
+    CASE(SETC, INSN, PL, "pl")                                        \
+    CASE(SETC, INSN, VS, "vs")                                        \
+    CASE(SETC, INSN, VC, "vc")                                        \
+    CASE(SETC, INSN, HI, "hi")                                        \
+    CASE(SETC, INSN, LS, "ls")                                        \
+    CASE(SETC, INSN, GE, "ge")                                        \
+    CASE(SETC, INSN, LT, "lt")                                        \
+    CASE(SETC, INSN, GT, "gt")                                        \
+    CASE(SETC, INSN, LE, "le")                                        \
+    }                                                                 \
+    (void)t;                                                          \
+    return r;                                                         \
+}
+
+#define DEF_OP(NAME, INSN)                                            \
+    DEF_FN(NAME##_a32, , SETC_A32, INSN)                              \
+    DEF_FN(NAME##_t32, __attribute__((target("thumb"))), SETC_T32, INSN)
+
+DEF_OP(cmp, "cmp %2, %3")
+DEF_OP(cmn, "cmn %2, %3")
+DEF_OP(subs, "subs %1, %2, %3")
+DEF_OP(rsbs, "rsbs %1, %3, %2")
+DEF_OP(cmpi, "cmp %2, #1")
+
+typedef int test_fn(int, bool, uint32_t, uint32_t);
+
+static const struct {
+    const char *name;
+    test_fn *a32, *t32;
+    bool add;       /* Flags of a + b, rather than a - b */
+    bool imm;       /* Compares with #1, ignoring b */
+} ops[] = {
+    { "cmp", cmp_a32, cmp_t32, false, false },
+    { "cmn", cmn_a32, cmn_t32, true, false },
+    { "subs", subs_a32, subs_t32, false, false },
+    { "rsbs", rsbs_a32, rsbs_t32, false, false },
+    { "cmp #1", cmpi_a32, cmpi_t32, false, true },
+};
+
+/* Signed overflow, unsigned wrap and equality */
+static const uint32_t values[] = {
+    0, 1, 2, -1u, -2u, 0x7ffffffe, 0x7fffffff, 0x80000000, 0x80000001,
+};
+
+static bool test_cond(int cond, bool n, bool z, bool c, bool v)
+{
+    switch (cond) {
+    case EQ: return z;
+    case NE: return !z;
+    case CS: return c;
+    case CC: return !c;
+    case MI: return n;
+    case PL: return !n;
+    case VS: return v;
+    case VC: return !v;
+    case HI: return c && !z;
+    case LS: return !c || z;
+    case GE: return n == v;
+    case LT: return n != v;
+    case GT: return !z && n == v;
+    case LE: return z || n != v;
+    }
+    return false;
+}
+
+static bool expect(int cond, bool add, uint32_t a, uint32_t b)
+{
+    uint32_t r;
+    bool c, v;
+
+    if (add) {
+        r = a + b;
+        c = r < a;
+        v = (~(a ^ b) & (a ^ r)) >> 31;
+    } else {
+        r = a - b;
+        c = a >= b;
+        v = ((a ^ b) & (a ^ r)) >> 31;
+    }
+    return test_cond(cond, r >> 31, r == 0, c, v);
+}
+
+int main(void)
+{
+    int nvalues = sizeof(values) / sizeof(values[0]);
+    int err = 0;
+
+    for (int o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+        for (int i = 0; i < nvalues; i++) {
+            for (int j = 0; j < nvalues; j++) {
+                uint32_t a = values[i];
+                uint32_t b = ops[o].imm ? 1 : values[j];
+
+                if (ops[o].imm && j) {
+                    break;
+                }
+                for (int cond = 0; cond < NCOND; cond++) {
+                    bool e = expect(cond, ops[o].add, a, b);
+
+                    for (int k = 0; k < 4; k++) {
+                        bool thumb = k & 2, branch = k & 1;
+                        test_fn *fn = thumb ? ops[o].t32 : ops[o].a32;
+                        int r = fn(cond, branch, a, b);
+
+                        if (r != e) {
+                            printf("%s %s %#x, %#x; %s%s: "
+                                   "got %d, expected %d\n",
+                                   thumb ? "T32" : "A32", ops[o].name, a, b,
+                                   branch ? "b" : thumb ? "it " : "mov",
+                                   cond_names[cond], r, e);
+                            err = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return err;
+}
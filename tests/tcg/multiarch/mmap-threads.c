@@ -0,0 +1,252 @@
+/*
+ * Threaded mapping stress test
+ *
+ * Several threads change the protection of their own mappings and
+ * replace scratch mappings in a tight loop, checking that the contents
+ * and permissions stay consistent. Under linux-user this exercises the
+ * page flags from many threads at once; the elapsed time makes it usable
+ * as a benchmark of mapping changes in parallel.
+ *
+ * On hosts whose instructions we know how to write, one more thread keeps
+ * calling a function on a code page while another makes the page writable,
+ * rewrites the value the function returns and makes it executable again.
+ * The caller must never see the value go back, and must see the last one.
+ *
+ * Usage: mmap-threads [threads [iterations]]
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define REGION_PAGES 16
+
+static int n_threads = 4;
+static int n_iters = 2000;
+static size_t pagesize;
+
+typedef struct {
+    int index;
+    unsigned long ops;
+} ThreadArg;
+
+static void *map_pages(size_t len, int prot)
+{
+    void *p = mmap(NULL, len, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    assert(p != MAP_FAILED);
+    return p;
+}
+
+static void protect_pages(void *p, size_t len, int prot)
+{
+    int ret = mprotect(p, len, prot);
+
+    assert(ret == 0);
+}
+
+static void unmap_pages(void *p, size_t len)
+{
+    int ret = munmap(p, len);
+
+    assert(ret == 0);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_CODE_WRITER
+/* mov $val, %eax; ret */
+static void write_code(uint8_t *code, int val)
+{
+    code[0] = 0xb8;
+    memcpy(code + 1, &val, 4);
+    code[5] = 0xc3;
+}
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HAVE_CODE_WRITER
+/* mov w0, #val; ret */
+static void write_code(uint8_t *code, int val)
+{
+    uint32_t insn[2] = { 0x52800000 | (val << 5), 0xd65f03c0 };
+
+    memcpy(code, insn, sizeof(insn));
+}
+#elif defined(__arm__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HAVE_CODE_WRITER
+/* movw r0, #val; bx lr */
+static void write_code(uint8_t *code, int val)
+{
+    uint32_t insn[2] = {
+        0xe3000000 | ((val & 0xf000) << 4) | (val & 0xfff), 0xe12fff1e
+    };
+
+    memcpy(code, insn, sizeof(insn));
+}
+#elif defined(__riscv)
+#define HAVE_CODE_WRITER
+/* li a0, val; ret */
+static void write_code(uint8_t *code, int val)
+{
+    uint32_t insn[2] = { (val << 20) | 0x513, 0x8067 };
+
+    memcpy(code, insn, sizeof(insn));
+}
+#endif
+
+#ifdef HAVE_CODE_WRITER
+/* fits the immediate of every encoding above */
+#define CODE_MAX_VALUE 2047
+
+static uint8_t *code;
+static int code_value;
+static bool code_done;
+
+/* make the code page writable, change it, and make it executable again */
+static void *flip_fn(void *varg)
+{
+    ThreadArg *arg = varg;
+    int n = n_iters < CODE_MAX_VALUE ? n_iters : CODE_MAX_VALUE;
+    int i;
+
+    for (i = 1; i <= n; i++) {
+        protect_pages(code, pagesize, PROT_READ | PROT_WRITE | PROT_EXEC);
+        write_code(code, i);
+        __builtin___clear_cache((char *)code, (char *)code + pagesize);
+        protect_pages(code, pagesize, PROT_READ | PROT_EXEC);
+        __atomic_store_n(&code_value, i, __ATOMIC_RELEASE);
+        arg->ops += 2;
+    }
+    __atomic_store_n(&code_done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* call the code until the last change is done, and once after it */
+static void *exec_fn(void *varg)
+{
+    int (*fn)(void) = (int (*)(void))code;
+    int last = 0;
+    bool done;
+
+    do {
+        int val;
+
+        done = __atomic_load_n(&code_done, __ATOMIC_ACQUIRE);
+        val = fn();
+        assert(val >= last);
+        assert(val <= __atomic_load_n(&code_value, __ATOMIC_ACQUIRE));
+        last = val;
+    } while (!done);
+    assert(last == code_value);
+    return NULL;
+}
+#endif
+
+static void *thread_fn(void *varg)
+{
+    ThreadArg *arg = varg;
+    size_t len = REGION_PAGES * pagesize;
+    uint8_t *region = map_pages(len, PROT_READ | PROT_WRITE);
+    int i, j;
+
+    for (i = 0; i < n_iters; i++) {
+        uint8_t val = arg->index + i;
+        uint8_t *scratch;
+
+        /* make the pages read-only one at a time, then writable again */
+        for (j = 0; j < REGION_PAGES; j++) {
+            region[j * pagesize] = val;
+            protect_pages(region + j * pagesize, pagesize, PROT_READ);
+            arg->ops++;
+        }
+        for (j = 0; j < REGION_PAGES; j++) {
+            assert(region[j * pagesize] == val);
+        }
+        protect_pages(region, len, PROT_NONE);
+        protect_pages(region, len, PROT_READ | PROT_WRITE);
+        arg->ops += 2;
+        for (j = 0; j < REGION_PAGES; j++) {
+            assert(region[j * pagesize] == val);
+        }
+
+        /* and replace a short-lived mapping */
+        scratch = map_pages(2 * pagesize, PROT_READ | PROT_WRITE);
+        memset(scratch, val, 2 * pagesize);
+        assert(scratch[2 * pagesize - 1] == val);
+        unmap_pages(scratch, 2 * pagesize);
+        arg->ops += 2;
+    }
+
+    unmap_pages(region, len);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t *threads;
+    ThreadArg *args;
+#ifdef HAVE_CODE_WRITER
+    pthread_t flip_thread, exec_thread;
+    ThreadArg flip_arg = { 0 };
+#endif
+    struct timespec start, end;
+    unsigned long ops = 0;
+    double secs;
+    int i;
+
+    if (argc > 1) {
+        n_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        n_iters = atoi(argv[2]);
+    }
+    pagesize = getpagesize();
+
+    threads = calloc(n_threads, sizeof(pthread_t));
+    args = calloc(n_threads, sizeof(ThreadArg));
+
+#ifdef HAVE_CODE_WRITER
+    code = map_pages(pagesize, PROT_READ | PROT_WRITE);
+    write_code(code, 0);
+    __builtin___clear_cache((char *)code, (char *)code + pagesize);
+    protect_pages(code, pagesize, PROT_READ | PROT_EXEC);
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+#ifdef HAVE_CODE_WRITER
+    pthread_create(&exec_thread, NULL, exec_fn, NULL);
+    pthread_create(&flip_thread, NULL, flip_fn, &flip_arg);
+#endif
+    for (i = 0; i < n_threads; i++) {
+        args[i].index = i;
+        pthread_create(&threads[i], NULL, thread_fn, &args[i]);
+    }
+    for (i = 0; i < n_threads; i++) {
+        pthread_join(threads[i], NULL);
+        ops += args[i].ops;
+    }
+#ifdef HAVE_CODE_WRITER
+    pthread_join(flip_thread, NULL);
+    pthread_join(exec_thread, NULL);
+    ops += flip_arg.ops;
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d threads, %lu mapping changes in %.3fs (%.0f/s)\n",
+           n_threads, ops, secs, secs > 0 ? ops / secs : 0);
+
+#ifdef HAVE_CODE_WRITER
+    unmap_pages(code, pagesize);
+#endif
+    free(args);
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#!/bin/sh
+#
+# Check the ops logged for the ld-forward test
+#
+# $1 is the output of the test, which gives the address of the block, and
+# $2 the -d op_opt log.  The block must load xmm0 from env twice: once for
+# the two movq before cpuid, and once more after it.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+pc=$(sed -n 's/^ld_forward_block //p' "$1")
+if [ -z "$pc" ]; then
+    echo "$1: no block address" >&2
+    exit 1
+fi
+
+loads=$(awk -v start=" ---- $pc" '
+    /^OP after optimization/ { if (found) exit }
+    index($0, start) == 1 { found = 1 }
+    found && / ld_i64 / { n++ }
+    END { print n + 0 }' "$2")
+
+if [ "$loads" -ne 2 ]; then
+    echo "$2: expected 2 loads of xmm0 at $pc, found $loads" >&2
+    exit 1
+fi
@@ -0,0 +1,44 @@
+/*
+ * Load forwarding from env in the TCG optimizer
+ *
+ * Each movq from xmm0 below loads it from env, and all of them are in one
+ * translation block.  The optimizer must reuse the first load for the
+ * second, and load xmm0 again after cpuid, whose helper may write env.
+ * check-ld-forward.sh counts the loads in the op_opt log.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+uint64_t ld_forward(uint64_t val);
+extern char ld_forward_block[];
+
+/*
+ * The jump starts a new block, so that the store to xmm0 is not forwarded
+ * to the loads that are checked.
+ */
+asm(".text\n"
+    ".globl ld_forward, ld_forward_block\n"
+    "ld_forward:\n"
+    "    mov %rbx, %r8\n"
+    "    movq %rdi, %xmm0\n"
+    "    jmp ld_forward_block\n"
+    "ld_forward_block:\n"
+    "    movq %xmm0, %rsi\n"
+    "    movq %xmm0, %rcx\n"
+    "    xor %eax, %eax\n"
+    "    cpuid\n"
+    "    movq %xmm0, %rdx\n"
+    "    mov %r8, %rbx\n"
+    "    lea (%rsi, %rdx), %rax\n"
+    "    ret\n");
+
+int main(void)
+{
+    uint64_t ret = ld_forward(21);
+
+    printf("ld_forward_block %016lx\n", (unsigned long)ld_forward_block);
+    return ret == 42 ? 0 : 1;
+}